@@ -30,6 +30,7 @@ SOURCES += \
     src/application.cpp \
     src/autoonline.cpp \
     src/bucket.cpp \
+    src/buyoutjournal.cpp \
     src/buyoutmanager.cpp \
     src/column.cpp \
     src/currencymanager.cpp \
@@ -37,12 +38,18 @@ SOURCES += \
     src/filesystem.cpp \
     src/filters.cpp \
     src/flowlayout.cpp \
+    src/htmlform.cpp \
     src/imagecache.cpp \
+    src/imagepack.cpp \
     src/item.cpp \
+    src/itemarena.cpp \
+    src/itembitmap.cpp \
+    src/itemchangeset.cpp \
     src/itemlocation.cpp \
     src/items_model.cpp \
     src/itemsmanager.cpp \
     src/itemsmanagerworker.cpp \
+    src/itemstore.cpp \
     src/itemtooltip.cpp \
     src/logindialog.cpp \
     src/logpanel.cpp \
@@ -52,20 +59,32 @@ SOURCES += \
     src/modlist.cpp \
     src/modsfilter.cpp \
     src/porting.cpp \
+    src/prefetcher.cpp \
+    src/rendercache.cpp \
     src/replytimeout.cpp \
     src/search.cpp \
     src/shop.cpp \
+    src/shoplayout.cpp \
     src/steamlogindialog.cpp \
     src/tabcache.cpp \
     src/updatechecker.cpp \
     src/util.cpp \
     src/version.cpp \
     src/verticalscrollarea.cpp \
+    src/writebehinddatastore.cpp \
+    test/mockforum.cpp \
+    test/testautoonline.cpp \
     test/testdata.cpp \
+    test/testdatastore.cpp \
+    test/testhtmlform.cpp \
+    test/testimagecache.cpp \
     test/testitem.cpp \
     test/testitemsmanager.cpp \
+    test/testitemstore.cpp \
     test/testmain.cpp \
+    test/testrendercache.cpp \
     test/testshop.cpp \
+    test/testtabcache.cpp \
     test/testutil.cpp
 
 HEADERS += \
@@ -73,6 +92,7 @@ HEADERS += \
     src/application.h \
     src/autoonline.h \
     src/bucket.h \
+    src/buyoutjournal.h \
     src/buyoutmanager.h \
     src/column.h \
     src/currencymanager.h \
@@ -81,13 +101,19 @@ HEADERS += \
     src/filesystem.h \
     src/filters.h \
     src/flowlayout.h \
+    src/htmlform.h \
     src/imagecache.h \
+    src/imagepack.h \
     src/item.h \
+    src/itemarena.h \
+    src/itembitmap.h \
+    src/itemchangeset.h \
     src/itemconstants.h \
     src/itemlocation.h \
     src/items_model.h \
     src/itemsmanager.h \
     src/itemsmanagerworker.h \
+    src/itemstore.h \
     src/itemtooltip.h \
     src/logindialog.h \
     src/logpanel.h \
@@ -96,11 +122,14 @@ HEADERS += \
     src/modlist.h \
     src/modsfilter.h \
     src/porting.h \
+    src/prefetcher.h \
+    src/rendercache.h \
     src/rapidjson_util.h \
     src/replytimeout.h \
     src/search.h \
     src/selfdestructingreply.h \
     src/shop.h \
+    src/shoplayout.h \
     src/steamlogindialog.h \
     src/tabcache.h \
     src/updatechecker.h \
@@ -108,11 +137,20 @@ HEADERS += \
     src/version.h \
     src/version_defines.h \
     src/verticalscrollarea.h \
+    src/writebehinddatastore.h \
+    test/mockforum.h \
+    test/testautoonline.h \
     test/testdata.h \
+    test/testdatastore.h \
+    test/testhtmlform.h \
+    test/testimagecache.h \
     test/testitem.h \
     test/testitemsmanager.h \
+    test/testitemstore.h \
     test/testmain.h \
+    test/testrendercache.h \
     test/testshop.h \
+    test/testtabcache.h \
     test/testutil.h
 
 FORMS += \
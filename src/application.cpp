@@ -20,6 +20,7 @@
 #include "application.h"
 
 #include <QNetworkAccessManager>
+#include <QTimer>
 
 #include "buyoutmanager.h"
 #include "sqlitedatastore.h"
@@ -31,6 +32,7 @@
 #include "shop.h"
 #include "QsLog.h"
 #include "version.h"
+#include "writebehinddatastore.h"
 
 Application::Application() {}
 
@@ -41,30 +43,46 @@ Application::~Application() {
 
 void Application::InitLogin(std::unique_ptr<QNetworkAccessManager> login_manager, const std::string &league, const std::string &email,
         bool mock_data) {
+    startup_timer_.start();
     league_ = league;
     email_ = email;
     logged_in_nm_ = std::move(login_manager);
 
+    std::string buyout_journal;
     if (mock_data) {
         // This is used in tests
         data_ = std::make_unique<MemoryDataStore>();
         sensitive_data_ = std::make_unique<MemoryDataStore>();
     } else {
         std::string data_file = SqliteDataStore::MakeFilename(email, league);
-        data_ = std::make_unique<SqliteDataStore>(Filesystem::UserDir() + "/data/" + data_file);
-        sensitive_data_ = std::make_unique<SqliteDataStore>(Filesystem::UserDir() + "/sensitive_data/" + data_file);
+        // writes are stored on a separate thread so that disk latency doesn't stall the UI
+        data_ = std::make_unique<WriteBehindDataStore>(
+            std::make_unique<SqliteDataStore>(Filesystem::UserDir() + "/data/" + data_file));
+        sensitive_data_ = std::make_unique<WriteBehindDataStore>(
+            std::make_unique<SqliteDataStore>(Filesystem::UserDir() + "/sensitive_data/" + data_file));
+        buyout_journal = Filesystem::UserDir() + "/data/" + data_file + ".journal";
         SaveDbOnNewVersion();
     }
-    buyout_manager_ = std::make_unique<BuyoutManager>(*data_);
+    buyout_manager_ = std::make_unique<BuyoutManager>(*data_, buyout_journal);
     shop_ = std::make_unique<Shop>(*this);
     items_manager_ = std::make_unique<ItemsManager>(*this);
     currency_manager_ = std::make_unique<CurrencyManager>(*this);
     connect(items_manager_.get(), &ItemsManager::ItemsRefreshed, this, &Application::OnItemsRefreshed);
+    // Start() shows the items of the local snapshot and tab cache, the server
+    // is only asked for changes once they are on screen.
     items_manager_->Start();
-    items_manager_->Update(TabSelection::Checked);
 }
 
 void Application::OnItemsRefreshed(bool initial_refresh) {
+    if (initial_refresh && !refresh_started_) {
+        refresh_started_ = true;
+        // queued behind the other slots of this refresh, including the one rendering the items
+        QTimer::singleShot(0, this, [this]() {
+            QLOG_INFO() << "Interactive" << startup_timer_.elapsed() << "ms after login with"
+                        << items_manager_->items().size() << "local items, refreshing from the server";
+            items_manager_->Update(TabSelection::Checked);
+        });
+    }
     currency_manager_->Update();
     shop_->Update();
     if (!initial_refresh && shop_->auto_update())
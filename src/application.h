@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QObject>
 
@@ -63,5 +64,8 @@ private:
     std::unique_ptr<QNetworkAccessManager> logged_in_nm_;
     std::unique_ptr<ItemsManager> items_manager_;
     std::unique_ptr<CurrencyManager> currency_manager_;
+    // time to interactive is measured from login
+    QElapsedTimer startup_timer_;
+    bool refresh_started_{false};
     void SaveDbOnNewVersion();
 };
@@ -22,22 +22,40 @@
 #if defined(Q_OS_WIN32)
 #include <windows.h>
 #include <tlhelp32.h>
-#elif defined(Q_OS_LINUX) || defined(Q_OS_MAC)
-#include <QProcess>
 #endif
 
+#include <QDirIterator>
+#include <QFile>
+#include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QRunnable>
+#include <functional>
 #include "QsLog.h"
 #include "datastore.h"
 #include "version.h"
 
 namespace {
 
+// Enough of a command line to find the game's executable in it
+const qint64 kMaxCommandLine = 4096;
+
+class CheckTask : public QRunnable {
+public:
+    explicit CheckTask(const std::function<void()> &task) : task_(task) {}
+    void run() { task_(); }
+private:
+    std::function<void()> task_;
+};
+
+// Runs on a background thread
 bool is_poe_running_locally() {
-#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+#if defined(Q_OS_LINUX)
+    return IsProcessRunning("/proc", "PathOfExile");
+#elif defined(Q_OS_MAC)
     QProcess process;
     process.start("/bin/sh -c \"ps -ax|grep PathOfExile|grep -v grep|wc -l\"");
-    process.waitForFinished(-1);
+    if (!process.waitForFinished(kRemoteScriptTimeout))
+        process.kill();
     QString i = process.readAllStandardOutput();
     return i.toInt() > 0;
 #elif defined(Q_OS_WIN)
@@ -72,44 +90,66 @@ bool is_poe_running_locally() {
 #endif
 }
 
-bool is_poe_running_remotely(const std::string& script) {
-#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
-    std::string poe_check_script = "/bin/sh -c \"" + script + "\"";
-
-    QProcess process;
-    process.start(poe_check_script.c_str());
-    process.waitForFinished(-1);
+}
 
-    return process.exitCode() == 0;
-#else
-    Q_UNUSED(script);
-    QLOG_ERROR() << "Script handling has not been implemented on this Operating System";
+bool IsProcessRunning(const QString &proc_dir, const QByteArray &name) {
+    QDirIterator it(proc_dir, QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        bool is_pid = false;
+        it.fileName().toUInt(&is_pid);
+        if (!is_pid)
+            continue;
+        // the process may have exited since it was listed
+        QFile command_line(it.filePath() + "/cmdline");
+        if (command_line.open(QIODevice::ReadOnly) && command_line.read(kMaxCommandLine).contains(name))
+            return true;
+    }
     return false;
-#endif
 }
 
-
-} //end of anonymous namespace
-
-// check for PoE running every minute
-const int kOnlineCheckInterval = 60 * 1000;
-
 AutoOnline::AutoOnline(DataStore &data, DataStore &sensitive_data) :
     data_(data),
     sensitive_data_(sensitive_data),
     enabled_(data_.GetBool("online_enabled")),
     url_(sensitive_data_.Get("online_url")),
     process_script_(data.Get("process_script")),
-    previous_status_(true)  // set to true to force first refresh
+    previous_status_(true),  // set to true to force first refresh
+    checking_(false)
 {
-    timer_.setInterval(kOnlineCheckInterval);
+    pool_.setMaxThreadCount(1);
+    timer_.setInterval(CheckInterval());
     connect(&timer_, &QTimer::timeout, this, &AutoOnline::Check);
+    connect(this, &AutoOnline::Checked, this, &AutoOnline::OnChecked, Qt::QueuedConnection);
+    connect(&script_, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, &AutoOnline::OnScriptFinished);
+    connect(&script_, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        // otherwise finished() follows
+        if (error == QProcess::FailedToStart) {
+            QLOG_ERROR() << "Can't run the remote script" << process_script_.c_str() << ":" << script_.errorString();
+            script_timeout_.stop();
+            checking_ = false;
+        }
+    });
+    script_timeout_.setSingleShot(true);
+    script_timeout_.setInterval(kRemoteScriptTimeout);
+    connect(&script_timeout_, &QTimer::timeout, this, &AutoOnline::OnScriptTimeout);
     if (enabled_) {
         timer_.start();
         Check();
     }
 }
 
+AutoOnline::~AutoOnline() {
+    // the check emits a signal of this object
+    pool_.waitForDone();
+    if (script_.state() != QProcess::NotRunning) {
+        script_.disconnect(this);
+        script_.kill();
+        script_.waitForFinished();
+    }
+}
+
 void AutoOnline::SendOnlineUpdate(bool online) {
     // online: true  -> Go online
     // online: false -> Go offline
@@ -120,26 +160,61 @@ void AutoOnline::SendOnlineUpdate(bool online) {
     QNetworkRequest request(QUrl(url.c_str()));
     QByteArray data;
     request.setHeader(QNetworkRequest::UserAgentHeader, (std::string("Acquisition ") + VERSION_NAME).c_str());
-    nm_.post(request, data);
+    QNetworkReply *reply = nm_.post(request, data);
+    connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
+    last_update_.start();
 }
 
 void AutoOnline::Check() {
-    bool running = is_poe_running_locally();
-    if (IsRemoteScriptSet()){
-        running = is_poe_running_remotely(process_script_);
-    } else {
-        running = is_poe_running_locally();
+    if (checking_)
+        return;
+    checking_ = true;
+    if (!IsRemoteScriptSet()) {
+        pool_.start(new CheckTask([this]() {
+            emit Checked(is_poe_running_locally());
+        }));
+        return;
     }
+#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+    script_.start("/bin/sh", { "-c", process_script_.c_str() });
+    script_timeout_.start();
+#else
+    QLOG_ERROR() << "Script handling has not been implemented on this Operating System";
+    OnChecked(false);
+#endif
+}
 
-    if (running || previous_status_) {
+void AutoOnline::OnChecked(bool running) {
+    checking_ = false;
+    // Send changes right away, and keep telling the server we're online while
+    // the game runs.  The margin lets process scans update about once a minute,
+    // and remote scripts, run once a minute, on every check even if the timer
+    // fires early or the script is faster than the last time.
+    if (running != previous_status_ || (running && (!last_update_.isValid()
+            || last_update_.hasExpired(kOnlineCheckInterval - kProcessCheckInterval))))
         SendOnlineUpdate(running);
-    }
 
     previous_status_ = running;
 
     emit Update(running);
 }
 
+void AutoOnline::OnScriptFinished(int exit_code, QProcess::ExitStatus status) {
+    script_timeout_.stop();
+    if (status != QProcess::NormalExit) {
+        // killed after timing out, or crashed: we don't know any better than before
+        QLOG_WARN() << "The remote script" << process_script_.c_str() << "didn't finish:" << script_.errorString();
+        checking_ = false;
+        return;
+    }
+    OnChecked(exit_code == 0);
+}
+
+void AutoOnline::OnScriptTimeout() {
+    QLOG_WARN() << "The remote script took longer than" << script_timeout_.interval() / 1000 << "seconds, stopping it";
+    script_.kill();
+}
+
 const std::vector<std::string> url_valid_prefixes = { "http://control.poe.xyz.is/", "http://control.poe.trade/" };
 
 void AutoOnline::SetUrl(const std::string &url) {
@@ -160,6 +235,11 @@ void AutoOnline::SetUrl(const std::string &url) {
 void AutoOnline::SetRemoteScript(const std::string& path) {
     process_script_ = path;
     data_.Set("process_script", path);
+    timer_.setInterval(CheckInterval());
+}
+
+int AutoOnline::CheckInterval() {
+    return IsRemoteScriptSet() ? kOnlineCheckInterval : kProcessCheckInterval;
 }
 
 void AutoOnline::SetEnabled(bool enabled) {
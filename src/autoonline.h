@@ -19,16 +19,32 @@
 
 #pragma once
 
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QObject>
+#include <QProcess>
+#include <QThreadPool>
 #include <QTimer>
 
 class DataStore;
 
+// How often to look for the game on this computer, in ms
+const int kProcessCheckInterval = 5 * 1000;
+// How often remote scripts run, and how often the server is told we're online
+// while the game runs, in ms
+const int kOnlineCheckInterval = 60 * 1000;
+// Remote scripts still running after this long are killed, in ms
+const int kRemoteScriptTimeout = 30 * 1000;
+
+// Whether a process whose command line contains name is running, looking at
+// the /proc/<pid>/cmdline files under proc_dir
+bool IsProcessRunning(const QString &proc_dir, const QByteArray &name);
+
 class AutoOnline : public QObject {
     Q_OBJECT
 public:
     AutoOnline(DataStore &data, DataStore &sensitive_data);
+    ~AutoOnline();
     void SetUrl(const std::string &url);
     void SetEnabled(bool enabled);
     bool enabled() { return enabled_; }
@@ -36,17 +52,37 @@ public:
     bool IsRemoteScriptSet() { return !process_script_.empty(); }
     void SendOnlineUpdate(bool online);
     void SetRemoteScript(const std::string& script);
+    // used by tests
+    void SetRemoteScriptTimeout(int timeout) { script_timeout_.setInterval(timeout); }
 public slots:
+    // Starts looking for the game without waiting for it; Update is emitted
+    // when that's done
     void Check();
 signals:
     void Update(bool running);
+    // emitted by the background check
+    void Checked(bool running);
+private slots:
+    void OnChecked(bool running);
+    void OnScriptFinished(int exit_code, QProcess::ExitStatus status);
+    void OnScriptTimeout();
 private:
+    // Polls quickly for the local scan, which is cheap, but not for scripts
+    int CheckInterval();
+
     DataStore &data_;
     DataStore &sensitive_data_;
     bool enabled_;
     std::string url_;
     std::string process_script_;
     bool previous_status_;
+    // a check is running, so don't start another one
+    bool checking_;
+    // since online status was last sent
+    QElapsedTimer last_update_;
     QTimer timer_;
     QNetworkAccessManager nm_;
+    QThreadPool pool_;
+    QProcess script_;
+    QTimer script_timeout_;
 };
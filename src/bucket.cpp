@@ -1,6 +1,8 @@
 #include "bucket.h"
 #include "QMessageBox"
 
+#include "itemstore.h"
+
 // this is required by std::map's operator[]
 Bucket::Bucket()
 {}
@@ -9,32 +11,71 @@ Bucket::Bucket(const ItemLocation &location):
     location_(location)
 {}
 
-void Bucket::AddItem(const std::shared_ptr<Item> & item) {
-    items_.push_back(item);
+Bucket::Bucket(const ItemLocation &location, const ItemStore &store, const ItemBitmap &ids):
+    store_(&store),
+    generation_(store.generation()),
+    ids_(ids),
+    location_(location)
+{}
+
+const std::vector<ItemId> &Bucket::rows() const {
+    if (!rows_valid_) {
+        rows_ = ids_.ToVector();
+        rows_valid_ = true;
+    }
+    return rows_;
 }
 
 const std::shared_ptr<Item> &Bucket::item(int row) const
 {
+    auto const &rows = this->rows();
     if (row >= 0) {
-        std::vector<Items>::size_type row_t = (size_t) row;  // Assumes int max() always able to fit in unsigned long long
-        if (row_t < items_.size()) {
-            return items_[row_t];
+        std::vector<ItemId>::size_type row_t = (size_t) row;  // Assumes int max() always able to fit in unsigned long long
+        if (row_t < rows.size()) {
+            ItemHandle handle;
+            handle.id = rows[row_t];
+            handle.generation = generation_;
+            if (store_->IsValid(handle))
+                return store_->item(handle.id);
+            QMessageBox::critical(nullptr, "Fatal Error", "Item bucket refers to items from a previous refresh. Program will abort.");
+            abort();
         }
     }
 
     QMessageBox::critical(nullptr, "Fatal Error", QString("Item row out of bounds: ") +
-                          QString::number(row) + " item count: " + QString::number(items_.size()) +
+                          QString::number(row) + " item count: " + QString::number(rows.size()) +
                           ". Program will abort.");
     abort();
 
 }
 
+int Bucket::row(ItemId id) const
+{
+    if (!ids_.Contains(id))
+        return -1;
+    if (!row_index_valid_) {
+        auto const &rows = this->rows();
+        row_index_.clear();
+        row_index_.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+            row_index_[rows[i]] = static_cast<int>(i);
+        row_index_valid_ = true;
+    }
+    auto it = row_index_.find(id);
+    return it == row_index_.end() ? -1 : it->second;
+}
+
 void Bucket::Sort(const Column &column, Qt::SortOrder order)
 {
-    std::sort(begin(items_), end(items_), [&](const std::shared_ptr<Item>& lhs, const std::shared_ptr<Item>& rhs) {
+    if (!store_)
+        return;
+    rows();
+    row_index_valid_ = false;
+    auto const &store = *store_;
+    std::sort(begin(rows_), end(rows_), [&](ItemId lhs, ItemId rhs) {
         if (order == Qt::AscendingOrder) {
-            return column.lt(rhs.get(),lhs.get());
+            return column.lt(store.item(rhs).get(), store.item(lhs).get());
         }
-        return column.lt(lhs.get(),rhs.get());
+        return column.lt(store.item(lhs).get(), store.item(rhs).get());
     });
 }
@@ -1,23 +1,42 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 
 #include "item.h"
 #include "column.h"
+#include "itembitmap.h"
+
+class ItemStore;
 
 // A bucket holds set of filtered items.
 // Items are "bucketed" by their location: stash tab / character.
+// Items are referenced by their ItemStore id, the row order is only
+// materialised when the bucket is actually displayed (sorted).
 class Bucket {
 public:
     Bucket();
     explicit Bucket(const ItemLocation &location);
-    void AddItem(const std::shared_ptr<Item> &item);
-    const Items &items() const { return items_; }
+    Bucket(const ItemLocation &location, const ItemStore &store, const ItemBitmap &ids);
+    size_t size() const { return ids_.Cardinality(); }
+    const ItemBitmap &ids() const { return ids_; }
     const std::shared_ptr<Item> &item(int row) const;
+    // Current row of the item with the given id, -1 if it's not in this bucket
+    int row(ItemId id) const;
     const ItemLocation &location() const { return location_; }
     void Sort(const Column &column, Qt::SortOrder order);
 
 private:
-    Items items_;
+    const std::vector<ItemId> &rows() const;
+
+    const ItemStore *store_{nullptr};
+    // ItemStore generation the ids refer to
+    uint32_t generation_{0};
+    ItemBitmap ids_;
+    mutable std::vector<ItemId> rows_;
+    mutable bool rows_valid_{false};
+    // id -> row, rebuilt lazily after the rows are sorted
+    mutable std::unordered_map<ItemId, int> row_index_;
+    mutable bool row_index_valid_{false};
     ItemLocation location_;
 };
@@ -0,0 +1,77 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "buyoutjournal.h"
+
+#include "QsLog.h"
+
+BuyoutJournal::BuyoutJournal(const std::string &filename) :
+    file_(QString::fromStdString(filename))
+{
+    if (!file_.open(QIODevice::ReadWrite | QIODevice::Append))
+        QLOG_ERROR() << "Failed to open buyout journal" << filename.c_str() << ":" << file_.errorString();
+    size_ = ReadAll().size();
+}
+
+void BuyoutJournal::Append(const std::string &record) {
+    if (!file_.isOpen())
+        return;
+    file_.write(record.c_str(), record.size());
+    file_.write("\n", 1);
+    ++size_;
+}
+
+void BuyoutJournal::Flush() {
+    file_.flush();
+}
+
+std::vector<std::string> BuyoutJournal::ReadAll() {
+    std::vector<std::string> records;
+    if (!file_.isOpen())
+        return records;
+    file_.flush();
+    file_.seek(0);
+    while (!file_.atEnd()) {
+        QByteArray line = file_.readLine();
+        // a record cut short by a crash has no newline and is dropped
+        if (!line.endsWith('\n'))
+            break;
+        line.chop(1);
+        if (!line.isEmpty())
+            records.push_back(line.toStdString());
+    }
+    return records;
+}
+
+void BuyoutJournal::Clear() {
+    if (!file_.isOpen() || file_.size() == 0)
+        return;
+    file_.resize(0);
+    size_ = 0;
+}
+
+void BuyoutJournal::Drop(size_t count) {
+    if (count == 0)
+        return;
+    auto records = ReadAll();
+    Clear();
+    for (size_t i = count; i < records.size(); ++i)
+        Append(records[i]);
+    Flush();
+}
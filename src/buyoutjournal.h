@@ -0,0 +1,47 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QFile>
+#include <string>
+#include <vector>
+
+/*
+ * Append-only log of records (one per line) that have not made it into the
+ * DataStore yet.  BuyoutManager appends every user edit here as it happens so
+ * that nothing is lost if Acquisition exits before the next save, replays the
+ * log on startup and drops records once they are stored.
+ */
+class BuyoutJournal {
+public:
+    explicit BuyoutJournal(const std::string &filename);
+    void Append(const std::string &record);
+    // Makes appended records durable
+    void Flush();
+    std::vector<std::string> ReadAll();
+    void Clear();
+    // Removes the `count` oldest records, keeping the ones appended after them
+    void Drop(size_t count);
+    // number of records appended since the journal was last cleared
+    size_t size() const { return size_; }
+private:
+    QFile file_;
+    size_t size_{0};
+};
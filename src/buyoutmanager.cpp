@@ -19,21 +19,22 @@
 
 #include "buyoutmanager.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <sstream>
 #include <stdexcept>
-#include <regex>
 #include "QsLog.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/error/en.h"
 
 #include "application.h"
+#include "buyoutjournal.h"
 #include "datastore.h"
 #include "rapidjson_util.h"
 #include "util.h"
 #include "itemlocation.h"
-#include "QVariant"
 
 const std::string Currency::currency_type_error_;
 
@@ -195,24 +196,43 @@ const std::map<std::string, Currency> BuyoutManager::string_to_currency_type_ =
     {"silver", CURRENCY_SILVER_COIN},
 };
 
-BuyoutManager::BuyoutManager(DataStore &data) :
-    data_(data),
-    save_needed_(false)
+BuyoutManager::BuyoutManager(DataStore &data, const std::string &journal_file) :
+    data_(data)
 {
+    save_timer_.setSingleShot(true);
+    save_timer_.setInterval(kSaveDelay);
+    QObject::connect(&save_timer_, &QTimer::timeout, [this]() { Save(); });
+    journal_timer_.setSingleShot(true);
+    journal_timer_.setInterval(kJournalCheckInterval);
+    QObject::connect(&journal_timer_, &QTimer::timeout, [this]() { TrimJournal(); });
+    if (!journal_file.empty())
+        journal_ = std::make_unique<BuyoutJournal>(journal_file);
     Load();
 }
 
+// out of line because of unique_ptr<BuyoutJournal>
+BuyoutManager::~BuyoutManager() {
+    // whatever isn't stored yet is replayed on the next start
+    TrimJournal();
+}
+
 void BuyoutManager::Set(const Item &item, const Buyout &buyout) {
-    auto it = buyouts_.lower_bound(item.hash());
-    if (it != buyouts_.end() && !(buyouts_.key_comp()(item.hash(), it->first))) {
+    SetItemBuyout(item.hash(), buyout);
+}
+
+void BuyoutManager::SetItemBuyout(const std::string &hash, const Buyout &buyout) {
+    auto it = buyouts_.lower_bound(hash);
+    if (it != buyouts_.end() && !(buyouts_.key_comp()(hash, it->first))) {
         // Entry exists - we don't want to update if buyout is equal to existing
         if (buyout != it->second) {
-            save_needed_ = true;
+            RecordEdit(false, hash, it->second, buyout);
+            dirty_buyouts_.insert(hash);
             it->second = buyout;
         }
     } else {
-        save_needed_ = true;
-        buyouts_.insert(it, {item.hash(), buyout});
+        RecordEdit(false, hash, Buyout(), buyout);
+        dirty_buyouts_.insert(hash);
+        buyouts_.insert(it, {hash, buyout});
     }
 }
 
@@ -237,11 +257,15 @@ void BuyoutManager::SetTab(const std::string &tab, const Buyout &buyout) {
     if (it != tab_buyouts_.end() && !(tab_buyouts_.key_comp()(tab, it->first))) {
         // Entry exists - we don't want to update if buyout is equal to existing
         if (buyout != it->second) {
-            save_needed_ = true;
+            RecordEdit(true, tab, it->second, buyout);
+            dirty_tab_buyouts_.insert(tab);
+            changed_tabs_.insert(tab);
             it->second = buyout;
         }
     } else {
-        save_needed_ = true;
+        RecordEdit(true, tab, Buyout(), buyout);
+        dirty_tab_buyouts_.insert(tab);
+        changed_tabs_.insert(tab);
         tab_buyouts_.insert(it, {tab, buyout});
     }
 }
@@ -256,7 +280,8 @@ void BuyoutManager::CompressTabBuyouts() {
 
     for (auto it = tab_buyouts_.begin(), ite = tab_buyouts_.end(); it != ite;) {
         if (tmp.count(it->first) == 0) {
-            save_needed_ = true;
+            dirty_tab_buyouts_.insert(it->first);
+            changed_tabs_.insert(it->first);
             it = tab_buyouts_.erase(it);
         } else {
             ++it;
@@ -276,7 +301,7 @@ void BuyoutManager::CompressItemBuyouts(const Items &items) {
 
     for (auto it = buyouts_.cbegin(); it != buyouts_.cend();) {
         if (tmp.count(it->first) == 0) {
-
+            dirty_buyouts_.insert(it->first);
             buyouts_.erase(it++);
         } else {
             ++it;
@@ -285,7 +310,7 @@ void BuyoutManager::CompressItemBuyouts(const Items &items) {
 }
 
 void BuyoutManager::SetRefreshChecked(const ItemLocation &loc, bool value) {
-    save_needed_ = true;
+    dirty_refresh_checked_.insert(loc.GetUniqueHash());
     refresh_checked_[loc.GetUniqueHash()] = value;
 }
 
@@ -303,51 +328,119 @@ void BuyoutManager::SetRefreshLocked(const ItemLocation &loc) {
     refresh_locked_.insert(loc.GetUniqueHash());
 }
 
+void BuyoutManager::ClearRefreshLocked(const ItemLocation &loc) {
+    refresh_locked_.erase(loc.GetUniqueHash());
+}
+
 void BuyoutManager::ClearRefreshLocks() {
     refresh_locked_.clear();
 }
 
+void BuyoutManager::ClearTabChanges() {
+    changed_tabs_.clear();
+    all_tabs_changed_ = false;
+}
+
 void BuyoutManager::Clear() {
-    save_needed_ = true;
+    // everything has to be deleted from the data store on the next save
+    for (auto &bo : buyouts_)
+        dirty_buyouts_.insert(bo.first);
+    for (auto &bo : tab_buyouts_)
+        dirty_tab_buyouts_.insert(bo.first);
+    for (auto &checked : refresh_checked_)
+        dirty_refresh_checked_.insert(checked.first);
     buyouts_.clear();
     tab_buyouts_.clear();
     refresh_locked_.clear();
     refresh_checked_.clear();
     tabs_.clear();
+    undo_.clear();
+    redo_.clear();
+    all_tabs_changed_ = true;
 }
 
-std::string BuyoutManager::Serialize(const std::map<std::string, Buyout> &buyouts) {
-    rapidjson::Document doc;
-    doc.SetObject();
-    auto &alloc = doc.GetAllocator();
-
-    for (auto &bo : buyouts) {
-        const Buyout &buyout = bo.second;
-        if (!buyout.IsSavable())
-            continue;
-        rapidjson::Value item(rapidjson::kObjectType);
-        item.AddMember("value", buyout.value, alloc);
-
-        if (!buyout.last_update.isNull()){
-            item.AddMember("last_update", buyout.last_update.toTime_t(), alloc);
-        }else{
-            // If last_update is null, set as the actual time
-            item.AddMember("last_update", QDateTime::currentDateTime().toTime_t(), alloc);
-        }
+namespace {
+
+// Whether BuyoutFromJson can read object
+bool IsBuyoutJson(const rapidjson::Value &object) {
+    return object.IsObject()
+        && object.HasMember("currency") && object["currency"].IsString()
+        && object.HasMember("type") && object["type"].IsString()
+        && object.HasMember("value") && object["value"].IsNumber()
+        && (!object.HasMember("last_update") || object["last_update"].IsInt())
+        && (!object.HasMember("source") || object["source"].IsString())
+        && (!object.HasMember("inherited") || object["inherited"].IsBool());
+}
 
-        Util::RapidjsonAddConstString(&item, "type", buyout.BuyoutTypeAsTag(), alloc);
-        Util::RapidjsonAddConstString(&item, "currency", buyout.CurrencyAsTag(), alloc);
-        Util::RapidjsonAddConstString(&item, "source", buyout.BuyoutSourceAsTag(), alloc);
+Buyout BuyoutFromJson(const rapidjson::Value &object) {
+    Buyout bo;
+    bo.currency = Currency::FromTag(object["currency"].GetString());
+    bo.type = Buyout::TagAsBuyoutType(object["type"].GetString());
+    bo.value = object["value"].GetDouble();
+    if (object.HasMember("last_update")){
+        bo.last_update = QDateTime::fromTime_t(object["last_update"].GetInt());
+    }
+    if (object.HasMember("source")){
+        bo.source = Buyout::TagAsBuyoutSource(object["source"].GetString());
+    }
+    bo.inherited = false;
+    if (object.HasMember("inherited"))
+        bo.inherited = object["inherited"].GetBool();
+    return bo;
+}
 
-        item.AddMember("inherited", buyout.inherited, alloc);
+rapidjson::Value BuyoutToJson(const Buyout &buyout, rapidjson_allocator &alloc) {
+    rapidjson::Value item(rapidjson::kObjectType);
+    item.AddMember("value", buyout.value, alloc);
 
-        rapidjson::Value name(bo.first.c_str(), alloc);
-        doc.AddMember(name, item, alloc);
+    if (!buyout.last_update.isNull()){
+        item.AddMember("last_update", buyout.last_update.toTime_t(), alloc);
+    }else{
+        // If last_update is null, set as the actual time
+        item.AddMember("last_update", QDateTime::currentDateTime().toTime_t(), alloc);
     }
 
+    Util::RapidjsonAddConstString(&item, "type", buyout.BuyoutTypeAsTag(), alloc);
+    Util::RapidjsonAddConstString(&item, "currency", buyout.CurrencyAsTag(), alloc);
+    Util::RapidjsonAddConstString(&item, "source", buyout.BuyoutSourceAsTag(), alloc);
+
+    item.AddMember("inherited", buyout.inherited, alloc);
+    return item;
+}
+
+}
+
+std::string BuyoutManager::SerializeBuyout(const Buyout &buyout) {
+    rapidjson::Document doc;
+    rapidjson::Value item = BuyoutToJson(buyout, doc.GetAllocator());
+    return Util::RapidjsonSerialize(item);
+}
+
+std::string BuyoutManager::SerializeEdit(const BuyoutEdit &edit) {
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto &alloc = doc.GetAllocator();
+    doc.AddMember("tab", edit.tab, alloc);
+    rapidjson::Value key(edit.key.c_str(), alloc);
+    doc.AddMember("key", key, alloc);
+    doc.AddMember("time", QDateTime::currentDateTime().toTime_t(), alloc);
+    rapidjson::Value before = BuyoutToJson(edit.before, alloc);
+    doc.AddMember("before", before, alloc);
+    rapidjson::Value after = BuyoutToJson(edit.after, alloc);
+    doc.AddMember("after", after, alloc);
     return Util::RapidjsonSerialize(doc);
 }
 
+bool BuyoutManager::DeserializeBuyout(const std::string &data, Buyout *buyout) {
+    rapidjson::Document object;
+    if (object.Parse(data.c_str()).HasParseError() || !object.IsObject()) {
+        QLOG_ERROR() << "Error while parsing buyout:" << data.c_str();
+        return false;
+    }
+    *buyout = BuyoutFromJson(object);
+    return true;
+}
+
 void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, Buyout> *buyouts) {
     buyouts->clear();
 
@@ -363,41 +456,11 @@ void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, B
     }
     if (!doc.IsObject())
         return;
-    for (auto itr = doc.MemberBegin(); itr != doc.MemberEnd(); ++itr) {
-        auto &object = itr->value;
-        const std::string &name = itr->name.GetString();
-        Buyout bo;
-
-        bo.currency = Currency::FromTag(object["currency"].GetString());
-        bo.type = Buyout::TagAsBuyoutType(object["type"].GetString());
-        bo.value = object["value"].GetDouble();
-        if (object.HasMember("last_update")){
-            bo.last_update = QDateTime::fromTime_t(object["last_update"].GetInt());
-        }
-        if (object.HasMember("source")){
-            bo.source = Buyout::TagAsBuyoutSource(object["source"].GetString());
-        }
-        bo.inherited = false;
-        if (object.HasMember("inherited"))
-            bo.inherited = object["inherited"].GetBool();
-        (*buyouts)[name] = bo;
-    }
+    for (auto itr = doc.MemberBegin(); itr != doc.MemberEnd(); ++itr)
+        (*buyouts)[itr->name.GetString()] = BuyoutFromJson(itr->value);
 }
 
 
-std::string BuyoutManager::Serialize(const std::map<std::string, bool> &obj) {
-    rapidjson::Document doc;
-    doc.SetObject();
-    auto &alloc = doc.GetAllocator();
-
-    for (auto &pair : obj) {
-        rapidjson::Value key(pair.first.c_str(), alloc);
-        rapidjson::Value val(pair.second);
-        doc.AddMember(key, val, alloc);
-    }
-    return Util::RapidjsonSerialize(doc);
-}
-
 void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, bool> &obj) {
     // if data is empty (on first use) we shouldn't make user panic by showing ERROR messages
     if (data.empty())
@@ -419,20 +482,250 @@ void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, b
     }
 }
 
+void BuyoutManager::SaveBuyouts(const std::string &collection, const std::map<std::string, Buyout> &buyouts, std::set<std::string> *dirty) {
+    if (dirty->empty())
+        return;
+    DataRows changed;
+    std::set<std::string> removed;
+    for (auto &key : *dirty) {
+        auto it = buyouts.find(key);
+        if (it != buyouts.end() && it->second.IsSavable())
+            changed[key] = SerializeBuyout(it->second);
+        else
+            removed.insert(key);
+    }
+    data_.UpdateRows(collection, changed, removed);
+    dirty->clear();
+}
+
+void BuyoutManager::LoadBuyouts(const std::string &collection, std::map<std::string, Buyout> *buyouts) {
+    buyouts->clear();
+    for (auto &row : data_.GetRows(collection)) {
+        Buyout bo;
+        if (DeserializeBuyout(row.second, &bo))
+            (*buyouts)[row.first] = bo;
+    }
+}
+
 void BuyoutManager::Save() {
-    if (!save_needed_)
+    save_timer_.stop();
+    data_.BeginBatch();
+    SaveBuyouts("buyouts", buyouts_, &dirty_buyouts_);
+    SaveBuyouts("tab_buyouts", tab_buyouts_, &dirty_tab_buyouts_);
+
+    if (!dirty_refresh_checked_.empty()) {
+        DataRows changed;
+        std::set<std::string> removed;
+        for (auto &key : dirty_refresh_checked_) {
+            auto it = refresh_checked_.find(key);
+            if (it != refresh_checked_.end())
+                changed[key] = it->second ? "1" : "0";
+            else
+                removed.insert(key);
+        }
+        data_.UpdateRows("refresh_checked_state", changed, removed);
+        dirty_refresh_checked_.clear();
+    }
+    data_.Commit();
+
+    // the journal may only go once its edits are stored, which a write-behind
+    // store does later on its own thread
+    if (journal_) {
+        journal_saved_ = journal_->size();
+        journal_sequence_ = data_.WriteSequence();
+        TrimJournal();
+    }
+}
+
+void BuyoutManager::TrimJournal() {
+    journal_timer_.stop();
+    if (!journal_ || journal_saved_ == 0)
         return;
-    save_needed_ = false;
-    data_.Set("buyouts", Serialize(buyouts_));
-    data_.Set("tab_buyouts", Serialize(tab_buyouts_));
-    data_.Set("refresh_checked_state", Serialize(refresh_checked_));
+    if (data_.StoredSequence() < journal_sequence_) {
+        journal_timer_.start();
+        return;
+    }
+    journal_->Drop(journal_saved_);
+    journal_saved_ = 0;
+}
+
+void BuyoutManager::ScheduleSave() {
+    if (dirty_buyouts_.empty() && dirty_tab_buyouts_.empty() && dirty_refresh_checked_.empty())
+        return;
+    // restarting the timer pushes the save back until changes stop coming in
+    save_timer_.start();
 }
 
 void BuyoutManager::Load() {
-    Deserialize(data_.Get("buyouts"), &buyouts_);
-    Deserialize(data_.Get("tab_buyouts"), &tab_buyouts_);
-    Deserialize(data_.Get("refresh_checked_state"), refresh_checked_);
+    // don't let pending changes be overwritten by what is stored.  Saving
+    // clears the journal, so only do it if there is something to save: on
+    // startup the journal holds edits of the previous run to be replayed below.
+    if (!dirty_buyouts_.empty() || !dirty_tab_buyouts_.empty() || !dirty_refresh_checked_.empty())
+        Save();
+
+    LoadBuyouts("buyouts", &buyouts_);
+    LoadBuyouts("tab_buyouts", &tab_buyouts_);
+    refresh_checked_.clear();
+    for (auto &row : data_.GetRows("refresh_checked_state"))
+        refresh_checked_[row.first] = row.second == "1";
+
+    ImportLegacyData();
+    ReplayJournal();
+    all_tabs_changed_ = true;
+}
+
+void BuyoutManager::ReplayJournal() {
+    if (!journal_)
+        return;
+    auto records = journal_->ReadAll();
+    if (records.empty())
+        return;
+
+    std::vector<BuyoutEdit> edits;
+    for (auto &record : records) {
+        rapidjson::Document doc;
+        if (doc.Parse(record.c_str()).HasParseError() || !doc.IsObject()
+                || !doc.HasMember("tab") || !doc["tab"].IsBool() || !doc.HasMember("key") || !doc["key"].IsString()
+                || !doc.HasMember("before") || !IsBuyoutJson(doc["before"])
+                || !doc.HasMember("after") || !IsBuyoutJson(doc["after"])) {
+            QLOG_WARN() << "Skipping malformed buyout journal record:" << record.c_str();
+            continue;
+        }
+        BuyoutEdit edit;
+        edit.tab = doc["tab"].GetBool();
+        edit.key = doc["key"].GetString();
+        edit.before = BuyoutFromJson(doc["before"]);
+        edit.after = BuyoutFromJson(doc["after"]);
+        edits.push_back(edit);
+    }
+    QLOG_INFO() << "Replaying" << edits.size() << "buyout edits that were not saved";
+    ApplyEdits(edits, false);
+    // compact the journal into the data store
+    Save();
+}
+
+void BuyoutManager::RecordEdit(bool tab, const std::string &key, const Buyout &before, const Buyout &after) {
+    if (!journaling_)
+        return;
+    BuyoutEdit edit = { tab, key, before, after };
+    if (journal_)
+        journal_->Append(SerializeEdit(edit));
+    if (edit_depth_ > 0)
+        current_edit_.push_back(edit);
+}
+
+void BuyoutManager::BeginUserEdit() {
+    ++edit_depth_;
+    journaling_ = true;
 }
+
+void BuyoutManager::EndUserEdit() {
+    if (edit_depth_ == 0 || --edit_depth_ > 0)
+        return;
+    journaling_ = false;
+    if (journal_)
+        journal_->Flush();
+    if (current_edit_.empty())
+        return;
+    undo_.push_back(std::move(current_edit_));
+    current_edit_.clear();
+    if (undo_.size() > kMaxUndoEdits)
+        undo_.pop_front();
+    redo_.clear();
+    ScheduleSave();
+}
+
+void BuyoutManager::ApplyEdits(const std::vector<BuyoutEdit> &edits, bool undo) {
+    if (undo) {
+        for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+            if (it->tab)
+                SetTab(it->key, it->before);
+            else
+                SetItemBuyout(it->key, it->before);
+        }
+    } else {
+        for (auto &edit : edits) {
+            if (edit.tab)
+                SetTab(edit.key, edit.after);
+            else
+                SetItemBuyout(edit.key, edit.after);
+        }
+    }
+}
+
+bool BuyoutManager::Undo() {
+    if (undo_.empty())
+        return false;
+    auto edits = std::move(undo_.back());
+    undo_.pop_back();
+    journaling_ = true;
+    ApplyEdits(edits, true);
+    journaling_ = false;
+    if (journal_)
+        journal_->Flush();
+    redo_.push_back(std::move(edits));
+    ScheduleSave();
+    return true;
+}
+
+bool BuyoutManager::Redo() {
+    if (redo_.empty())
+        return false;
+    auto edits = std::move(redo_.back());
+    redo_.pop_back();
+    journaling_ = true;
+    ApplyEdits(edits, false);
+    journaling_ = false;
+    if (journal_)
+        journal_->Flush();
+    undo_.push_back(std::move(edits));
+    ScheduleSave();
+    return true;
+}
+
+void BuyoutManager::ImportLegacyData() {
+    std::string data = data_.Get("buyouts");
+    if (!data.empty()) {
+        std::map<std::string, Buyout> buyouts;
+        Deserialize(data, &buyouts);
+        for (auto &bo : buyouts) {
+            buyouts_[bo.first] = bo.second;
+            dirty_buyouts_.insert(bo.first);
+        }
+    }
+
+    std::string tab_data = data_.Get("tab_buyouts");
+    if (!tab_data.empty()) {
+        std::map<std::string, Buyout> buyouts;
+        Deserialize(tab_data, &buyouts);
+        for (auto &bo : buyouts) {
+            tab_buyouts_[bo.first] = bo.second;
+            dirty_tab_buyouts_.insert(bo.first);
+        }
+    }
+
+    std::string checked_data = data_.Get("refresh_checked_state");
+    if (!checked_data.empty()) {
+        std::map<std::string, bool> checked;
+        Deserialize(checked_data, checked);
+        for (auto &state : checked) {
+            refresh_checked_[state.first] = state.second;
+            dirty_refresh_checked_.insert(state.first);
+        }
+    }
+
+    if (data.empty() && tab_data.empty() && checked_data.empty())
+        return;
+    QLOG_INFO() << "Moving buyouts to row storage";
+    // only drop the old data once it is safely stored in the new format
+    data_.BeginBatch();
+    Save();
+    data_.Set("buyouts", "");
+    data_.Set("tab_buyouts", "");
+    data_.Set("refresh_checked_state", "");
+    data_.Commit();
+}
+
 void BuyoutManager::SetStashTabLocations(const std::vector<ItemLocation> &tabs) {
     tabs_ = tabs;
 }
@@ -458,23 +751,172 @@ BuyoutType BuyoutManager::StringToBuyoutType(std::string bo_str) const {
     return BUYOUT_TYPE_INHERIT;
 }
 
-Buyout BuyoutManager::StringToBuyout(std::string format) {
-    // Parse format string and initialize buyout object, if string does not match any known format
-    // then the buyout object will not be valid (IsValid will return false).
-    std::regex exp("(~\\S+)\\s+(\\d+\\.?\\d*)\\s+(\\w+)");
+namespace {
+
+// \s, \d and \w as std::regex understands them in the "C" locale
+bool IsNoteSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool IsNoteDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool IsNoteWord(char c) {
+    return IsNoteDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// Part of the parsed note, points into the note itself
+struct NoteToken {
+    const char *begin;
+    const char *end;
+    bool empty() const { return begin == end; }
+};
+
+struct NoteMatch {
+    NoteToken type;
+    NoteToken value;
+    // set for fractional prices such as "~price 1/2 exa"
+    NoteToken denominator;
+    NoteToken currency;
+};
+
+// Matches \d+\.?\d* at p, returns its end or nullptr
+const char *MatchNumber(const char *p, const char *end) {
+    const char *start = p;
+    while (p < end && IsNoteDigit(*p))
+        ++p;
+    if (p == start)
+        return nullptr;
+    if (p < end && *p == '.')
+        ++p;
+    while (p < end && IsNoteDigit(*p))
+        ++p;
+    return p;
+}
 
-    std::smatch sm;
+// Matches (~\S+)\s+(\d+\.?\d*)(/\d+\.?\d*)?\s+(\w+) with the ~ at p.  None of
+// the repetitions can give back anything and still match, so unlike the regex
+// this never has to backtrack.
+bool MatchNoteAt(const char *p, const char *end, NoteMatch *match) {
+    const char *q = p + 1;
+    while (q < end && !IsNoteSpace(*q))
+        ++q;
+    if (q == p + 1 || q == end)
+        return false;
+    match->type = { p, q };
+
+    while (q < end && IsNoteSpace(*q))
+        ++q;
+    const char *number_end = MatchNumber(q, end);
+    if (!number_end)
+        return false;
+    match->value = { q, number_end };
+    q = number_end;
+
+    match->denominator = {};
+    if (q < end && *q == '/') {
+        number_end = MatchNumber(q + 1, end);
+        if (number_end) {
+            match->denominator = { q + 1, number_end };
+            q = number_end;
+        }
+    }
 
+    if (q == end || !IsNoteSpace(*q))
+        return false;
+    while (q < end && IsNoteSpace(*q))
+        ++q;
+    const char *word = q;
+    while (q < end && IsNoteWord(*q))
+        ++q;
+    if (q == word)
+        return false;
+    match->currency = { word, q };
+    return true;
+}
+
+// Like regex_search, finds the leftmost match anywhere in the note
+bool MatchNote(const std::string &note, NoteMatch *match) {
+    const char *end = note.data() + note.size();
+    for (const char *p = note.data(); p < end; ++p)
+        if (*p == '~' && MatchNoteAt(p, end, match))
+            return true;
+    return false;
+}
+
+double NoteNumber(const NoteToken &token) {
+    // Powers of ten that are exact doubles
+    static const double kPow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    bool fraction = false;
+    for (const char *p = token.begin; p < token.end; ++p) {
+        if (*p == '.') {
+            fraction = true;
+            continue;
+        }
+        mantissa = mantissa * 10 + (*p - '0');
+        ++digits;
+        if (fraction)
+            ++scale;
+    }
+    // Both operands are exact and the division is correctly rounded, so
+    // this gives the same result as a full conversion.
+    if (digits <= 15)
+        return mantissa / kPow10[scale];
+    return QByteArray(token.begin, token.end - token.begin).toDouble();
+}
+
+template <typename T>
+size_t LongestKey(const std::map<std::string, T> &map) {
+    size_t longest = 0;
+    for (auto &entry : map)
+        longest = std::max(longest, entry.first.size());
+    return longest;
+}
+
+}
+
+Buyout BuyoutManager::StringToBuyout(const std::string &format) {
+    // Parse format string and initialize buyout object, if string does not match any known format
+    // then the buyout object will not be game set (IsGameSet will return false).
+    // This is called for every note and tab name on each refresh, so the note is parsed in place
+    // rather than with a regex.
+    NoteMatch match = {};
     Buyout tmp;
-    // regex_search allows for stuff before ~ and after currency type.  We only want to honor the formats
-    // that POE trade also accept so this may need to change if it's too generous
-    if (std::regex_search(format,sm,exp)) {
-        tmp.type = StringToBuyoutType(sm[1]);
-        tmp.value = QVariant(sm[2].str().c_str()).toDouble();
-        tmp.currency = StringToCurrencyType(sm[3]);
-        tmp.source = BUYOUT_SOURCE_GAME;
-        tmp.last_update = QDateTime::currentDateTime();
+    // Like the regex_search this replaces, this allows for stuff before ~ and after currency type.
+    // We only want to honor the formats that POE trade also accept so this may need to change if
+    // it's too generous
+    if (!MatchNote(format, &match))
+        return tmp;
+
+    double value = NoteNumber(match.value);
+    if (!match.denominator.empty()) {
+        double denominator = NoteNumber(match.denominator);
+        if (denominator == 0)
+            return tmp;
+        value /= denominator;
     }
+
+    // Words longer than any known one can't match, the others are short enough
+    // for std::string to keep them without allocating.
+    static const size_t longest_type = LongestKey(string_to_buyout_type_);
+    static const size_t longest_currency = LongestKey(string_to_currency_type_);
+    size_t type_size = match.type.end - match.type.begin;
+    size_t currency_size = match.currency.end - match.currency.begin;
+
+    tmp.type = type_size > longest_type ? BUYOUT_TYPE_INHERIT
+        : StringToBuyoutType(std::string(match.type.begin, type_size));
+    tmp.value = value;
+    tmp.currency = currency_size > longest_currency ? CURRENCY_NONE
+        : StringToCurrencyType(std::string(match.currency.begin, currency_size));
+    tmp.source = BUYOUT_SOURCE_GAME;
+    tmp.last_update = QDateTime::currentDateTime();
     return tmp;
 }
 
@@ -486,7 +928,8 @@ void BuyoutManager::MigrateItem(const Item &item) {
     if (it != buyouts_.end() && (new_it == buyouts_.end() || new_it->second.source != BUYOUT_SOURCE_MANUAL)) {
         buyouts_[hash] = it->second;
         buyouts_.erase(it);
-        save_needed_ = true;
+        dirty_buyouts_.insert(hash);
+        dirty_buyouts_.insert(old_hash);
     }
 }
 
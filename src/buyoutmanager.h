@@ -21,6 +21,9 @@
 
 #include "item.h"
 #include <QDateTime>
+#include <QTimer>
+#include <deque>
+#include <memory>
 #include <set>
 
 class ItemLocation;
@@ -141,11 +144,30 @@ private:
     static const BuyoutSourceMap buyout_source_as_tag_;
 };
 
+class BuyoutJournal;
 class DataStore;
 
+// How long ScheduleSave waits for further changes before saving, in ms
+const int kSaveDelay = 2000;
+// How often to check whether saved edits are stored and can leave the journal, in ms
+const int kJournalCheckInterval = 200;
+// Number of user edits that can be undone
+const size_t kMaxUndoEdits = 100;
+
+// A single change of an item (by hash) or tab buyout
+struct BuyoutEdit {
+    bool tab;
+    std::string key;
+    Buyout before;
+    Buyout after;
+};
+
 class BuyoutManager {
 public:
-    explicit BuyoutManager(DataStore &data);
+    // Edits made between BeginUserEdit and EndUserEdit are written to the journal
+    // at journal_file (if not empty) right away and can be undone together.
+    explicit BuyoutManager(DataStore &data, const std::string &journal_file = "");
+    ~BuyoutManager();
     void Set(const Item &item, const Buyout &buyout);
     Buyout Get(const Item &item) const;
 
@@ -159,26 +181,58 @@ public:
 
     bool GetRefreshLocked(const ItemLocation &tab) const;
     void SetRefreshLocked(const ItemLocation &tab);
+    void ClearRefreshLocked(const ItemLocation &tab);
     void ClearRefreshLocks();
 
+    // Tabs whose buyout was set, changed or removed since the last ClearTabChanges().
+    // all_tabs_changed() is true when every tab must be treated as changed, e.g. after Load or Clear.
+    const std::set<std::string> &changed_tabs() const { return changed_tabs_; }
+    bool all_tabs_changed() const { return all_tabs_changed_; }
+    void ClearTabChanges();
+
     void SetStashTabLocations(const std::vector<ItemLocation> &tabs);
     const std::vector<ItemLocation> GetStashTabLocations() const;
     void Clear();
 
-    Buyout StringToBuyout(std::string);
+    // Parses buyouts set in game through item notes and tab names, e.g.
+    // "~b/o 5 chaos", "~price 1.5 exa" or "~price 1/2 exa".
+    Buyout StringToBuyout(const std::string &format);
+    Currency StringToCurrencyType(std::string currency) const;
+    BuyoutType StringToBuyoutType(std::string bo_str) const;
 
+    // Writes buyouts changed since the last save.
     void Save();
+    // Same as Save but waits for more changes to accumulate first.
+    void ScheduleSave();
     void Load();
 
     void MigrateItem(const Item &item);
+
+    void BeginUserEdit();
+    void EndUserEdit();
+    bool CanUndo() const { return !undo_.empty(); }
+    bool CanRedo() const { return !redo_.empty(); }
+    // Return false if there was nothing to undo/redo.  Tab buyouts have to be
+    // propagated again by the caller afterwards.
+    bool Undo();
+    bool Redo();
 private:
-    Currency StringToCurrencyType(std::string currency) const;
-    BuyoutType StringToBuyoutType(std::string bo_str) const;
+    void SetItemBuyout(const std::string &hash, const Buyout &buyout);
+    void RecordEdit(bool tab, const std::string &key, const Buyout &before, const Buyout &after);
+    void ApplyEdits(const std::vector<BuyoutEdit> &edits, bool undo);
+    void ReplayJournal();
+    // Drops the journal records of the last Save once the data store has stored them
+    void TrimJournal();
+
+    std::string SerializeBuyout(const Buyout &buyout);
+    std::string SerializeEdit(const BuyoutEdit &edit);
+    bool DeserializeBuyout(const std::string &data, Buyout *buyout);
+    void SaveBuyouts(const std::string &collection, const std::map<std::string, Buyout> &buyouts, std::set<std::string> *dirty);
+    void LoadBuyouts(const std::string &collection, std::map<std::string, Buyout> *buyouts);
+    // Imports buyouts saved as whole-map json blobs by older versions
+    void ImportLegacyData();
 
-    std::string Serialize(const std::map<std::string, Buyout> &buyouts);
     void Deserialize(const std::string &data, std::map<std::string, Buyout> *buyouts);
-
-    std::string Serialize(const std::map<std::string, bool> &obj);
     void Deserialize(const std::string &data, std::map<std::string, bool> &obj);
 
     DataStore &data_;
@@ -186,7 +240,26 @@ private:
     std::map<std::string, Buyout> tab_buyouts_;
     std::map<std::string, bool> refresh_checked_;
     std::set<std::string> refresh_locked_;
-    bool save_needed_;
+    std::set<std::string> changed_tabs_;
+    bool all_tabs_changed_{true};
+    // keys changed since the last Save, each map is stored as its own collection of rows
+    std::set<std::string> dirty_buyouts_;
+    std::set<std::string> dirty_tab_buyouts_;
+    std::set<std::string> dirty_refresh_checked_;
+    QTimer save_timer_;
+    std::unique_ptr<BuyoutJournal> journal_;
+    // number of journal records covered by the last Save and the data store write
+    // sequence they are stored with
+    size_t journal_saved_{0};
+    uint64_t journal_sequence_{0};
+    QTimer journal_timer_;
+    // > 0 while a user edit is in progress, edits are collected in current_edit_
+    int edit_depth_{0};
+    // set while edits are journaled (user edits and undo/redo)
+    bool journaling_{false};
+    std::vector<BuyoutEdit> current_edit_;
+    std::deque<std::vector<BuyoutEdit>> undo_;
+    std::vector<std::vector<BuyoutEdit>> redo_;
     std::vector<ItemLocation> tabs_;
     static const std::map<std::string, BuyoutType> string_to_buyout_type_;
     static const std::map<std::string, Currency> string_to_currency_type_;
@@ -18,6 +18,7 @@
 */
 
 #include <ctime>
+#include <limits>
 #include <QWidget>
 #include <QtGui>
 #include "QsLog.h"
@@ -50,6 +51,9 @@ CurrencyManager::CurrencyManager(Application &app):
     }
     else
         InitCurrency();
+    InitSlots();
+    MigrateCurrencyHistory();
+    DownsampleCurrencyHistory();
 
     dialog_ = std::make_shared<CurrencyDialog>(*this, data_.GetBool("currency_show_chaos"), data_.GetBool("currency_show_exalt"));
 }
@@ -59,18 +63,43 @@ CurrencyManager::~CurrencyManager() {
 }
 
 void CurrencyManager::Save() {
+    data_.BeginBatch();
     SaveCurrencyItems();
     SaveCurrencyValue();
     data_.SetBool("currency_show_chaos", dialog_->ShowChaos());
     data_.SetBool("currency_show_exalt", dialog_->ShowExalt());
-
+    data_.Commit();
 }
 
 void CurrencyManager::Update() {
-    ClearCurrency();
-    for (auto &item : app_.items_manager().items()) {
-        ParseSingleItem(*item);
+    auto &items_manager = app_.items_manager();
+    if (!counted_) {
+        tab_counts_.clear();
+        for (auto &item : items_manager.items())
+            CountItem(*item, 1);
+        counted_ = true;
+    } else {
+        auto &changes = items_manager.changes();
+        for (auto &item : changes.added)
+            CountItem(*item, 1);
+        for (auto &item : changes.removed)
+            CountItem(*item, -1);
+        for (auto *list : { &changes.changed, &changes.moved }) {
+            for (auto &change : *list) {
+                CountItem(*change.previous, -1);
+                CountItem(*change.current, 1);
+            }
+        }
     }
+
+    std::vector<int> totals(currencies_.size() + wisdoms_.size());
+    for (auto &tab : tab_counts_)
+        for (size_t i = 0; i < totals.size(); ++i)
+            totals[i] += tab.second[i];
+    for (size_t i = 0; i < currencies_.size(); ++i)
+        currencies_[i]->count = totals[i];
+    for (size_t i = 0; i < wisdoms_.size(); ++i)
+        wisdoms_[i] = totals[currencies_.size() + i];
     SaveCurrencyValue();
     dialog_->Update();
 }
@@ -102,22 +131,32 @@ int CurrencyManager::TotalWisdomValue() {
     return out;
 }
 
-void CurrencyManager::ClearCurrency() {
-    for (auto& currency : currencies_) {
-        currency->count = 0;
-    }
-    for (auto& wisdom : wisdoms_) {
-        wisdom = 0;
-    }
-}
 void CurrencyManager::InitCurrency() {
     for (auto type: Currency::Types()) {
         currencies_.push_back(std::make_shared<CurrencyItem>(0, Currency(type), 1, 1));
     }
     Deserialize(data_.Get("currency_items"), &currencies_);
-    for (unsigned int i = 0; i < CurrencyWisdomValue.size(); i++) {
-        wisdoms_.push_back(0);
-    }
+}
+
+void CurrencyManager::InitSlots() {
+    wisdoms_.assign(CurrencyForWisdom.size(), 0);
+    for (size_t i = 0; i < currencies_.size(); ++i)
+        if (!currencies_[i]->name.empty())
+            slots_[currencies_[i]->name] = i;
+    for (size_t i = 0; i < CurrencyForWisdom.size(); ++i)
+        slots_[CurrencyForWisdom[i]] = currencies_.size() + i;
+}
+
+void CurrencyManager::CountItem(const Item &item, int sign) {
+    auto &category = item.category_vector();
+    if (category.empty() || category[0] != "Currency")
+        return;
+    auto slot = slots_.find(item.PrettyName());
+    if (slot == slots_.end())
+        return;
+    auto &counts = tab_counts_[item.location().GetUniqueHash()];
+    counts.resize(currencies_.size() + wisdoms_.size());
+    counts[slot->second] += sign * item.count();
 }
 
 void CurrencyManager::FirstInitCurrency() {
@@ -130,10 +169,12 @@ void CurrencyManager::FirstInitCurrency() {
         value += "0;";
     }
     value.pop_back(); // Remove the last ";"
+    data_.BeginBatch();
     data_.Set("currency_items", Serialize(currencies_));
     data_.Set("currency_last_value", value);
     data_.SetBool("currency_show_chaos", true);
     data_.SetBool("currency_show_exalt", true);
+    data_.Commit();
 }
 
 void CurrencyManager::MigrateCurrency() {
@@ -147,6 +188,50 @@ void CurrencyManager::MigrateCurrency() {
     data_.Set("currency_base", "");
 }
 
+void CurrencyManager::MigrateCurrencyHistory() {
+    if (data_.GetBool("currency_history_migrated"))
+        return;
+    // the counts were stored in this order, skipping CURRENCY_NONE
+    std::vector<int> types;
+    for (auto type : Currency::Types())
+        if (type != CURRENCY_NONE)
+            types.push_back(type);
+
+    std::vector<CurrencySample> samples;
+    for (auto &update : data_.GetAllCurrency()) {
+        std::vector<std::string> values = Util::StringSplit(update.value, ';');
+        for (size_t i = 0; i < values.size() && i <= types.size(); ++i) {
+            CurrencySample sample;
+            sample.timestamp = update.timestamp;
+            sample.currency = i == 0 ? CURRENCY_NONE : types[i - 1];
+            try {
+                sample.count = std::stod(values[i]);
+            } catch (const std::exception &) {
+                QLOG_WARN() << "Skipping currency value" << values[i].c_str() << "from" << update.timestamp;
+                continue;
+            }
+            // the chaos value wasn't stored
+            sample.chaos_value = 0;
+            if (i == 0 || sample.count != 0)
+                samples.push_back(sample);
+        }
+    }
+    data_.BeginBatch();
+    data_.InsertCurrencySamples(samples);
+    data_.SetBool("currency_history_migrated", true);
+    data_.Commit();
+    if (!samples.empty())
+        QLOG_INFO() << "Migrated" << samples.size() << "currency history samples";
+}
+
+void CurrencyManager::DownsampleCurrencyHistory() {
+    long long now = std::time(nullptr);
+    data_.BeginBatch();
+    data_.DownsampleCurrency(now - kCurrencyDailyAfter, 24 * 3600);
+    data_.DownsampleCurrency(now - kCurrencyWeeklyAfter, 7 * 24 * 3600);
+    data_.Commit();
+}
+
 std::string CurrencyManager::Serialize(const std::vector<std::shared_ptr<CurrencyItem>> &currencies) {
     rapidjson::Document doc;
     doc.SetObject();
@@ -205,22 +290,43 @@ void CurrencyManager::SaveCurrencyValue() {
     }
     std::string old_value = data_.Get("currency_last_value", "");
     if (value != old_value && !empty) {
-        CurrencyUpdate update = CurrencyUpdate();
-        update.timestamp = std::time(nullptr);
-        update.value = value;
-        data_.InsertCurrencyUpdate(update);
+        long long timestamp = std::time(nullptr);
+        std::vector<CurrencySample> samples;
+        CurrencySample total;
+        total.timestamp = timestamp;
+        total.currency = CURRENCY_NONE;
+        total.count = TotalExaltedValue();
+        total.chaos_value = TotalChaosValue();
+        samples.push_back(total);
+        for (auto &currency : currencies_) {
+            if (currency->currency == CURRENCY_NONE || currency->count == 0)
+                continue;
+            CurrencySample sample;
+            sample.timestamp = timestamp;
+            sample.currency = currency->currency.type;
+            sample.count = currency->count;
+            sample.chaos_value = fabs(currency->chaos.value1) > EPS ? currency->count / currency->chaos.value1 : 0;
+            samples.push_back(sample);
+        }
+        data_.BeginBatch();
+        data_.InsertCurrencySamples(samples);
         data_.Set("currency_last_value", value);
+        data_.Commit();
     }
 }
 
 void CurrencyManager::ExportCurrency() {
     std::string header_csv = "Date; Total value";
+    // column of every currency after the total value
+    std::map<int, size_t> columns;
     for (auto& item : currencies_) {
         auto label = item->currency.AsString();
-        if (label != "")
+        if (label != "") {
             header_csv += ";" + label;
+            size_t column = columns.size();
+            columns[item->currency.type] = column;
+        }
     }
-    std::vector<CurrencyUpdate> result = data_.GetAllCurrency();
 
     QString fileName = QFileDialog::getSaveFileName(this, tr("Save Export file"),
                                                     QDir::toNativeSeparators(QDir::homePath() + "/" + "acquisition_export_currency.csv"));
@@ -230,28 +336,44 @@ void CurrencyManager::ExportCurrency() {
     if (file.open(QFile::WriteOnly | QFile::Text)) {
         QTextStream out(&file);
         out << header_csv.c_str() << "\n";
-        for (auto &update : result) {
+        // Samples come ordered by timestamp, so every snapshot is written as
+        // soon as the next one starts instead of reading the whole history.
+        long long timestamp = -1;
+        double total = 0;
+        std::vector<double> counts(columns.size());
+        auto write_row = [&]() {
             char buf[4096];
-            std::time_t timestamp = update.timestamp;
-            std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", std::localtime(&timestamp));
-            out << buf << ";";
-            out << update.value.c_str() << "\n";
-        }
+            std::time_t time = timestamp;
+            std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", std::localtime(&time));
+            out << buf << ";" << QString::number(total, 'f', 6);
+            for (double count : counts)
+                out << ";" << count;
+            out << "\n";
+        };
+        data_.ForEachCurrencySample(0, std::numeric_limits<long long>::max(), [&](const CurrencySample &sample) {
+            if (sample.timestamp != timestamp) {
+                if (timestamp != -1)
+                    write_row();
+                timestamp = sample.timestamp;
+                total = 0;
+                std::fill(counts.begin(), counts.end(), 0);
+            }
+            if (sample.currency == CURRENCY_NONE) {
+                total = sample.count;
+            } else {
+                auto it = columns.find(sample.currency);
+                if (it != columns.end())
+                    counts[it->second] = sample.count;
+            }
+            return true;
+        });
+        if (timestamp != -1)
+            write_row();
     } else {
         QLOG_WARN() << "CurrencyManager::ExportCurrency : couldn't open CSV export file ";
     }
 }
 
-void CurrencyManager::ParseSingleItem(const Item &item) {
-    for (unsigned int i = 0; i < currencies_.size(); i++)
-        if (item.PrettyName() == currencies_[i]->name)
-            currencies_[i]->count += item.count();
-
-    for (unsigned int i = 0; i < wisdoms_.size(); i++)
-        if (item.PrettyName() == CurrencyForWisdom[i])
-            wisdoms_[i] += item.count();
-}
-
 void CurrencyManager::DisplayCurrency() {
 
     dialog_->show();
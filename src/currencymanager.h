@@ -21,6 +21,7 @@
 
 #include <QtGui>
 #include <QtWidgets>
+#include <unordered_map>
 
 #include "application.h"
 #include "buyoutmanager.h"
@@ -104,13 +105,19 @@ private:
     std::shared_ptr<CurrencyItem> currency_;
 };
 
-// For now we just serialize/deserialize 'value' inside CurrencyManager
-// Later we might need more logic if GGG adds more currency types and we want to be backwards compatible
+// How currency history used to be stored: 'value' is the total exalted value
+// followed by the count of every currency, joined by ";".  Only read to migrate
+// it to CurrencySample.
 struct CurrencyUpdate {
     long long timestamp;
     std::string value;
 };
 
+// Currency history older than this only keeps one snapshot a day, and older
+// than kCurrencyWeeklyAfter one a week, in seconds
+const long long kCurrencyDailyAfter = 30LL * 24 * 3600;
+const long long kCurrencyWeeklyAfter = 365LL * 24 * 3600;
+
 const std::vector<std::string> CurrencyForWisdom({
     "Scroll of Wisdom",
     "Portal Scroll",
@@ -164,15 +171,12 @@ class CurrencyManager : public QWidget
 public:
     explicit CurrencyManager(Application &app);
     ~CurrencyManager();
-    void ClearCurrency();
-    // Called in itemmanagerworker::ParseItem
-    void ParseSingleItem(const Item &item);
-    //void UpdateBaseValue(int ind, double value);
     const std::vector<std::shared_ptr<CurrencyItem>> &currencies() const { return currencies_;}
     double TotalExaltedValue();
     double TotalChaosValue();
     int TotalWisdomValue();
     void DisplayCurrency();
+    // Recounts the currency in the tabs that changed in the last items refresh
     void Update();
     // CSV export
     void ExportCurrency();
@@ -184,11 +188,25 @@ private:
     // We only need the "count" of a CurrencyItem so int will be enough
     std::vector<int> wisdoms_;
     std::shared_ptr<CurrencyDialog> dialog_;
+    // PrettyName of a currency -> its slot in the counts: the index in currencies_,
+    // or currencies_.size() + the index in CurrencyForWisdom
+    std::unordered_map<std::string, size_t> slots_;
+    // Counts of every slot per tab, by ItemLocation::GetUniqueHash
+    std::unordered_map<std::string, std::vector<int>> tab_counts_;
+    // Set once tab_counts_ holds all items, later updates only apply changes
+    bool counted_{false};
     // Used only the first time we launch the app
     void FirstInitCurrency();
     //Migrate from old storage (csv-like serializing) to new one (using json)
     void MigrateCurrency();
+    // Migrate the history from CurrencyUpdate to CurrencySample, once
+    void MigrateCurrencyHistory();
+    // Thin out old history, see kCurrencyDailyAfter
+    void DownsampleCurrencyHistory();
     void InitCurrency();
+    void InitSlots();
+    // Adds sign * the stack size of item to the counts of its tab if it's a currency we count
+    void CountItem(const Item &item, int sign);
     void SaveCurrencyItems();
     std::string Serialize(const std::vector<std::shared_ptr<CurrencyItem>> &currencies);
     void Deserialize(const std::string &data, std::vector<std::shared_ptr<CurrencyItem>> *currencies);
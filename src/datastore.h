@@ -19,20 +19,109 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "currencymanager.h"
 
+// Rows of a named collection, keyed by their row key.  Used for data that
+// changes a few entries at a time (e.g. buyouts) so that saving it doesn't
+// have to rewrite everything.
+typedef std::map<std::string, std::string> DataRows;
+
+// How much of a currency there was at a point in time.  The sample of
+// CURRENCY_NONE holds the total value, in exalted orbs as count and in chaos
+// orbs as chaos_value.
+struct CurrencySample {
+    long long timestamp;
+    int currency;
+    double count;
+    // value of count in chaos orbs at that time
+    double chaos_value;
+};
+
+struct ItemPrice {
+    double value{0};
+    // currency tag, empty if the item has no price
+    std::string currency;
+};
+
+// An item as stored in the items table, so that items can be queried
+// without loading and parsing all of them
+struct ItemRecord {
+    // key of the row: the item's uid, or its hash for items without one.
+    // Identical items without a uid share it, each of them is a separate row.
+    std::string uid;
+    std::string hash;
+    // unique hash of the item's location
+    std::string tab;
+    std::string category;
+    int frame_type{0};
+    ItemPrice price;
+    std::map<std::string, double> mods;
+};
+
+// Erases one record for every uid in `uids` from `items`, returns how many were erased
+inline size_t EraseItemRecords(std::vector<ItemRecord> *items, const std::vector<std::string> &uids) {
+    std::map<std::string, size_t> left;
+    for (auto &uid : uids)
+        ++left[uid];
+    size_t size = items->size();
+    items->erase(std::remove_if(items->begin(), items->end(), [&](const ItemRecord &item) {
+        auto it = left.find(item.uid);
+        if (it == left.end() || it->second == 0)
+            return false;
+        --it->second;
+        return true;
+    }), items->end());
+    return size - items->size();
+}
+
 class DataStore {
 public:
     virtual ~DataStore() {};
     virtual void Set(const std::string &key, const std::string &value) = 0;
     virtual std::string Get(const std::string &key, const std::string &default_value = "") = 0;
-    virtual void InsertCurrencyUpdate(const CurrencyUpdate &update) = 0;
+    // Currency history as stored by versions before CurrencySample, only read to migrate it
     virtual std::vector<CurrencyUpdate> GetAllCurrency() = 0;
+    virtual void InsertCurrencySamples(const std::vector<CurrencySample> &samples) = 0;
+    // Calls callback with the samples with from <= timestamp < to, ordered by timestamp and
+    // currency, without loading all of them at once.  Stops when callback returns false.
+    // callback must not use the data store.
+    virtual void ForEachCurrencySample(long long from, long long to,
+                                       const std::function<bool(const CurrencySample&)> &callback) = 0;
+    // Of the samples older than `before` only keeps the last snapshot of every `interval` seconds
+    virtual void DownsampleCurrency(long long before, long long interval) = 0;
     virtual void SetBool(const std::string &key, bool value) = 0;
     virtual bool GetBool(const std::string &key, bool default_value = false) = 0;
     virtual void SetInt(const std::string &key, int value) = 0;
     virtual int GetInt(const std::string &key, int default_value = 0) = 0;
+    virtual DataRows GetRows(const std::string &collection) = 0;
+    // Inserts or replaces `changed` and deletes `removed` rows of the collection at once
+    virtual void UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed) = 0;
+    // Everything written between BeginBatch and Commit is stored in one transaction.
+    // Batches can be nested, only the outermost Commit writes anything.
+    virtual void BeginBatch() = 0;
+    virtual void Commit() = 0;
+    // Writes are numbered in the order they are made: WriteSequence() is the number of
+    // the last write, StoredSequence() of the last one that is actually stored.  Stores
+    // that write synchronously have everything stored right away.
+    virtual uint64_t WriteSequence() { return 0; }
+    virtual uint64_t StoredSequence() { return WriteSequence(); }
+    // Replaces all stored items
+    virtual void ReplaceItems(const std::vector<ItemRecord> &items) = 0;
+    // Deletes one stored item for every uid in `removed`, then stores `added`
+    virtual void UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed) = 0;
+    // Sets the price of stored items by their uid
+    virtual void UpdateItemPrices(const std::map<std::string, ItemPrice> &prices) = 0;
+    virtual std::vector<ItemRecord> GetItemsByHash(const std::string &hash) = 0;
+    // Number of stored items per tab
+    virtual std::map<std::string, int> CountItemsByTab() = 0;
+    // Sum of item prices per currency, of one tab or of all items if tab is empty
+    virtual std::map<std::string, double> PriceTotals(const std::string &tab = "") = 0;
 };
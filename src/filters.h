@@ -72,7 +72,7 @@ class FilterData {
 public:
     FilterData(Filter *filter);
     Filter *filter () { return filter_; }
-    bool Matches(const std::shared_ptr<Item> item);
+    bool Matches(const std::shared_ptr<Item> &item);
     void FromForm();
     void ToForm();
     // Various types of data for various filters
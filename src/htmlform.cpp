@@ -0,0 +1,339 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "htmlform.h"
+
+#include <cstring>
+
+namespace {
+
+struct Entity {
+    const char *name;
+    unsigned code;
+};
+
+const Entity kEntities[] = {
+    { "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' },
+    { "nbsp", 0xA0 }, { "copy", 0xA9 }, { "reg", 0xAE }, { "middot", 0xB7 }, { "laquo", 0xAB },
+    { "raquo", 0xBB }, { "times", 0xD7 }, { "ndash", 0x2013 }, { "mdash", 0x2014 },
+    { "lsquo", 0x2018 }, { "rsquo", 0x2019 }, { "ldquo", 0x201C }, { "rdquo", 0x201D },
+    { "hellip", 0x2026 },
+};
+
+// Longest name in kEntities
+const size_t kMaxEntityName = 6;
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool IsAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+void AppendUtf8(unsigned code, std::string *out) {
+    if (code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+        code = 0xFFFD;
+    if (code < 0x80) {
+        out->push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+// Reads the reference after the '&' at text[pos], appending what it stands for
+// to out.  Returns the position after it, or pos if it isn't one.
+size_t DecodeEntity(const std::string &text, size_t pos, std::string *out) {
+    size_t i = pos + 1;
+    if (i < text.size() && text[i] == '#') {
+        ++i;
+        bool hex = i < text.size() && (text[i] == 'x' || text[i] == 'X');
+        if (hex)
+            ++i;
+        size_t digits = i;
+        unsigned code = 0;
+        for (; i < text.size(); ++i) {
+            char c = ToLower(text[i]);
+            unsigned digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (hex && c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else
+                break;
+            // anything this large is invalid anyway, stop before it overflows
+            if (code <= 0x10FFFF)
+                code = code * (hex ? 16 : 10) + digit;
+        }
+        if (i == digits)
+            return pos;
+        // the semicolon is optional for numeric references
+        if (i < text.size() && text[i] == ';')
+            ++i;
+        AppendUtf8(code, out);
+        return i;
+    }
+
+    size_t end = text.find(';', i);
+    if (end == std::string::npos || end == i || end - i > kMaxEntityName)
+        return pos;
+    for (auto &entity : kEntities) {
+        if (text.compare(i, end - i, entity.name) == 0) {
+            AppendUtf8(entity.code, out);
+            return end + 1;
+        }
+    }
+    return pos;
+}
+
+std::string Trim(const std::string &text) {
+    size_t first = 0, last = text.size();
+    while (first < last && IsSpace(text[first]))
+        ++first;
+    while (last > first && IsSpace(text[last - 1]))
+        --last;
+    return text.substr(first, last - first);
+}
+
+// Splits the text between '<' and '>' into a lowercase element name and its
+// attributes, with names lowercased and values decoded.
+void ParseTag(const std::string &tag, std::string *name, bool *closing, bool *self_closing,
+              std::map<std::string, std::string> *attributes) {
+    size_t i = 0;
+    *closing = !tag.empty() && tag[0] == '/';
+    if (*closing)
+        ++i;
+    *self_closing = !tag.empty() && tag.back() == '/';
+    for (; i < tag.size() && !IsSpace(tag[i]) && tag[i] != '/'; ++i)
+        name->push_back(ToLower(tag[i]));
+
+    while (i < tag.size()) {
+        while (i < tag.size() && (IsSpace(tag[i]) || tag[i] == '/'))
+            ++i;
+        std::string key;
+        for (; i < tag.size() && !IsSpace(tag[i]) && tag[i] != '=' && tag[i] != '/'; ++i)
+            key.push_back(ToLower(tag[i]));
+        while (i < tag.size() && IsSpace(tag[i]))
+            ++i;
+        std::string value;
+        if (i < tag.size() && tag[i] == '=') {
+            ++i;
+            while (i < tag.size() && IsSpace(tag[i]))
+                ++i;
+            if (i < tag.size() && (tag[i] == '"' || tag[i] == '\'')) {
+                size_t end = tag.find(tag[i], i + 1);
+                if (end == std::string::npos)
+                    end = tag.size();
+                value = tag.substr(i + 1, end - i - 1);
+                i = end + 1;
+            } else {
+                size_t start = i;
+                while (i < tag.size() && !IsSpace(tag[i]))
+                    ++i;
+                value = tag.substr(start, i - start);
+            }
+        }
+        if (!key.empty() && !attributes->count(key))
+            (*attributes)[key] = DecodeHtmlEntities(value);
+    }
+}
+
+bool HasClass(const std::string &classes, const std::string &name) {
+    size_t pos = 0;
+    while ((pos = classes.find(name, pos)) != std::string::npos) {
+        size_t end = pos + name.size();
+        if ((pos == 0 || IsSpace(classes[pos - 1])) && (end == classes.size() || IsSpace(classes[end])))
+            return true;
+        pos = end;
+    }
+    return false;
+}
+
+}
+
+const HtmlForm *HtmlPage::FindForm(const std::string &name) const {
+    for (auto &form : forms)
+        if (form.fields.count(name))
+            return &form;
+    return nullptr;
+}
+
+void HtmlFormReader::Feed(const char *data, size_t size) {
+    const char *end = data + size;
+    const char *p = data;
+    while (p < end) {
+        switch (state_) {
+        case State::Text: {
+            const char *open = static_cast<const char*>(std::memchr(p, '<', end - p));
+            if (in_error_)
+                error_.append(p, open ? open : end);
+            if (!open)
+                return;
+            p = open + 1;
+            state_ = State::Tag;
+            tag_.clear();
+            quote_ = 0;
+            break;
+        }
+        case State::Tag: {
+            char c = *p++;
+            if (tag_.empty() && !IsAlpha(c) && c != '/' && c != '!') {
+                // a lone '<' in text
+                if (in_error_)
+                    error_.push_back('<');
+                if (c != '<') {
+                    if (in_error_)
+                        error_.push_back(c);
+                    state_ = State::Text;
+                }
+            } else if (quote_) {
+                if (c == quote_)
+                    quote_ = 0;
+                tag_.push_back(c);
+            } else if (c == '>') {
+                state_ = State::Text;
+                OnTag();
+            } else {
+                if ((c == '"' || c == '\'') && !tag_.empty() && tag_[0] != '!')
+                    quote_ = c;
+                tag_.push_back(c);
+                if (tag_ == "!--") {
+                    state_ = State::Comment;
+                    dashes_ = 0;
+                }
+            }
+            break;
+        }
+        case State::Comment: {
+            char c = *p++;
+            if (c == '>' && dashes_ >= 2)
+                state_ = State::Text;
+            else
+                dashes_ = c == '-' ? dashes_ + 1 : 0;
+            break;
+        }
+        case State::Raw: {
+            if (raw_matched_ == 0) {
+                const char *open = static_cast<const char*>(std::memchr(p, '<', end - p));
+                if (!open)
+                    return;
+                p = open + 1;
+                raw_matched_ = 1;
+                break;
+            }
+            char c = ToLower(*p++);
+            if (c != raw_end_[raw_matched_]) {
+                raw_matched_ = c == '<' ? 1 : 0;
+            } else if (++raw_matched_ == raw_end_.size()) {
+                // read the rest of the closing tag as usual
+                raw_matched_ = 0;
+                tag_ = raw_end_.substr(1);
+                quote_ = 0;
+                state_ = State::Tag;
+            }
+            break;
+        }
+        }
+    }
+}
+
+void HtmlFormReader::OnTag() {
+    if (tag_.empty() || tag_[0] == '!' || tag_[0] == '?')
+        return;
+    std::string name;
+    bool closing, self_closing;
+    std::map<std::string, std::string> attributes;
+    ParseTag(tag_, &name, &closing, &self_closing, &attributes);
+
+    if (closing) {
+        if (name == "form") {
+            in_form_ = false;
+        } else if (name == "li" && in_error_) {
+            FinishError();
+        } else if (name == "ul" && error_lists_ > 0) {
+            if (in_error_)
+                FinishError();
+            --error_lists_;
+        }
+        return;
+    }
+
+    if (name == "form") {
+        page_.forms.push_back(HtmlForm());
+        page_.forms.back().action = attributes["action"];
+        in_form_ = true;
+    } else if (name == "input") {
+        auto it = attributes.find("name");
+        if (in_form_ && it != attributes.end() && !it->second.empty())
+            page_.forms.back().fields.insert(std::make_pair(it->second, attributes["value"]));
+    } else if (name == "ul") {
+        if (error_lists_ > 0 || HasClass(attributes["class"], "errors"))
+            ++error_lists_;
+    } else if (name == "li" && error_lists_ > 0) {
+        // the previous item may not have been closed
+        if (in_error_)
+            FinishError();
+        in_error_ = true;
+    } else if ((name == "script" || name == "style" || name == "textarea") && !self_closing) {
+        raw_end_ = "</" + name;
+        raw_matched_ = 0;
+        state_ = State::Raw;
+    }
+}
+
+void HtmlFormReader::FinishError() {
+    std::string error = Trim(DecodeHtmlEntities(error_));
+    if (!error.empty())
+        page_.errors.push_back(error);
+    error_.clear();
+    in_error_ = false;
+}
+
+std::string DecodeHtmlEntities(const std::string &text) {
+    size_t amp = text.find('&');
+    if (amp == std::string::npos)
+        return text;
+    std::string result(text, 0, amp);
+    result.reserve(text.size());
+    for (size_t i = amp; i < text.size();) {
+        if (text[i] == '&') {
+            size_t next = DecodeEntity(text, i, &result);
+            if (next != i) {
+                i = next;
+                continue;
+            }
+        }
+        result.push_back(text[i++]);
+    }
+    return result;
+}
@@ -0,0 +1,80 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct HtmlForm {
+    std::string action;
+    // values of the named inputs, with entities decoded; the first input with
+    // a name wins.  Textareas are skipped.
+    std::map<std::string, std::string> fields;
+};
+
+struct HtmlPage {
+    std::vector<HtmlForm> forms;
+    // text of the items of <ul class="errors"> lists, as the forum shows them
+    std::vector<std::string> errors;
+    // the form with a field called name, or nullptr
+    const HtmlForm *FindForm(const std::string &name) const;
+};
+
+/*
+ * Reads the forms and error messages of a page in one pass as it arrives,
+ * without keeping the page around: only the tag being read is buffered.
+ * Comments and the contents of <script>, <style> and <textarea> are skipped.
+ */
+class HtmlFormReader {
+public:
+    void Feed(const char *data, size_t size);
+    void Feed(const std::string &data) { Feed(data.data(), data.size()); }
+    const HtmlPage &page() const { return page_; }
+private:
+    enum class State {
+        Text,
+        Tag,
+        Comment,
+        // inside an element whose contents aren't markup, until raw_end_
+        Raw,
+    };
+    void OnTag();
+    void FinishError();
+
+    HtmlPage page_;
+    State state_{State::Text};
+    std::string tag_;
+    // quote character of the attribute value being read, or 0
+    char quote_{0};
+    // dashes in a row seen inside a comment
+    int dashes_{0};
+    std::string raw_end_;
+    size_t raw_matched_{0};
+    bool in_form_{false};
+    // <ul> elements open inside an error list
+    int error_lists_{0};
+    bool in_error_{false};
+    std::string error_;
+};
+
+// Replaces character references like &amp; &#x3D; and &#61; by what they stand
+// for, in UTF-8.  Unknown references are left alone.
+std::string DecodeHtmlEntities(const std::string &text);
@@ -21,33 +21,141 @@
 
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QRunnable>
 #include <QString>
-#include <QCryptographicHash>
+#include <functional>
 
-#include "mainwindow.h"
+#include "QsLog.h"
+#include "imagepack.h"
+#include "porting.h"
 #include "util.h"
 
-ImageCache::ImageCache(const std::string &directory):
-    directory_(directory)
+namespace {
+
+class ImageTask : public QRunnable {
+public:
+    explicit ImageTask(const std::function<void()> &task) : task_(task) {}
+    void run() { task_(); }
+private:
+    std::function<void()> task_;
+};
+
+}
+
+ImageCache::ImageCache(const std::string &directory, qint64 memory_budget, QObject *parent):
+    QObject(parent),
+    directory_(directory),
+    memory_budget_(memory_budget)
 {
     if (!QDir(directory_.c_str()).exists())
         QDir().mkpath(directory_.c_str());
+    pack_ = std::make_unique<ImagePack>(QString::fromStdString(directory_ + "/images.pack"));
+    ImportFiles();
+    connect(this, &ImageCache::Loaded, this, &ImageCache::OnLoaded, Qt::QueuedConnection);
+    connect(&network_manager_, &QNetworkAccessManager::finished, this, &ImageCache::OnDownloaded);
+}
+
+ImageCache::~ImageCache() {
+    // tasks emit signals of this object
+    pool_.waitForDone();
+}
+
+bool ImageCache::Request(const std::string &url, QImage *image) {
+    auto it = memory_.find(url);
+    if (it != memory_.end()) {
+        lru_.splice(lru_.end(), lru_, it->second.lru);
+        ++stats_.memory_hits;
+        *image = it->second.image;
+        return true;
+    }
+    if (!loading_.insert(url).second) {
+        ++stats_.coalesced;
+        return false;
+    }
+
+    QString qurl(url.c_str());
+    std::string key = Util::Md5(url);
+    pool_.start(new ImageTask([this, qurl, key]() {
+        QImage image;
+        QByteArray bytes = pack_->Read(key);
+        if (!bytes.isNull())
+            image.loadFromData(bytes);
+        emit Loaded(qurl, image, false);
+    }));
+    return false;
 }
 
-bool ImageCache::Exists(const std::string &url) {
-    std::string path = GetPath(url);
-    QFile file(QString(path.c_str()));
-    return file.exists();
+void ImageCache::OnLoaded(const QString &url, const QImage &image, bool downloaded) {
+    std::string key = url.toStdString();
+    if (image.isNull() && !downloaded) {
+        QNetworkRequest request{QUrl(url)};
+        // QUrl may normalize the url, the reply must find its loading_ entry
+        request.setAttribute(QNetworkRequest::User, url);
+        network_manager_.get(request);
+        return;
+    }
+    loading_.erase(key);
+    if (image.isNull()) {
+        emit ImageFailed(key);
+        return;
+    }
+    if (downloaded)
+        ++stats_.downloads;
+    else
+        ++stats_.disk_hits;
+    Remember(key, image);
+    emit ImageReady(key, image);
 }
 
-QImage ImageCache::Get(const std::string &url) {
-    return QImage(QString(GetPath(url).c_str()));
+void ImageCache::OnDownloaded(QNetworkReply *reply) {
+    reply->deleteLater();
+    QString url = reply->request().attribute(QNetworkRequest::User).toString();
+    if (reply->error()) {
+        QLOG_WARN() << "Failed to download item image," << url;
+        loading_.erase(url.toStdString());
+        emit ImageFailed(url.toStdString());
+        return;
+    }
+    QByteArray bytes = reply->readAll();
+    std::string key = Util::Md5(url.toStdString());
+    // stores the file as downloaded instead of encoding the decoded image again
+    pool_.start(new ImageTask([this, url, key, bytes]() {
+        QImage image = QImage::fromData(bytes);
+        if (!image.isNull() && !pack_->Write(key, bytes))
+            QLOG_WARN() << "Failed to store item image" << url;
+        emit Loaded(url, image, true);
+    }));
 }
 
-void ImageCache::Set(const std::string &url, const QImage &image) {
-    image.save(QString(GetPath(url).c_str()));
+void ImageCache::Remember(const std::string &url, const QImage &image) {
+    MemoryEntry entry;
+    entry.image = image;
+    entry.lru = lru_.insert(lru_.end(), url);
+    memory_[url] = entry;
+    stats_.memory_bytes += image.byteCount();
+    while (stats_.memory_bytes > memory_budget_ && lru_.size() > 1) {
+        auto evicted = memory_.find(lru_.front());
+        stats_.memory_bytes -= evicted->second.image.byteCount();
+        memory_.erase(evicted);
+        lru_.pop_front();
+        ++stats_.evictions;
+    }
 }
 
-std::string ImageCache::GetPath(const std::string &url) {
-    return directory_ + "/" + Util::Md5(url) + ".png";
+void ImageCache::ImportFiles() {
+    QDir dir(directory_.c_str());
+    QStringList files = dir.entryList(QStringList("*.png"), QDir::Files);
+    if (files.isEmpty())
+        return;
+    QLOG_INFO() << "Moving" << files.size() << "item images into the image pack";
+    for (auto &name : files) {
+        QFile file(dir.filePath(name));
+        // files were named after the md5 of their url
+        std::string key = QFileInfo(name).completeBaseName().toStdString();
+        if (file.open(QIODevice::ReadOnly) && !pack_->Contains(key))
+            pack_->Write(key, file.readAll());
+        file.remove();
+    }
 }
@@ -1,17 +1,74 @@
 #pragma once
 
 #include <QImage>
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <QThreadPool>
+#include <list>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
 
-class MainWindow;
+class ImagePack;
+class QNetworkReply;
 
-class ImageCache {
+// Decoded images kept in memory, in bytes
+const qint64 kImageCacheMemoryBudget = 32 * 1024 * 1024;
+
+struct ImageCacheStats {
+    size_t memory_hits{0};
+    size_t disk_hits{0};
+    size_t downloads{0};
+    // requests for an image that was already being loaded
+    size_t coalesced{0};
+    size_t evictions{0};
+    qint64 memory_bytes{0};
+};
+
+/*
+ * Item images, decoded and kept in memory up to a byte budget (least recently
+ * used are dropped first), and as downloaded in a single ImagePack under
+ * `directory`.  Reading and decoding happens on a background thread, and an
+ * image requested again while it is loading is only loaded once.
+ */
+class ImageCache : public QObject {
+    Q_OBJECT
 public:
-    explicit ImageCache(const std::string &directory);
-    bool Exists(const std::string &url);
-    QImage Get(const std::string &url);
-    void Set(const std::string &url, const QImage &image);
+    explicit ImageCache(const std::string &directory, qint64 memory_budget = kImageCacheMemoryBudget,
+                        QObject *parent = nullptr);
+    ~ImageCache();
+    // Sets *image and returns true if url is in memory.  Otherwise loads it from
+    // disk or downloads it, and emits ImageReady once it's there.
+    bool Request(const std::string &url, QImage *image);
+    const ImageCacheStats &stats() const { return stats_; }
+signals:
+    void ImageReady(const std::string &url, const QImage &image);
+    // url couldn't be downloaded or isn't an image
+    void ImageFailed(const std::string &url);
+    // emitted by background tasks, image is null if url isn't in the pack
+    void Loaded(const QString &url, const QImage &image, bool downloaded);
+private slots:
+    void OnLoaded(const QString &url, const QImage &image, bool downloaded);
+    void OnDownloaded(QNetworkReply *reply);
 private:
-    std::string GetPath(const std::string &url);
+    struct MemoryEntry {
+        QImage image;
+        std::list<std::string>::iterator lru;
+    };
+    // Moves images stored one file per url by older versions into the pack
+    void ImportFiles();
+    void Remember(const std::string &url, const QImage &image);
+
     std::string directory_;
+    std::unique_ptr<ImagePack> pack_;
+    qint64 memory_budget_;
+    std::unordered_map<std::string, MemoryEntry> memory_;
+    // least recently used first
+    std::list<std::string> lru_;
+    // urls being loaded from disk or downloaded
+    std::set<std::string> loading_;
+    QNetworkAccessManager network_manager_;
+    QThreadPool pool_;
+    ImageCacheStats stats_;
 };
@@ -0,0 +1,236 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagepack.h"
+
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include "QsLog.h"
+
+namespace {
+
+const char kPackMagic[] = "ACQP";
+const quint32 kPackVersion = 1;
+const qint64 kFileHeaderSize = 8;
+// key size and data size
+const qint64 kRecordHeaderSize = 8;
+
+QByteArray FileHeader() {
+    QByteArray header(kPackMagic, 4);
+    header.resize(kFileHeaderSize);
+    qToBigEndian<quint32>(kPackVersion, header.data() + 4);
+    return header;
+}
+
+QByteArray MakeRecord(const std::string &key, const QByteArray &data) {
+    QByteArray record(kRecordHeaderSize, 0);
+    qToBigEndian<quint32>(key.size(), record.data());
+    qToBigEndian<quint32>(data.size(), record.data() + 4);
+    record.append(key.data(), key.size());
+    record.append(data);
+    return record;
+}
+
+qint64 RecordSize(size_t key_size, quint32 data_size) {
+    return kRecordHeaderSize + key_size + data_size;
+}
+
+}
+
+ImagePack::ImagePack(const QString &path, bool map):
+    path_(path),
+    map_(map)
+{
+    if (Open() && stats_.dead_bytes > stats_.live_bytes)
+        DoCompact();
+}
+
+ImagePack::~ImagePack() {
+    Unmap();
+}
+
+bool ImagePack::Open() {
+    file_.setFileName(path_);
+    if (!file_.open(QIODevice::ReadWrite)) {
+        QLOG_ERROR() << "Failed to open image pack" << path_ << file_.errorString();
+        return false;
+    }
+    Scan();
+    return true;
+}
+
+void ImagePack::Scan() {
+    index_.clear();
+    stats_ = ImagePackStats();
+
+    QByteArray header = file_.read(kFileHeaderSize);
+    if (header != FileHeader()) {
+        if (!header.isEmpty())
+            QLOG_WARN() << "Image pack" << path_ << "has an unknown format, starting over";
+        file_.resize(0);
+        file_.seek(0);
+        file_.write(FileHeader());
+        return;
+    }
+
+    qint64 size = file_.size();
+    qint64 pos = kFileHeaderSize;
+    while (pos + kRecordHeaderSize <= size) {
+        file_.seek(pos);
+        QByteArray record_header = file_.read(kRecordHeaderSize);
+        if (record_header.size() != kRecordHeaderSize)
+            break;
+        quint32 key_size = qFromBigEndian<quint32>(record_header.constData());
+        quint32 data_size = qFromBigEndian<quint32>(record_header.constData() + 4);
+        qint64 end = pos + RecordSize(key_size, data_size);
+        if (end > size)
+            break;
+        std::string key = file_.read(key_size).toStdString();
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            qint64 old_size = RecordSize(key_size, it->second.size);
+            stats_.live_bytes -= old_size;
+            stats_.dead_bytes += old_size;
+        }
+        stats_.live_bytes += end - pos;
+        index_[key] = Record{ pos + kRecordHeaderSize + key_size, data_size };
+        pos = end;
+    }
+    if (pos < size) {
+        QLOG_WARN() << "Image pack" << path_ << "ends with an incomplete record, dropping" << size - pos << "bytes";
+        file_.resize(pos);
+    }
+    stats_.records = index_.size();
+}
+
+void ImagePack::Map() {
+    Unmap();
+    qint64 size = file_.size();
+    mapping_ = file_.map(0, size);
+    if (!mapping_) {
+        QLOG_WARN() << "Failed to map image pack" << path_ << file_.errorString() << ", reading it instead";
+        map_ = false;
+        return;
+    }
+    mapped_size_ = size;
+}
+
+void ImagePack::Unmap() {
+    if (mapping_)
+        file_.unmap(mapping_);
+    mapping_ = nullptr;
+    mapped_size_ = 0;
+}
+
+QByteArray ImagePack::Read(const std::string &key) {
+    QMutexLocker locker(&mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+        return QByteArray();
+    const Record &record = it->second;
+    qint64 end = record.offset + record.size;
+    // records appended since the file was mapped are outside the mapping
+    if (map_ && end > mapped_size_)
+        Map();
+    if (mapping_ && end <= mapped_size_)
+        return QByteArray(reinterpret_cast<const char*>(mapping_ + record.offset), record.size);
+    if (!file_.seek(record.offset))
+        return QByteArray();
+    QByteArray data = file_.read(record.size);
+    if (data.size() != static_cast<int>(record.size))
+        return QByteArray();
+    return data;
+}
+
+bool ImagePack::Write(const std::string &key, const QByteArray &data) {
+    QMutexLocker locker(&mutex_);
+    if (!file_.isOpen())
+        return false;
+    QByteArray record = MakeRecord(key, data);
+    qint64 pos = file_.size();
+    if (!file_.seek(pos) || file_.write(record) != record.size() || !file_.flush()) {
+        QLOG_WARN() << "Failed to write to image pack" << path_ << file_.errorString();
+        file_.resize(pos);
+        return false;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        qint64 old_size = RecordSize(key.size(), it->second.size);
+        stats_.live_bytes -= old_size;
+        stats_.dead_bytes += old_size;
+    }
+    stats_.live_bytes += record.size();
+    index_[key] = Record{ pos + kRecordHeaderSize + static_cast<qint64>(key.size()), static_cast<quint32>(data.size()) };
+    stats_.records = index_.size();
+    return true;
+}
+
+bool ImagePack::Contains(const std::string &key) {
+    QMutexLocker locker(&mutex_);
+    return index_.count(key) > 0;
+}
+
+bool ImagePack::Compact() {
+    QMutexLocker locker(&mutex_);
+    return DoCompact();
+}
+
+bool ImagePack::DoCompact() {
+    if (!file_.isOpen())
+        return false;
+    if (stats_.dead_bytes == 0)
+        return true;
+
+    QSaveFile out(path_);
+    if (!out.open(QIODevice::WriteOnly)) {
+        QLOG_WARN() << "Failed to compact image pack" << path_ << out.errorString();
+        return false;
+    }
+    out.write(FileHeader());
+    for (auto &entry : index_) {
+        const Record &record = entry.second;
+        QByteArray data;
+        if (file_.seek(record.offset))
+            data = file_.read(record.size);
+        if (data.size() != static_cast<int>(record.size)) {
+            QLOG_WARN() << "Failed to read image pack" << path_ << "while compacting it";
+            out.cancelWriting();
+            return false;
+        }
+        out.write(MakeRecord(entry.first, data));
+    }
+
+    qint64 before = file_.size();
+    // the file can't be replaced while it's open on every platform
+    Unmap();
+    file_.close();
+    if (!out.commit())
+        QLOG_WARN() << "Failed to compact image pack" << path_ << out.errorString();
+    bool opened = Open();
+    if (opened)
+        QLOG_INFO() << "Compacted image pack" << path_ << "from" << before << "to" << file_.size() << "bytes";
+    return opened && stats_.dead_bytes == 0;
+}
+
+ImagePackStats ImagePack::stats() {
+    QMutexLocker locker(&mutex_);
+    return stats_;
+}
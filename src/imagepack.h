@@ -0,0 +1,77 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <string>
+#include <unordered_map>
+
+struct ImagePackStats {
+    size_t records{0};
+    // bytes of records that can still be read, headers included
+    qint64 live_bytes{0};
+    // bytes of records that were written over since the last compaction
+    qint64 dead_bytes{0};
+};
+
+/*
+ * ImagePack keeps many small files in one append-only file.  Records are never
+ * changed in place: writing a key again appends a new record and leaves the old
+ * one dead until Compact() rewrites the file with only the live records.  The
+ * index is rebuilt on open by walking the record headers, and a record cut
+ * short by a crash is dropped.  All methods can be called from any thread.
+ */
+class ImagePack {
+public:
+    // With map set, the file is memory-mapped and reads copy from the mapping
+    // instead of seeking and reading.
+    explicit ImagePack(const QString &path, bool map = true);
+    ~ImagePack();
+    // Returns a null array if key isn't stored
+    QByteArray Read(const std::string &key);
+    bool Write(const std::string &key, const QByteArray &data);
+    bool Contains(const std::string &key);
+    // Rewrites the file without dead records
+    bool Compact();
+    ImagePackStats stats();
+private:
+    struct Record {
+        // position of the data in the file
+        qint64 offset;
+        quint32 size;
+    };
+    bool Open();
+    void Scan();
+    void Map();
+    void Unmap();
+    bool DoCompact();
+
+    QString path_;
+    bool map_;
+    QFile file_;
+    uchar *mapping_{nullptr};
+    qint64 mapped_size_{0};
+    std::unordered_map<std::string, Record> index_;
+    ImagePackStats stats_;
+    QMutex mutex_;
+};
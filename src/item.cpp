@@ -85,6 +85,10 @@ Item::Item(const std::string &name, const ItemLocation &location) :
 {}
 
 Item::Item(const rapidjson::Value &json) :
+    Item(json, Util::RapidjsonSerialize(json))
+{}
+
+Item::Item(const rapidjson::Value &json, std::string serialized) :
     location_(ItemLocation(json)),
     identified_(true),
     corrupted_(false),
@@ -97,7 +101,7 @@ Item::Item(const rapidjson::Value &json) :
     sockets_cnt_(0),
     links_cnt_(0),
     sockets_({ 0, 0, 0, 0 }),
-    json_(Util::RapidjsonSerialize(json)),
+    json_(std::move(serialized)),
     ilvl_(0)
 {
     if (json.HasMember("name") && json["name"].IsString())
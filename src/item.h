@@ -71,6 +71,8 @@ public:
     };
 
     explicit Item(const rapidjson::Value &json);
+    // Same, for when json was already serialized
+    Item(const rapidjson::Value &json, std::string serialized);
     Item(const std::string &name, const ItemLocation &location); // used by tests
     std::string name() const { return name_; }
     std::string typeLine() const { return typeLine_; }
@@ -93,6 +95,7 @@ public:
     const std::vector<ItemSocket> &text_sockets() const { return text_sockets_; }
     const std::string &hash() const { return hash_; }
     const std::string &old_hash() const { return old_hash_; }
+    const std::string &uid() const { return uid_; }
     const std::vector<std::pair<std::string, int>> &elemental_damage() const { return elemental_damage_; }
     const std::map<std::string, int> &requirements() const { return requirements_; }
     double DPS() const;
@@ -104,7 +107,7 @@ public:
     const ItemSocketGroup &sockets() const { return sockets_; }
     const std::vector<ItemSocketGroup> &socket_groups() const { return socket_groups_; }
     const ItemLocation &location() const { return location_; }
-    const std::string& json() { return json_; }
+    const std::string& json() const { return json_; }
     const std::string& note() const { return note_; }
     const std::string& category() const { return category_; }
     const std::vector<std::string>& category_vector() const { return category_vector_; }
@@ -0,0 +1,45 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemarena.h"
+
+const size_t ItemArena::kChunkSize;
+std::atomic<int> ItemArena::live_count_(0);
+
+ItemArena::ItemArena() {
+    ++live_count_;
+}
+
+ItemArena::~ItemArena() {
+    // destroy in reverse construction order
+    for (size_t chunk = chunks_.size(); chunk > 0; --chunk) {
+        size_t used = (chunk == chunks_.size()) ? used_ : kChunkSize;
+        for (size_t i = used; i > 0; --i)
+            reinterpret_cast<Item*>(&chunks_[chunk - 1][i - 1])->~Item();
+    }
+    --live_count_;
+}
+
+void *ItemArena::Allocate() {
+    if (used_ == kChunkSize) {
+        chunks_.emplace_back(new Slot[kChunkSize]);
+        used_ = 0;
+    }
+    return &chunks_.back()[used_];
+}
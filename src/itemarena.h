@@ -0,0 +1,76 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "item.h"
+
+/*
+ * ItemArena constructs all Items of one refresh in fixed-size chunks instead
+ * of one heap allocation per Item.  Items are handed out as shared_ptrs that
+ * alias the arena, so the existing Items interface keeps working but all of
+ * them share the arena's single control block; the whole arena (and every
+ * Item in it) is destroyed at once when the last reference goes away, which
+ * normally happens when the next refresh replaces the ItemStore contents.
+ */
+class ItemArena : public std::enable_shared_from_this<ItemArena> {
+public:
+    ItemArena();
+    ~ItemArena();
+    ItemArena(const ItemArena&) = delete;
+    ItemArena &operator=(const ItemArena&) = delete;
+
+    template<typename... Args>
+    std::shared_ptr<Item> MakeItem(Args&&... args) {
+        Item *item = new (Allocate()) Item(std::forward<Args>(args)...);
+        // only claim the slot once the constructor has succeeded
+        ++used_;
+        ++size_;
+        return std::shared_ptr<Item>(shared_from_this(), item);
+    }
+
+    // number of Items constructed in this arena
+    size_t size() const { return size_; }
+    // number of heap allocations made for Item storage
+    size_t chunk_count() const { return chunks_.size(); }
+    size_t reserved_bytes() const { return chunks_.size() * kChunkSize * sizeof(Slot); }
+    // number of arenas currently alive in the process, used to verify that
+    // retired arenas are actually released
+    static int live_count() { return live_count_; }
+
+    static const size_t kChunkSize = 512;
+
+private:
+    typedef std::aligned_storage<sizeof(Item), alignof(Item)>::type Slot;
+
+    // returns the next free slot without claiming it
+    void *Allocate();
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    // slots used in the last chunk, all other chunks are full
+    size_t used_{kChunkSize};
+    size_t size_{0};
+    static std::atomic<int> live_count_;
+};
@@ -0,0 +1,198 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itembitmap.h"
+
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+
+int ItemBitmap::CountTrailingZeros(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+    while (!(w & 1)) {
+        w >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+void ItemBitmap::ConvertToBitset(Container *container) {
+    container->bits.assign(kBitsetWords, 0);
+    for (auto low : container->array)
+        container->bits[low / 64] |= uint64_t(1) << (low % 64);
+    container->array.clear();
+    container->array.shrink_to_fit();
+}
+
+void ItemBitmap::ConvertToArray(Container *container) {
+    container->array.clear();
+    container->array.reserve(container->cardinality);
+    for (size_t word = 0; word < container->bits.size(); ++word) {
+        uint64_t w = container->bits[word];
+        while (w) {
+            container->array.push_back(static_cast<uint16_t>(word * 64 + CountTrailingZeros(w)));
+            w &= w - 1;
+        }
+    }
+    container->bits.clear();
+    container->bits.shrink_to_fit();
+}
+
+ItemBitmap::Container *ItemBitmap::FindOrCreate(uint16_t key) {
+    // Ids are almost always added in ascending order so check the last container first
+    if (!containers_.empty() && containers_.back().key == key)
+        return &containers_.back();
+
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container &c, uint16_t k) {
+        return c.key < k;
+    });
+    if (it != containers_.end() && it->key == key)
+        return &*it;
+
+    Container container;
+    container.key = key;
+    container.cardinality = 0;
+    return &*containers_.insert(it, container);
+}
+
+const ItemBitmap::Container *ItemBitmap::Find(uint16_t key) const {
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container &c, uint16_t k) {
+        return c.key < k;
+    });
+    if (it != containers_.end() && it->key == key)
+        return &*it;
+    return nullptr;
+}
+
+void ItemBitmap::Add(ItemId id) {
+    Container *container = FindOrCreate(static_cast<uint16_t>(id >> 16));
+    uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+
+    if (!container->bits.empty()) {
+        uint64_t &word = container->bits[low / 64];
+        uint64_t mask = uint64_t(1) << (low % 64);
+        if (!(word & mask)) {
+            word |= mask;
+            ++container->cardinality;
+        }
+        return;
+    }
+
+    auto &array = container->array;
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low)
+            return;
+        array.insert(it, low);
+    }
+    ++container->cardinality;
+
+    if (container->cardinality > kMaxArraySize)
+        ConvertToBitset(container);
+}
+
+bool ItemBitmap::Contains(ItemId id) const {
+    const Container *container = Find(static_cast<uint16_t>(id >> 16));
+    if (!container)
+        return false;
+    uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    if (!container->bits.empty())
+        return (container->bits[low / 64] >> (low % 64)) & 1;
+    return std::binary_search(container->array.begin(), container->array.end(), low);
+}
+
+size_t ItemBitmap::Cardinality() const {
+    size_t result = 0;
+    for (auto &container : containers_)
+        result += container.cardinality;
+    return result;
+}
+
+std::vector<ItemId> ItemBitmap::ToVector() const {
+    std::vector<ItemId> result;
+    result.reserve(Cardinality());
+    ForEach([&result](ItemId id) { result.push_back(id); });
+    return result;
+}
+
+size_t ItemBitmap::MemoryUsage() const {
+    size_t result = sizeof(*this) + containers_.capacity() * sizeof(Container);
+    for (auto &container : containers_)
+        result += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    return result;
+}
+
+ItemBitmap::Container ItemBitmap::Intersect(const Container &a, const Container &b) {
+    Container result;
+    result.key = a.key;
+    result.cardinality = 0;
+
+    if (!a.bits.empty() && !b.bits.empty()) {
+        result.bits.resize(kBitsetWords);
+        for (size_t i = 0; i < kBitsetWords; ++i) {
+            result.bits[i] = a.bits[i] & b.bits[i];
+            result.cardinality += std::bitset<64>(result.bits[i]).count();
+        }
+        if (result.cardinality <= kMaxArraySize)
+            ConvertToArray(&result);
+    } else if (a.bits.empty() && b.bits.empty()) {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(result.array));
+        result.cardinality = result.array.size();
+    } else {
+        const Container &sparse = a.bits.empty() ? a : b;
+        const Container &dense = a.bits.empty() ? b : a;
+        for (auto low : sparse.array)
+            if ((dense.bits[low / 64] >> (low % 64)) & 1)
+                result.array.push_back(low);
+        result.cardinality = result.array.size();
+    }
+    return result;
+}
+
+ItemBitmap ItemBitmap::operator&(const ItemBitmap &other) const {
+    ItemBitmap result;
+    auto a = containers_.begin(), b = other.containers_.begin();
+    while (a != containers_.end() && b != other.containers_.end()) {
+        if (a->key < b->key) {
+            ++a;
+        } else if (b->key < a->key) {
+            ++b;
+        } else {
+            Container container = Intersect(*a, *b);
+            if (container.cardinality > 0)
+                result.containers_.push_back(std::move(container));
+            ++a;
+            ++b;
+        }
+    }
+    return result;
+}
+
+bool ItemBitmap::operator==(const ItemBitmap &other) const {
+    if (Cardinality() != other.Cardinality())
+        return false;
+    return ToVector() == other.ToVector();
+}
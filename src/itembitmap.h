@@ -0,0 +1,90 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+typedef uint32_t ItemId;
+
+/*
+ * Compressed set of item ids, laid out like a roaring bitmap.
+ *
+ * Ids are split into a 16-bit high part selecting a container and a 16-bit
+ * low part stored inside it.  Sparse containers keep a sorted array of low
+ * parts, dense containers switch to a 65536-bit bitset.  A search over a
+ * typical stash produces a handful of containers, which is much cheaper to
+ * keep around per search tab than a vector of shared_ptr copies.
+ */
+class ItemBitmap {
+public:
+    void Add(ItemId id);
+    bool Contains(ItemId id) const;
+    size_t Cardinality() const;
+    bool Empty() const { return containers_.empty(); }
+    void Clear() { containers_.clear(); }
+    std::vector<ItemId> ToVector() const;
+    size_t MemoryUsage() const;
+    ItemBitmap operator&(const ItemBitmap &other) const;
+    bool operator==(const ItemBitmap &other) const;
+
+    template<typename Function>
+    void ForEach(Function f) const {
+        for (auto &container : containers_) {
+            ItemId high = static_cast<ItemId>(container.key) << 16;
+            if (container.bits.empty()) {
+                for (auto low : container.array)
+                    f(high | low);
+            } else {
+                for (size_t word = 0; word < container.bits.size(); ++word) {
+                    uint64_t w = container.bits[word];
+                    while (w) {
+                        f(high | static_cast<ItemId>(word * 64 + CountTrailingZeros(w)));
+                        w &= w - 1;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Container {
+        uint16_t key;
+        size_t cardinality;
+        // Exactly one of these is in use: array while the container is
+        // sparse, bits once it holds more than kMaxArraySize values.
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+    };
+
+    static const size_t kMaxArraySize = 4096;
+    static const size_t kBitsetWords = 65536 / 64;
+
+    static int CountTrailingZeros(uint64_t w);
+    static void ConvertToBitset(Container *container);
+    static void ConvertToArray(Container *container);
+    static Container Intersect(const Container &a, const Container &b);
+    Container *FindOrCreate(uint16_t key);
+    const Container *Find(uint16_t key) const;
+
+    // sorted by key
+    std::vector<Container> containers_;
+};
@@ -0,0 +1,74 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemchangeset.h"
+
+#include <unordered_map>
+
+namespace {
+
+bool SameContainer(const ItemLocation &lhs, const ItemLocation &rhs) {
+    return !(lhs < rhs) && !(rhs < lhs) && lhs.GetUniqueHash() == rhs.GetUniqueHash();
+}
+
+bool SameContents(const Item &lhs, const Item &rhs) {
+    return &lhs == &rhs || (lhs.json() == rhs.json() && lhs.hash() == rhs.hash());
+}
+
+}
+
+const std::string &ItemChangeSet::Identity(const Item &item) {
+    return item.uid().empty() ? item.hash() : item.uid();
+}
+
+ItemChangeSet ItemChangeSet::Diff(const Items &previous, const Items &current) {
+    ItemChangeSet changes;
+
+    std::unordered_multimap<std::string, std::shared_ptr<Item>> by_identity;
+    by_identity.reserve(previous.size());
+    for (auto &item : previous)
+        by_identity.emplace(Identity(*item), item);
+
+    for (auto &item : current) {
+        auto range = by_identity.equal_range(Identity(*item));
+        if (range.first == range.second) {
+            changes.added.push_back(item);
+            continue;
+        }
+        // with duplicate identities prefer the candidate that is unchanged
+        auto match = range.first;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (SameContents(*it->second, *item)) {
+                match = it;
+                break;
+            }
+        }
+        ItemChange change = { match->second, item };
+        by_identity.erase(match);
+
+        if (!SameContainer(change.previous->location(), item->location()))
+            changes.moved.push_back(change);
+        else if (!SameContents(*change.previous, *item))
+            changes.changed.push_back(change);
+    }
+
+    for (auto &left : by_identity)
+        changes.removed.push_back(left.second);
+    return changes;
+}
@@ -0,0 +1,55 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "item.h"
+
+struct ItemChange {
+    std::shared_ptr<Item> previous;
+    std::shared_ptr<Item> current;
+};
+
+/*
+ * Describes how one generation of items differs from the previous one.
+ * Items are matched by their uid (the "id" field of the API, falling back to
+ * the item hash for items that don't have one):
+ *  - added: no item with this uid existed before
+ *  - removed: the uid is no longer present
+ *  - moved: same uid but now in another stash tab or character
+ *  - changed: same uid and container but different contents (including its
+ *    position inside the tab, note or stack size)
+ * Items that are identical (the same instance or the same json) are not listed.
+ */
+struct ItemChangeSet {
+    Items added;
+    Items removed;
+    std::vector<ItemChange> changed;
+    std::vector<ItemChange> moved;
+
+    bool empty() const { return added.empty() && removed.empty() && changed.empty() && moved.empty(); }
+    size_t size() const { return added.size() + removed.size() + changed.size() + moved.size(); }
+
+    static ItemChangeSet Diff(const Items &previous, const Items &current);
+    // What items are matched by: the uid, or the hash if the item has none
+    static const std::string &Identity(const Item &item);
+};
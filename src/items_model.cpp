@@ -19,10 +19,14 @@
 
 #include "items_model.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "application.h"
 #include "bucket.h"
 #include "buyoutmanager.h"
 #include "itemlocation.h"
+#include "itemstore.h"
 #include "search.h"
 #include "util.h"
 #include "QsLog.h"
@@ -53,7 +57,7 @@ int ItemsModel::rowCount(const QModelIndex &parent) const {
         return search_.buckets().size();
     // Bucket, contains elements
     if (parent.isValid() && !parent.parent().isValid()) {
-        return search_.bucket(parent.row())->items().size();
+        return search_.bucket(parent.row())->size();
     }
     // Element, contains nothing
     return 0;
@@ -174,6 +178,47 @@ void ItemsModel::sort()
     sort(sort_column_, sort_order_);
 }
 
+void ItemsModel::RefreshLocations(const ItemStore &store, const std::set<ItemLocation> &locations)
+{
+    int last_column = columnCount() - 1;
+    int bucket_count = rowCount();
+    for (int row = 0; row < bucket_count; ++row) {
+        auto &bucket = search_.bucket(row);
+        QModelIndex parent = index(row);
+        if (bucket->location().IsValid()) {
+            // tab bucket, all items share its location
+            if (!locations.count(bucket->location()))
+                continue;
+            emit dataChanged(parent, index(row, last_column));
+            if (bucket->size() > 0)
+                emit dataChanged(index(0, 0, parent),
+                                 index(static_cast<int>(bucket->size()) - 1, last_column, parent));
+            continue;
+        }
+        // "All Items" bucket, only refresh the rows of items in the changed tabs
+        std::vector<int> rows;
+        for (auto &location : locations) {
+            auto it = store.locations().find(location);
+            if (it == store.locations().end())
+                continue;
+            (bucket->ids() & it->second).ForEach([&](ItemId id) {
+                int item_row = bucket->row(id);
+                if (item_row >= 0)
+                    rows.push_back(item_row);
+            });
+        }
+        std::sort(rows.begin(), rows.end());
+        // one signal per run of adjacent rows
+        for (size_t i = 0; i < rows.size();) {
+            size_t j = i;
+            while (j + 1 < rows.size() && rows[j + 1] == rows[j] + 1)
+                ++j;
+            emit dataChanged(index(rows[i], 0, parent), index(rows[j], last_column, parent));
+            i = j + 1;
+        }
+    }
+}
+
 QModelIndex ItemsModel::parent(const QModelIndex &index) const {
     // bucket
     if (!index.isValid() || index.internalId() == 0) {
@@ -20,11 +20,14 @@
 #pragma once
 
 #include <QAbstractItemModel>
+#include <set>
 
 #include "column.h"
 #include "item.h"
+#include "itemlocation.h"
 
 class BuyoutManager;
+class ItemStore;
 class Search;
 
 class ItemsModel : public QAbstractItemModel {
@@ -44,6 +47,9 @@ public:
     Qt::SortOrder GetSortOrder() { return sort_order_;};
     int GetSortColumn() { return sort_column_;};
     void SetSorted(bool val) { sorted_ = val; };
+    // Emits dataChanged only for the buckets and item rows in the passed locations,
+    // item rows of the "All Items" bucket are found through the store's tab bitmaps
+    void RefreshLocations(const ItemStore &store, const std::set<ItemLocation> &locations);
 
 private:
     BuyoutManager &bo_manager_;
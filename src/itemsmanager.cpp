@@ -19,6 +19,8 @@
 
 #include "itemsmanager.h"
 
+#include <QElapsedTimer>
+#include <QStringList>
 #include <QThread>
 #include <stdexcept>
 
@@ -27,6 +29,7 @@
 #include "datastore.h"
 #include "itemsmanagerworker.h"
 #include "porting.h"
+#include "QsLog.h"
 #include "rapidjson_util.h"
 #include "shop.h"
 #include "util.h"
@@ -57,7 +60,7 @@ void ItemsManager::Start() {
     connect(thread_.get(), SIGNAL(started()), worker_.get(), SLOT(Init()));
     connect(this, SIGNAL(UpdateSignal(TabSelection::Type, const std::vector<ItemLocation> &)), worker_.get(), SLOT(Update(TabSelection::Type, const std::vector<ItemLocation> &)));
     connect(worker_.get(), &ItemsManagerWorker::StatusUpdate, this, &ItemsManager::OnStatusUpdate);
-    connect(worker_.get(), SIGNAL(ItemsRefreshed(Items, std::vector<ItemLocation>, bool)), this, SLOT(OnItemsRefreshed(Items, std::vector<ItemLocation>, bool)));
+    connect(worker_.get(), SIGNAL(ItemsRefreshed(Items, std::vector<ItemLocation>, bool, ItemChangeSet)), this, SLOT(OnItemsRefreshed(Items, std::vector<ItemLocation>, bool, ItemChangeSet)));
     worker_->moveToThread(thread_.get());
     thread_->start();
 }
@@ -89,72 +92,237 @@ void ItemsManager::ApplyAutoTabBuyouts() {
 
 void ItemsManager::ApplyAutoItemBuyouts() {
     // Loop over all items, check for note field with pricing and apply
-    auto &bo = app_.buyout_manager();
-    for (auto const& item: items_) {
-        auto const &note = item->note();
-        if (!note.empty()) {
-            Buyout buyout = bo.StringToBuyout(note);
-            // This line may look confusing, buyout returns an active buyout if game
-            // pricing was found or a default buyout (inherit) if it was not.
-            // If there is a currently valid note we want to apply OR if
-            // old note no longer is valid (so basically clear pricing)
-            if (buyout.IsActive() || bo.Get(*item).IsGameSet()) {
-                bo.Set(*item, buyout);
-            }
-        }
-    }
+    for (auto const& item: items())
+        ApplyAutoItemBuyout(*item);
 
     // Commenting this out for robustness (iss381) to make it as unlikely as possible that users
     // pricing data will be removed.  Side effect is that stale pricing data will pile up and
     // could be applied to future items with the same hash (which includes tab name).
-    // bo.CompressItemBuyouts(items_);
+    // bo.CompressItemBuyouts(items());
 }
 
-void ItemsManager::PropagateTabBuyouts() {
+void ItemsManager::ApplyAutoItemBuyouts(const Items &items) {
+    for (auto const& item: items)
+        ApplyAutoItemBuyout(*item);
+}
+
+void ItemsManager::ApplyAutoItemBuyout(const Item &item) {
     auto &bo = app_.buyout_manager();
-    bo.ClearRefreshLocks();
-    for (auto &item_ptr : items_) {
-        Item &item = *item_ptr;
-        std::string hash = item.location().GetUniqueHash();
-        auto item_bo = bo.Get(item);
-        auto tab_bo = bo.GetTab(hash);
-
-        if (item_bo.IsInherited()) {
-            if (tab_bo.IsActive()) {
-                // Any propagation from tab price to item price should include this bit set
-                tab_bo.inherited = true;
-                tab_bo.last_update = QDateTime::currentDateTime();
-                bo.Set(item, tab_bo);
-            } else {
-                // This effectively 'clears' buyout by setting back to 'inherit' state.
-                bo.Set(item, Buyout());
-            }
+    auto const &note = item.note();
+    if (!note.empty()) {
+        Buyout buyout = bo.StringToBuyout(note);
+        // This line may look confusing, buyout returns an active buyout if game
+        // pricing was found or a default buyout (inherit) if it was not.
+        // If there is a currently valid note we want to apply OR if
+        // old note no longer is valid (so basically clear pricing)
+        if (buyout.IsActive() || bo.Get(item).IsGameSet()) {
+            bo.Set(item, buyout);
         }
+    }
+}
+
+bool ItemsManager::PropagateTabBuyout(const Item &item) {
+    auto &bo = app_.buyout_manager();
+    std::string hash = item.location().GetUniqueHash();
+    auto item_bo = bo.Get(item);
+    auto tab_bo = bo.GetTab(hash);
 
-        // If any savable bo's are set on an item or the tab then lock
-        // the refresh state.
-        if (bo.Get(item).RequiresRefresh() || tab_bo.RequiresRefresh()) {
-            bo.SetRefreshLocked(item.location());
+    if (item_bo.IsInherited()) {
+        if (tab_bo.IsActive()) {
+            // Any propagation from tab price to item price should include this bit set
+            tab_bo.inherited = true;
+            tab_bo.last_update = QDateTime::currentDateTime();
+            bo.Set(item, tab_bo);
+        } else {
+            // This effectively 'clears' buyout by setting back to 'inherit' state.
+            bo.Set(item, Buyout());
         }
     }
+
+    // If any savable bo's are set on an item or the tab then lock
+    // the refresh state.
+    return bo.Get(item).RequiresRefresh() || tab_bo.RequiresRefresh();
+}
+
+void ItemsManager::PropagateTabBuyouts() {
+    auto &bo = app_.buyout_manager();
+    bo.ClearRefreshLocks();
+    for (auto &item : items()) {
+        if (PropagateTabBuyout(*item))
+            bo.SetRefreshLocked(item->location());
+    }
+}
+
+void ItemsManager::PropagateTabBuyouts(const std::set<ItemLocation> &locations) {
+    auto &bo = app_.buyout_manager();
+    for (auto &location : locations) {
+        bo.ClearRefreshLocked(location);
+        auto it = store_.locations().find(location);
+        if (it == store_.locations().end())
+            continue;
+        it->second.ForEach([&](ItemId id) {
+            auto &item = *store_.item(id);
+            if (PropagateTabBuyout(item))
+                bo.SetRefreshLocked(item.location());
+        });
+    }
 }
 
 void ItemsManager::OnItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh) {
-    items_ = items;
+    OnItemsRefreshed(items, tabs, initial_refresh, ItemChangeSet::Diff(store_.items(), items));
+}
 
+void ItemsManager::OnItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh, const ItemChangeSet &changes) {
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::pair<const char*, qint64>> stages;
+    auto stage_done = [&](const char *name) {
+        stages.push_back({ name, timer.restart() });
+    };
+
+    store_.Reset(items);
+    changes_ = changes;
     bo_manager_.SetStashTabLocations(tabs);
-    MigrateBuyouts();
+    stage_done("store");
+
+    bool full = MigrateBuyouts();
+    stage_done("migrate");
+
     ApplyAutoTabBuyouts();
-    ApplyAutoItemBuyouts();
-    PropagateTabBuyouts();
+    stage_done("tab notes");
+
+    // Buyouts only have to be recomputed for items that changed and for
+    // everything in tabs whose buyout changed (by tab name or by the user)
+    full = full || bo_manager_.all_tabs_changed();
+    Items changed_items(changes.added);
+    for (auto const &change : changes.changed)
+        changed_items.push_back(change.current);
+    for (auto const &change : changes.moved)
+        changed_items.push_back(change.current);
+
+    if (full)
+        ApplyAutoItemBuyouts();
+    else
+        ApplyAutoItemBuyouts(changed_items);
+    stage_done("item notes");
+
+    // tabs whose items may have changed prices
+    std::set<ItemLocation> locations;
+    if (full) {
+        PropagateTabBuyouts();
+    } else {
+        for (auto const &item : changed_items)
+            locations.insert(item->location());
+        // tabs that items left may have to be unlocked
+        for (auto const &item : changes.removed)
+            locations.insert(item->location());
+        for (auto const &change : changes.moved)
+            locations.insert(change.previous->location());
+        for (auto const &location : store_.locations())
+            if (bo_manager_.changed_tabs().count(location.first.GetUniqueHash()))
+                locations.insert(location.first);
+        PropagateTabBuyouts(locations);
+    }
+    bo_manager_.ClearTabChanges();
+    stage_done("propagate");
+
     UpdateCategories();
+    stage_done("categories");
+
+    if (!items_stored_) {
+        // the rows may still be those of another session
+        StoreItems();
+    } else {
+        StoreItems(changes);
+        if (full)
+            StoreItemPrices();
+        else
+            StoreItemPrices(locations);
+    }
+    stage_done("store rows");
+
+    QStringList timings;
+    for (auto const &stage : stages)
+        timings.push_back(QString("%1 %2ms").arg(stage.first).arg(stage.second));
+    QLOG_DEBUG() << "Processed" << items.size() << "items," << changes.size() << "changed,"
+                 << (full ? "full" : "incremental") << "update:" << timings.join(", ");
 
     emit ItemsRefreshed(initial_refresh);
 }
 
+ItemPrice ItemsManager::CurrentPrice(const Item &item) const {
+    ItemPrice price;
+    Buyout buyout = bo_manager_.Get(item);
+    if (buyout.IsPriced()) {
+        price.value = buyout.value;
+        price.currency = buyout.currency.AsTag();
+    }
+    return price;
+}
+
+ItemRecord ItemsManager::MakeRecord(const Item &item) const {
+    ItemRecord record;
+    record.uid = ItemChangeSet::Identity(item);
+    record.hash = item.hash();
+    record.tab = item.location().GetUniqueHash();
+    record.category = item.category();
+    record.frame_type = item.frameType();
+    record.price = CurrentPrice(item);
+    record.mods.insert(item.mod_table().begin(), item.mod_table().end());
+    return record;
+}
+
+void ItemsManager::StoreItems() {
+    std::vector<ItemRecord> records;
+    records.reserve(items().size());
+    for (auto const &item : items())
+        records.push_back(MakeRecord(*item));
+    data_.ReplaceItems(records);
+    items_stored_ = true;
+}
+
+void ItemsManager::StoreItems(const ItemChangeSet &changes) {
+    std::vector<ItemRecord> added;
+    std::vector<std::string> removed;
+    for (auto const &item : changes.added)
+        added.push_back(MakeRecord(*item));
+    for (auto const &item : changes.removed)
+        removed.push_back(ItemChangeSet::Identity(*item));
+    for (auto const &change : changes.changed) {
+        removed.push_back(ItemChangeSet::Identity(*change.previous));
+        added.push_back(MakeRecord(*change.current));
+    }
+    for (auto const &change : changes.moved) {
+        removed.push_back(ItemChangeSet::Identity(*change.previous));
+        added.push_back(MakeRecord(*change.current));
+    }
+    data_.UpdateItems(added, removed);
+}
+
+void ItemsManager::StoreItemPrices(const std::set<ItemLocation> &locations) {
+    std::map<std::string, ItemPrice> prices;
+    for (auto &location : locations) {
+        auto it = store_.locations().find(location);
+        if (it == store_.locations().end())
+            continue;
+        it->second.ForEach([&](ItemId id) {
+            auto &item = *store_.item(id);
+            prices[ItemChangeSet::Identity(item)] = CurrentPrice(item);
+        });
+    }
+    data_.UpdateItemPrices(prices);
+}
+
+void ItemsManager::StoreItemPrices() {
+    std::map<std::string, ItemPrice> prices;
+    for (auto const &item : items())
+        prices[ItemChangeSet::Identity(*item)] = CurrentPrice(*item);
+    data_.UpdateItemPrices(prices);
+}
+
 void ItemsManager::UpdateCategories() {
     categories_.clear();
-    for (auto const &item: items_) {
+    for (auto const &item: items()) {
         QString tmp;
         for (auto const &level: item->category_vector()) {
             tmp = tmp.isEmpty() ? level.c_str(): tmp + "." + level.c_str();
@@ -190,13 +358,14 @@ void ItemsManager::OnAutoRefreshTimer() {
     Update(TabSelection::Checked);
 }
 
-void ItemsManager::MigrateBuyouts() {
+bool ItemsManager::MigrateBuyouts() {
     int db_version = data_.GetInt("db_version");
     // Don't migrate twice
     if (db_version == 4)
-        return;
-    for (auto &item : items_)
+        return false;
+    for (auto &item : items())
         bo_manager_.MigrateItem(*item);
     bo_manager_.Save();
     data_.SetInt("db_version", 4);
+    return true;
 }
@@ -21,12 +21,17 @@
 
 #include <QTimer>
 #include <memory>
+#include <set>
 
 #include "item.h"
+#include "itemchangeset.h"
 #include "itemsmanagerworker.h"
+#include "itemstore.h"
 #include "tabcache.h"
 
 struct CurrentStatusUpdate;
+struct ItemPrice;
+struct ItemRecord;
 class QThread;
 class Application;
 class BuyoutManager;
@@ -50,24 +55,46 @@ public:
     void SetAutoUpdate(bool update);
     int auto_update_interval() const { return auto_update_interval_; }
     bool auto_update() const { return auto_update_; }
-    const Items &items() const { return items_; }
+    const Items &items() const { return store_.items(); }
+    const ItemStore &store() const { return store_; }
+    // what changed in the last refresh
+    const ItemChangeSet &changes() const { return changes_; }
     void ApplyAutoTabBuyouts();
     void ApplyAutoItemBuyouts();
+    // Only applies note buyouts of the passed items
+    void ApplyAutoItemBuyouts(const Items &items);
     void PropagateTabBuyouts();
+    // Only propagates tab buyouts to items in the passed locations and updates their refresh locks
+    void PropagateTabBuyouts(const std::set<ItemLocation> &locations);
     void UpdateCategories();
     const QSet<QString>& categories() const { return categories_; }
+    // Stores all items as rows that can be queried through the DataStore
+    void StoreItems();
+    // Only stores the rows of items that changed
+    void StoreItems(const ItemChangeSet &changes);
+    // Stores the current prices of the stored items in the passed locations
+    void StoreItemPrices(const std::set<ItemLocation> &locations);
+    void StoreItemPrices();
 public slots:
     // called by auto_update_timer_
     void OnAutoRefreshTimer();
     // Used to glue Worker's signals to MainWindow
     void OnStatusUpdate(const CurrentStatusUpdate &status);
+    void OnItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh, const ItemChangeSet &changes);
+    // Same as above but computes the change set against the current items.
     void OnItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh);
 signals:
     void UpdateSignal(TabSelection::Type type, const std::vector<ItemLocation>& tab_names = std::vector<ItemLocation>());
     void ItemsRefreshed(bool initial_refresh);
     void StatusUpdate(const CurrentStatusUpdate &status);
 private:
-    void MigrateBuyouts();
+    // returns true if buyouts were migrated
+    bool MigrateBuyouts();
+    void ApplyAutoItemBuyout(const Item &item);
+    // returns true if the item's tab has to be locked for refresh
+    bool PropagateTabBuyout(const Item &item);
+    ItemPrice CurrentPrice(const Item &item) const;
+    ItemRecord MakeRecord(const Item &item) const;
 
     // should items be automatically refreshed
     bool auto_update_;
@@ -80,6 +107,10 @@ private:
     BuyoutManager &bo_manager_;
     Shop &shop_;
     Application &app_;
-    Items items_;
+    ItemStore store_;
+    ItemChangeSet changes_;
+    // whether the item rows were stored this session, after which they are
+    // only updated with what changed
+    bool items_stored_{false};
     QSet<QString> categories_;
 };
@@ -19,6 +19,7 @@
 
 #include "itemsmanagerworker.h"
 
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QNetworkCookie>
 #include <QNetworkCookieJar>
@@ -28,6 +29,7 @@
 #include <QTimer>
 #include <QUrlQuery>
 #include <algorithm>
+#include <memory>
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 
@@ -44,6 +46,19 @@ const char *kStashItemsUrl = "https://www.pathofexile.com/character-window/get-s
 const char *kCharacterItemsUrl = "https://www.pathofexile.com/character-window/get-items";
 const char *kGetCharactersUrl = "https://www.pathofexile.com/character-window/get-characters";
 const char *kMainPage = "https://www.pathofexile.com/";
+// When the "items" snapshot was last saved, in ms since the epoch
+const char *kSnapshotTime = "items_saved";
+
+namespace {
+
+// <"n", "id"> of an entry of the tab list
+std::pair<std::string, std::string> TabSignature(const rapidjson::Value &tab) {
+    std::string name = (tab.HasMember("n") && tab["n"].IsString()) ? tab["n"].GetString(): "UNKNOWN_NAME";
+    std::string uid = (tab.HasMember("id") && tab["id"].IsString()) ? tab["id"].GetString(): "UNKNOWN_ID";
+    return { name, uid };
+}
+
+}
 
 ItemsManagerWorker::ItemsManagerWorker(Application &app, QThread *thread) :
     data_(app.data()),
@@ -74,24 +89,29 @@ ItemsManagerWorker::~ItemsManagerWorker() {
 }
 
 void ItemsManagerWorker::Init() {
+    QElapsedTimer timer;
+    timer.start();
     items_.clear();
+    arena_ = std::make_shared<ItemArena>();
     std::string items = data_.Get("items");
     if (items.size() != 0) {
         rapidjson::Document doc;
         doc.Parse(items.c_str());
         for (auto item = doc.Begin(); item != doc.End(); ++item)
-            items_.push_back(std::make_shared<Item>(*item));
+            items_.push_back(arena_->MakeItem(*item));
     }
+    size_t snapshot_items = items_.size();
 
     tabs_.clear();
     std::string tabs = data_.Get("tabs");
     tabs_signature_ = CreateTabsSignatureVector(tabs);
     if (tabs.size() != 0) {
         rapidjson::Document doc;
-        if (doc.Parse(tabs.c_str()).HasParseError()) {
+        if (doc.Parse(tabs.c_str()).HasParseError() || !doc.IsArray()) {
             QLOG_ERROR() << "Malformed tabs data:" << tabs.c_str() << "The error was"
                 << rapidjson::GetParseError_En(doc.GetParseError());
-            return;
+            // still publish the snapshot below, that's what starts the refresh from the server
+            doc.SetArray();
         }
         for (auto &tab : doc) {
             if (!tab.HasMember("n") || !tab["n"].IsString()) {
@@ -104,7 +124,65 @@ void ItemsManagerWorker::Init() {
                 tabs_.push_back(ItemLocation(index, tab["n"].GetString()));
         }
     }
-    emit ItemsRefreshed(items_, tabs_, true);
+    int cached_tabs = LoadCachedTabs();
+    QLOG_INFO() << "Loaded" << items_.size() << "items from the local snapshot (" << snapshot_items << "items) and"
+                << cached_tabs << "cached tabs in" << timer.elapsed() << "ms";
+    PublishItems(true);
+}
+
+int ItemsManagerWorker::LoadCachedTabs() {
+    // The snapshot is only saved once an update completes, while tabs are
+    // cached as they arrive, so after an interrupted update the cache is newer.
+    // Tabs cached before the snapshot was saved are already in it.
+    bool ok;
+    qint64 snapshot_time = QString::fromStdString(data_.Get(kSnapshotTime, "0")).toLongLong(&ok);
+    if (!ok) {
+        QLOG_WARN() << "Malformed snapshot time, overlaying all cached tabs";
+        snapshot_time = 0;
+    }
+    std::set<int> loaded;
+    Items cached;
+    for (auto &tab : tabs_) {
+        int index = tab.get_tab_id();
+        QUrl url = MakeTabUrl(index, true);
+        QDateTime stored = tab_cache_->stored(url);
+        if (!stored.isValid() || stored.toMSecsSinceEpoch() <= snapshot_time)
+            continue;
+        std::unique_ptr<QIODevice> device(tab_cache_->data(url));
+        if (!device)
+            continue;
+        QByteArray bytes = device->readAll();
+        rapidjson::Document doc;
+        doc.Parse(bytes.constData());
+        if (!doc.IsObject() || doc.HasMember("error") || !doc.HasMember("items") || !doc["items"].IsArray()
+                || !doc.HasMember("tabs") || !doc["tabs"].IsArray())
+            continue;
+        // only trust it if the tab is still named and placed the same
+        auto &cached_tabs = doc["tabs"];
+        if (index < 0 || static_cast<rapidjson::SizeType>(index) >= cached_tabs.Size()
+                || static_cast<size_t>(index) >= tabs_signature_.size()
+                || !cached_tabs[index].IsObject() || TabSignature(cached_tabs[index]) != tabs_signature_[index])
+            continue;
+        items_.swap(cached);
+        ParseItems(&doc["items"], tab, doc.GetAllocator());
+        items_.swap(cached);
+        loaded.insert(index);
+    }
+    if (loaded.empty())
+        return 0;
+
+    items_.erase(std::remove_if(items_.begin(), items_.end(), [&loaded](const std::shared_ptr<Item> &item) {
+        return item->location().get_type() == ItemLocationType::STASH && loaded.count(item->location().get_tab_id());
+    }), items_.end());
+    items_.insert(items_.end(), cached.begin(), cached.end());
+    SortItems();
+    return loaded.size();
+}
+
+void ItemsManagerWorker::SortItems() {
+    std::sort(begin(items_), end(items_), [](const std::shared_ptr<Item> &a, const std::shared_ptr<Item> &b){
+        return *a < *b;
+    });
 }
 
 void ItemsManagerWorker::Update(TabSelection::Type type, const std::vector<ItemLocation> &locations) {
@@ -133,6 +211,15 @@ void ItemsManagerWorker::Update(TabSelection::Type type, const std::vector<ItemL
     queue_id_ = 0;
     replies_.clear();
     items_.clear();
+    arena_ = std::make_shared<ItemArena>();
+    reusable_.clear();
+    if (reused_generations_ < kMaxReusedGenerations) {
+        for (auto &item : previous_items_)
+            reusable_.emplace(std::hash<std::string>()(item->json()), item);
+        ++reused_generations_;
+    } else {
+        reused_generations_ = 0;
+    }
     tabs_as_string_ = "";
     selected_character_ = "";
 
@@ -241,7 +328,7 @@ void ItemsManagerWorker::OnCharacterListReceived() {
     reply->deleteLater();
 }
 
-QNetworkRequest ItemsManagerWorker::MakeTabRequest(int tab_index, const ItemLocation &location, bool tabs, bool refresh) {
+QUrl ItemsManagerWorker::MakeTabUrl(int tab_index, bool tabs) const {
     QUrlQuery query;
     query.addQueryItem("league", league_.c_str());
     query.addQueryItem("tabs", tabs ? "1" : "0");
@@ -250,6 +337,11 @@ QNetworkRequest ItemsManagerWorker::MakeTabRequest(int tab_index, const ItemLoca
 
     QUrl url(kStashItemsUrl);
     url.setQuery(query);
+    return url;
+}
+
+QNetworkRequest ItemsManagerWorker::MakeTabRequest(int tab_index, const ItemLocation &location, bool tabs, bool refresh) {
+    QUrl url = MakeTabUrl(tab_index, tabs);
 
     // If refresh is explicity request then force unconditionally
     TabCache::Flags flags = (refresh) ? TabCache::Refresh : TabCache::None;
@@ -397,13 +489,50 @@ void ItemsManagerWorker::ParseItems(rapidjson::Value *value_ptr, const ItemLocat
         ItemLocation location(base_location);
         location.FromItemJson(item);
         location.ToItemJson(&item, alloc);
-        items_.push_back(std::make_shared<Item>(item));
+        items_.push_back(ReuseOrMakeItem(item));
         location.set_socketed(true);
         if (item.HasMember("socketedItems") && item["socketedItems"].IsArray())
             ParseItems(&item["socketedItems"], location, alloc);
     }
 }
 
+std::shared_ptr<Item> ItemsManagerWorker::ReuseOrMakeItem(const rapidjson::Value &json) {
+    // serialized once, for the lookup and the new item
+    std::string serialized = Util::RapidjsonSerialize(json);
+    if (!reusable_.empty()) {
+        auto range = reusable_.equal_range(std::hash<std::string>()(serialized));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->json() == serialized) {
+                auto item = it->second;
+                // each previous item may only be reused once
+                reusable_.erase(it);
+                return item;
+            }
+        }
+    }
+    return arena_->MakeItem(json, std::move(serialized));
+}
+
+void ItemsManagerWorker::PublishItems(bool initial_refresh) {
+    ItemChangeSet changes = ItemChangeSet::Diff(previous_items_, items_);
+    QLOG_DEBUG() << "Items changed since last refresh:" << changes.added.size() << "added,"
+                 << changes.removed.size() << "removed," << changes.changed.size() << "changed,"
+                 << changes.moved.size() << "moved";
+    auto &cache = tab_cache_->stats();
+    QLOG_DEBUG() << "Tab cache:" << cache.hits << "hits," << cache.misses << "misses," << cache.bytes_read / 1024 << "kB read,"
+                 << cache.deduplicated << "of" << cache.inserts << "inserts deduplicated," << cache.bytes_written / 1024
+                 << "kB written," << tab_cache_->cacheSize() / 1024 << "kB stored," << cache.evictions << "evictions,"
+                 << cache.corrupt << "damaged";
+    // the index is written once per refresh rather than on every insert
+    tab_cache_->Sync();
+    emit ItemsRefreshed(items_, tabs_, initial_refresh, changes);
+
+    previous_items_ = items_;
+    reusable_.clear();
+    items_.clear();
+    arena_.reset();
+}
+
 void ItemsManagerWorker::OnTabReceived(int request_id) {
     if (!replies_.count(request_id)) {
         QLOG_WARN() << "Received a reply for request" << request_id << "that was not requested.";
@@ -537,9 +666,7 @@ void ItemsManagerWorker::OnTabReceived(int request_id) {
         // changed.  So sort items_ here before emitting and then generate
         // item list as strings.
 
-        std::sort(begin(items_), end(items_), [](const std::shared_ptr<Item> &a, const std::shared_ptr<Item> &b){
-            return *a < *b;
-        });
+        SortItems();
 
         QStringList tmp;
         for (auto const &item: items_) {
@@ -547,12 +674,19 @@ void ItemsManagerWorker::OnTabReceived(int request_id) {
         }
         auto items_as_string = std::string("[") + tmp.join(",").toStdString() + "]";
 
+        QLOG_DEBUG() << "Item arena holds" << arena_->size() << "new items in" << arena_->chunk_count()
+                     << "chunks," << arena_->reserved_bytes() << "bytes, reused"
+                     << items_.size() - arena_->size() << "items";
+
         // all requests completed
-        emit ItemsRefreshed(items_, tabs_, false);
+        PublishItems(false);
 
         // DataStore is thread safe so it's ok to call it here
+        data_.BeginBatch();
         data_.Set("items", items_as_string);
         data_.Set("tabs", tabs_as_string_);
+        data_.Set(kSnapshotTime, std::to_string(QDateTime::currentMSecsSinceEpoch()));
+        data_.Commit();
 
         updating_ = false;
         QLOG_DEBUG() << "Finished updating stash.";
@@ -582,11 +716,8 @@ std::vector<std::pair<std::string, std::string> > ItemsManagerWorker::CreateTabs
         QLOG_ERROR() << "Malformed tabs data:" << tabs.c_str() << "The error was"
             << rapidjson::GetParseError_En(doc.GetParseError());
     } else {
-        for (auto &tab : doc) {
-            std::string name = (tab.HasMember("n") && tab["n"].IsString()) ? tab["n"].GetString(): "UNKNOWN_NAME";
-            std::string uid = (tab.HasMember("id") && tab["id"].IsString()) ? tab["id"].GetString(): "UNKNOWN_ID";
-            tmp.emplace_back(name,uid);
-        }
+        for (auto &tab : doc)
+            tmp.push_back(TabSignature(tab));
     }
     return tmp;
 }
@@ -20,12 +20,15 @@
 #pragma once
 
 #include <queue>
+#include <unordered_map>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QObject>
 
 #include "util.h"
 #include "item.h"
+#include "itemarena.h"
+#include "itemchangeset.h"
 #include "mainwindow.h"
 
 class Application;
@@ -39,6 +42,9 @@ class TabCache;
 const int kThrottleRequests = 45;
 const int kThrottleSleep = 60;
 const int kMaxCacheSize = (1000*1024*1024); // 1GB
+// Reused items keep the arena of the refresh that created them alive, so after
+// this many refreshes in a row everything is parsed into a fresh arena again.
+const int kMaxReusedGenerations = 8;
 
 struct ItemsRequest {
     int id;
@@ -72,14 +78,21 @@ public slots:
     void FetchItems(int limit = kThrottleRequests);
     void PreserveSelectedCharacter();
 signals:
-    void ItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh);
+    void ItemsRefreshed(const Items &items, const std::vector<ItemLocation> &tabs, bool initial_refresh, const ItemChangeSet &changes);
     void StatusUpdate(const CurrentStatusUpdate &status);
 private:
 
+    QUrl MakeTabUrl(int tab_index, bool tabs) const;
     QNetworkRequest MakeTabRequest(int tab_index, const ItemLocation &location, bool tabs = false, bool refresh = false);
     QNetworkRequest MakeCharacterRequest(const std::string &name, const ItemLocation &location);
     void QueueRequest(const QNetworkRequest &request, const ItemLocation &location);
     void ParseItems(rapidjson::Value *value_ptr, const ItemLocation &base_location, rapidjson_allocator &alloc);
+    // Returns the Item from the previous refresh if its json is unchanged, otherwise creates a new one.
+    std::shared_ptr<Item> ReuseOrMakeItem(const rapidjson::Value &json);
+    // Replaces the snapshot items of the tabs the tab cache has a valid body for, returns how many
+    int LoadCachedTabs();
+    void SortItems();
+    void PublishItems(bool initial_refresh);
     std::vector<std::pair<std::string, std::string> > CreateTabsSignatureVector(std::string tabs);
 
     QNetworkRequest Request(QUrl url, const ItemLocation &location, TabCache::Flags flags = TabCache::None);
@@ -93,6 +106,13 @@ private:
     std::vector<std::pair<std::string, std::string> > tabs_signature_;
     bool cancel_update_{false};
     Items items_;
+    // backing storage for items_ of the refresh in progress
+    std::shared_ptr<ItemArena> arena_;
+    // items of the last completed refresh, and those of them not yet reused
+    // by the refresh in progress keyed by std::hash of their json
+    Items previous_items_;
+    std::unordered_multimap<size_t, std::shared_ptr<Item>> reusable_;
+    int reused_generations_{0};
     int total_completed_, total_needed_, total_cached_;
     int requests_completed_, requests_needed_;
     int cached_requests_completed_{0};
@@ -0,0 +1,45 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemstore.h"
+
+void ItemStore::Reset(const Items &items) {
+    items_ = items;
+    ++generation_;
+    locations_.clear();
+    for (ItemId id = 0; id < items_.size(); ++id)
+        locations_[items_[id]->location()].Add(id);
+}
+
+ItemHandle ItemStore::handle(ItemId id) const {
+    ItemHandle handle;
+    handle.id = id;
+    handle.generation = generation_;
+    return handle;
+}
+
+bool ItemStore::IsValid(const ItemHandle &handle) const {
+    return handle.generation == generation_ && handle.generation != 0 && handle.id < items_.size();
+}
+
+Item *ItemStore::Get(const ItemHandle &handle) const {
+    if (!IsValid(handle))
+        return nullptr;
+    return items_[handle.id].get();
+}
@@ -0,0 +1,64 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include "item.h"
+#include "itembitmap.h"
+#include "itemlocation.h"
+
+/*
+ * ItemStore holds the current generation of items and addresses them by dense
+ * 32-bit ids (their position in items()).  Searches keep their results as
+ * ItemBitmaps over these ids and derive per-tab buckets by intersecting with
+ * the location bitmaps kept here, so only one copy of the item pointers exists
+ * no matter how many search tabs are open.
+ *
+ * Every Reset starts a new generation.  Code that has to hold on to an item
+ * across refreshes should keep an ItemHandle instead of an id or a pointer:
+ * a handle from a previous generation no longer resolves, so it can neither
+ * point at a different item that reused the id nor keep the old items alive.
+ */
+struct ItemHandle {
+    ItemId id{0};
+    uint32_t generation{0};
+};
+
+class ItemStore {
+public:
+    void Reset(const Items &items);
+    const Items &items() const { return items_; }
+    size_t size() const { return items_.size(); }
+    const std::shared_ptr<Item> &item(ItemId id) const { return items_[id]; }
+    const std::map<ItemLocation, ItemBitmap> &locations() const { return locations_; }
+    uint32_t generation() const { return generation_; }
+    ItemHandle handle(ItemId id) const;
+    bool IsValid(const ItemHandle &handle) const;
+    // returns nullptr if the handle is from another generation
+    Item *Get(const ItemHandle &handle) const;
+private:
+    Items items_;
+    // 0 is never used so that a default constructed handle is always invalid
+    uint32_t generation_{0};
+    std::map<ItemLocation, ItemBitmap> locations_;
+};
@@ -60,6 +60,7 @@ static const int HEADER_DOUBLELINE_HEIGHT = 54;
 static const QSize HEADER_SINGLELINE_SIZE(HEADER_SINGLELINE_WIDTH, HEADER_SINGLELINE_HEIGHT);
 static const QSize HEADER_DOUBLELINE_SIZE(HEADER_DOUBLELINE_WIDTH, HEADER_DOUBLELINE_HEIGHT);
 static const QSize HEADER_OVERLAY_SIZE(27, 27);
+static const std::string POE_WEBCDN = "http://webcdn.pathofexile.com"; // Should be updated to https://web.poecdn.com ?
 
 /*
     PoE colors:
@@ -261,14 +262,30 @@ void GenerateItemHeaderSide(QLabel *itemHeader, bool leftNotRight, std::string h
     itemHeader->setPixmap(header_pixmap);
 }
 
+ItemTooltipText GenerateItemTooltipText(const Item &item) {
+    size_t frame = item.frameType();
+    if (frame >= FrameToKey.size())
+        frame = 0;
+    std::string key = FrameToKey[frame];
+
+    ItemTooltipText text;
+    text.properties = GenerateItemInfo(item, key, true);
+    text.text = GenerateItemInfo(item, key, false);
+    return text;
+}
+
 void UpdateItemTooltip(const Item &item, Ui::MainWindow *ui) {
+    UpdateItemTooltip(item, GenerateItemTooltipText(item), ui);
+}
+
+void UpdateItemTooltip(const Item &item, const ItemTooltipText &text, Ui::MainWindow *ui) {
     size_t frame = item.frameType();
     if (frame >= FrameToKey.size())
         frame = 0;
     std::string key = FrameToKey[frame];
 
-    ui->propertiesLabel->setText(GenerateItemInfo(item, key, true).c_str());
-    ui->itemTextTooltip->setText(GenerateItemInfo(item, key, false).c_str());
+    ui->propertiesLabel->setText(text.properties.c_str());
+    ui->itemTextTooltip->setText(text.text.c_str());
     UpdateMinimap(item, ui);
 
     bool singleline = item.name().empty();
@@ -298,8 +315,8 @@ void UpdateItemTooltip(const Item &item, Ui::MainWindow *ui) {
     ui->itemNameSecondLine->setStyleSheet(css.c_str());
 }
 
-QPixmap GenerateItemSockets(const int width, const int height, const std::vector<ItemSocket> &sockets) {
-    QPixmap pixmap(width * PIXELS_PER_SLOT, height * PIXELS_PER_SLOT);  // This will ensure we have enough room to draw the slots
+QImage GenerateItemSockets(const int width, const int height, const std::vector<ItemSocket> &sockets) {
+    QImage pixmap(width * PIXELS_PER_SLOT, height * PIXELS_PER_SLOT, QImage::Format_ARGB32_Premultiplied);  // This will ensure we have enough room to draw the slots
     pixmap.fill(Qt::transparent);
     QPainter painter(&pixmap);
 
@@ -376,11 +393,11 @@ QPixmap GenerateItemSockets(const int width, const int height, const std::vector
                                             PIXELS_PER_SLOT * socket_rows);
 }
 
-QPixmap GenerateItemIcon(const Item &item, const QImage &image) {
+QImage GenerateItemIcon(const Item &item, const QImage &image) {
     const int height = item.h();
     const int width = item.w();
 
-    QPixmap layered(image.width(), image.height());
+    QImage layered(image.width(), image.height(), QImage::Format_ARGB32_Premultiplied);
     layered.fill(Qt::transparent);
     QPainter layered_painter(&layered);
 
@@ -432,11 +449,19 @@ QPixmap GenerateItemIcon(const Item &item, const QImage &image) {
     layered_painter.drawImage(0, 0, image);
 
     if (item.text_sockets().size() > 0) {
-        QPixmap sockets = GenerateItemSockets(width, height, item.text_sockets());
+        QImage sockets = GenerateItemSockets(width, height, item.text_sockets());
 
-        layered_painter.drawPixmap((int)(0.5*(image.width() - sockets.width())),
+        layered_painter.drawImage((int)(0.5*(image.width() - sockets.width())),
                        (int)(0.5*(image.height() - sockets.height())), sockets);    // Center sockets on overall image
     }
 
+    layered_painter.end();
     return layered;
 }
+
+std::string ItemIconUrl(const Item &item) {
+    std::string icon = item.icon();
+    if (icon.size() && icon[0] == '/')
+        icon = POE_WEBCDN + icon;
+    return icon;
+}
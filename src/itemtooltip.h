@@ -24,5 +24,16 @@
 #include "item.h"
 #include "ui_mainwindow.h"
 
+// The tooltip HTML of an item, which needs no widgets and can be generated
+// before the item is shown
+struct ItemTooltipText {
+    std::string properties;
+    std::string text;
+};
+
+ItemTooltipText GenerateItemTooltipText(const Item &item);
+void UpdateItemTooltip(const Item &item, const ItemTooltipText &text, Ui::MainWindow *ui);
 void UpdateItemTooltip(const Item &item, Ui::MainWindow *ui);
-QPixmap GenerateItemIcon(const Item &item, const QImage &image);
+std::string ItemIconUrl(const Item &item);
+// Safe to call off the GUI thread
+QImage GenerateItemIcon(const Item &item, const QImage &image);
@@ -22,9 +22,9 @@
 
 #include <fstream>
 #include <iostream>
+#include <set>
 #include <vector>
 #include <QEvent>
-#include <QImageReader>
 #include <QInputDialog>
 #include <QMouseEvent>
 #include <QNetworkAccessManager>
@@ -33,6 +33,7 @@
 #include <QPainter>
 #include <QPushButton>
 #include <QScrollArea>
+#include <QShortcut>
 #include <QStringList>
 #include <QTabBar>
 #include <QStringListModel>
@@ -52,6 +53,8 @@
 #include "itemsmanager.h"
 #include "logpanel.h"
 #include "modsfilter.h"
+#include "prefetcher.h"
+#include "rendercache.h"
 #include "replytimeout.h"
 #include "search.h"
 #include "selfdestructingreply.h"
@@ -59,8 +62,6 @@
 #include "util.h"
 #include "verticalscrollarea.h"
 
-const std::string POE_WEBCDN = "http://webcdn.pathofexile.com"; // Should be updated to https://web.poecdn.com ?
-
 MainWindow::MainWindow(std::unique_ptr<Application> app):
     app_(std::move(app)),
     ui(new Ui::MainWindow),
@@ -77,17 +78,21 @@ MainWindow::MainWindow(std::unique_ptr<Application> app):
     setWindowIcon(QIcon(":/icons/assets/icon.svg"));
 #endif
 
-    image_cache_ = new ImageCache(Filesystem::UserDir() + "/cache");
+    image_cache_ = new ImageCache(Filesystem::UserDir() + "/cache", kImageCacheMemoryBudget, this);
+    connect(image_cache_, &ImageCache::ImageReady, this, &MainWindow::OnImageReady);
+
+    render_cache_ = new RenderCache(kRenderCacheSize, this);
 
     InitializeUi();
+    prefetcher_ = new Prefetcher(ui->treeView, image_cache_, render_cache_, [this](const QModelIndex &index) -> std::shared_ptr<Item> {
+        if (!index.parent().isValid())
+            return std::shared_ptr<Item>();
+        return current_search_->bucket(index.parent().row())->item(index.row());
+    }, this);
     InitializeLogging();
     InitializeSearchForm();
     NewSearch();
 
-    image_network_manager_ = new QNetworkAccessManager;
-    connect(image_network_manager_, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(OnImageFetched(QNetworkReply*)));
-
     connect(&app_->items_manager(), &ItemsManager::ItemsRefreshed, this, &MainWindow::OnItemsRefreshed);
     connect(&app_->items_manager(), &ItemsManager::StatusUpdate, this, &MainWindow::OnStatusUpdate);
     connect(&app_->shop(), &Shop::StatusUpdate, this, &MainWindow::OnStatusUpdate);
@@ -103,6 +108,12 @@ MainWindow::MainWindow(std::unique_ptr<Application> app):
             OnTreeChange(idx, idx);
     });
 
+    // Undo/redo buyouts set through the buyout widgets
+    auto undo = new QShortcut(QKeySequence::Undo, ui->treeView, nullptr, nullptr, Qt::WidgetWithChildrenShortcut);
+    connect(undo, &QShortcut::activated, [&]() { ApplyBuyoutHistory(false); });
+    auto redo = new QShortcut(QKeySequence::Redo, ui->treeView, nullptr, nullptr, Qt::WidgetWithChildrenShortcut);
+    connect(redo, &QShortcut::activated, [&]() { ApplyBuyoutHistory(true); });
+
 }
 
 void MainWindow::InitializeLogging() {
@@ -342,6 +353,11 @@ void MainWindow::OnBuyoutChange() {
         return;
 
     BuyoutManager &bo_manager = app_->buyout_manager();
+    // locations whose buyouts have to be propagated and displayed again
+    std::set<ItemLocation> locations;
+    std::set<std::string> tabs;
+    // everything set here is undone at once
+    bo_manager.BeginUserEdit();
     for (auto const &index: ui->treeView->selectionModel()->selectedIndexes()) {    
         auto const &tab = current_search_->GetTabLocation(index).GetUniqueHash();
 
@@ -350,20 +366,41 @@ void MainWindow::OnBuyoutChange() {
             continue;
         if (!index.parent().isValid()) {
             bo_manager.SetTab(tab, bo);
+            tabs.insert(tab);
         } else {
             auto &item = current_search_->bucket(index.parent().row())->item(index.row());
             // Don't allow users to manually update locked items (game priced per item in note section)
             if (bo_manager.Get(*item).IsGameSet())
                 continue;
             bo_manager.Set(*item, bo);
+            locations.insert(item->location());
         }
     }
-    app_->items_manager().PropagateTabBuyouts();
+    bo_manager.EndUserEdit();
+    // tab buyouts are keyed by name, so they apply to every tab with that name
+    if (!tabs.empty()) {
+        for (auto const &location : app_->items_manager().store().locations())
+            if (tabs.count(location.first.GetUniqueHash()))
+                locations.insert(location.first);
+    }
+    app_->items_manager().PropagateTabBuyouts(locations);
+    app_->items_manager().StoreItemPrices(locations);
     // refresh treeView to immediately reflect price changes
-    ui->treeView->model()->layoutChanged();
+    current_search_->model()->RefreshLocations(app_->items_manager().store(), locations);
     ResizeTreeColumns();
 }
 
+void MainWindow::ApplyBuyoutHistory(bool redo) {
+    BuyoutManager &bo_manager = app_->buyout_manager();
+    if (!(redo ? bo_manager.Redo() : bo_manager.Undo()))
+        return;
+    app_->shop().ExpireShopData();
+    app_->items_manager().PropagateTabBuyouts();
+    app_->items_manager().StoreItemPrices();
+    ui->treeView->model()->layoutChanged();
+    UpdateCurrentBuyout();
+}
+
 void MainWindow::OnStatusUpdate(const CurrentStatusUpdate &status) {
     QString title;
     bool need_progress = false;
@@ -446,19 +483,9 @@ bool MainWindow::eventFilter(QObject *o, QEvent *e) {
     return QMainWindow::eventFilter(o, e);
 }
 
-void MainWindow::OnImageFetched(QNetworkReply *reply) {
-    std::string url = reply->url().toString().toStdString();
-    if (reply->error()) {
-        QLOG_WARN() << "Failed to download item image," << url.c_str();
-        return;
-    }
-    QImageReader image_reader(reply);
-    QImage image = image_reader.read();
-
-    image_cache_->Set(url, image);
-
-    if (current_item_ && (url == current_item_->icon() || url == POE_WEBCDN + current_item_->icon()))
-        ui->imageLabel->setPixmap(GenerateItemIcon(*current_item_, image));
+void MainWindow::OnImageReady(const std::string &url, const QImage &image) {
+    if (current_item_ && url == ItemIconUrl(*current_item_))
+        UpdateItemIcon(image);
 }
 
 void MainWindow::SetCurrentSearch(Search *search) {
@@ -472,7 +499,7 @@ void MainWindow::OnSearchFormChange() {
 }
 
 void MainWindow::ModelViewRefresh() {
-    app_->buyout_manager().Save();
+    app_->buyout_manager().ScheduleSave();
 
     // Save view properties if no search fields are populated
     // AND we're viewing in Tab mode
@@ -482,12 +509,13 @@ void MainWindow::ModelViewRefresh() {
 
     previous_search_ = current_search_;
 
-    current_search_->Activate(app_->items_manager().items());
+    current_search_->Activate(app_->items_manager().store());
 
     ui->viewComboBox->setCurrentIndex(static_cast<int>(current_search_->GetViewMode()));
 
     connect(ui->treeView->selectionModel(), SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)),
             this, SLOT(OnTreeChange(const QModelIndex&, const QModelIndex&)));
+    prefetcher_->Attach();
 
     ui->treeView->reset();
     if (current_search_->IsAnyFilterActive() || current_search_->GetViewMode() == Search::ByItem) {
@@ -509,7 +537,7 @@ void MainWindow::OnDelayedSearchFormChange() {
 }
 
 void MainWindow::OnTreeChange(const QModelIndex &current, const QModelIndex & /* previous */) {
-    app_->buyout_manager().Save();
+    app_->buyout_manager().ScheduleSave();
 
     if (!current.parent().isValid()) {
         // clicked on a bucket
@@ -656,21 +684,33 @@ void MainWindow::UpdateCurrentItem() {
 
     // Everything except item image now lives in itemtooltip.cpp
     // in future should move everything tooltip-related there
-    UpdateItemTooltip(*current_item_, ui);
+    const ItemTooltipText *tooltip = render_cache_->Tooltip(*current_item_);
+    if (tooltip) {
+        UpdateItemTooltip(*current_item_, *tooltip, ui);
+    } else {
+        ItemTooltipText text = GenerateItemTooltipText(*current_item_);
+        render_cache_->Insert(*current_item_, text);
+        UpdateItemTooltip(*current_item_, text, ui);
+    }
 
     ui->pobTooltipButton->setEnabled(current_item_->Wearable());
 
-    std::string icon = current_item_->icon();
-    if (icon.size() && icon[0] == '/')
-        icon = POE_WEBCDN + icon;
-    if (!image_cache_->Exists(icon))
-        image_network_manager_->get(QNetworkRequest(QUrl(icon.c_str())));
-    else
-        ui->imageLabel->setPixmap(GenerateItemIcon(*current_item_, image_cache_->Get(icon)));
+    QPixmap icon;
+    QImage image;
+    if (render_cache_->Icon(*current_item_, &icon))
+        ui->imageLabel->setPixmap(icon);
+    else if (image_cache_->Request(ItemIconUrl(*current_item_), &image))
+        UpdateItemIcon(image);
 
     ui->locationLabel->setText(current_item_->location().GetHeader().c_str());
 }
 
+void MainWindow::UpdateItemIcon(const QImage &image) {
+    QPixmap icon = QPixmap::fromImage(GenerateItemIcon(*current_item_, image));
+    render_cache_->Insert(*current_item_, icon);
+    ui->imageLabel->setPixmap(icon);
+}
+
 void MainWindow::UpdateBuyoutWidgets(const Buyout &bo) {
     ui->buyoutTypeComboBox->setCurrentIndex(bo.type);
     ui->buyoutTypeComboBox->setEnabled(!bo.IsGameSet());
@@ -704,7 +744,7 @@ void MainWindow::OnItemsRefreshed() {
         search->SetRefreshReason(RefreshReason::ItemsChanged);
         // Don't update current search - it will be updated in OnSearchFormChange
         if (search != current_search_) {
-            search->FilterItems(app_->items_manager().items());
+            search->FilterItems(app_->items_manager().store());
             tab_bar_->setTabText(tab, search->GetCaption());
         }
         tab++;
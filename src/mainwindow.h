@@ -48,6 +48,8 @@ class Column;
 class Filter;
 class FlowLayout;
 class ImageCache;
+class Prefetcher;
+class RenderCache;
 class Search;
 class QStringListModel;
 
@@ -89,7 +91,7 @@ public slots:
     void OnSearchFormChange();
     void OnDelayedSearchFormChange();
     void OnTabChange(int index);
-    void OnImageFetched(QNetworkReply *reply);
+    void OnImageReady(const std::string &url, const QImage &image);
     void OnItemsRefreshed();
     void OnStatusUpdate(const CurrentStatusUpdate &status);
     void OnBuyoutChange();
@@ -128,7 +130,9 @@ private:
     void ModelViewRefresh();
     void UpdateCurrentBucket();
     void UpdateCurrentItem();
+    void UpdateItemIcon(const QImage &image);
     void UpdateCurrentBuyout();
+    void ApplyBuyoutHistory(bool redo);
     void NewSearch();
     void SetCurrentSearch(Search *search);
     void InitializeLogging();
@@ -153,8 +157,9 @@ private:
     QTabBar *tab_bar_;
     std::vector<std::unique_ptr<Filter>> filters_;
     int search_count_;
-    QNetworkAccessManager *image_network_manager_;
     ImageCache *image_cache_;
+    RenderCache *render_cache_;
+    Prefetcher *prefetcher_;
     QLabel *status_bar_label_;
     QVBoxLayout *search_form_layout_;
     QMenu context_menu_;
@@ -19,6 +19,9 @@
 
 #include "memorydatastore.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "currencymanager.h"
 
 std::string MemoryDataStore::Get(const std::string &key, const std::string &default_value) {
@@ -32,14 +35,39 @@ void MemoryDataStore::Set(const std::string &key, const std::string &value) {
     data_[key] = value;
 }
 
-void MemoryDataStore::InsertCurrencyUpdate(const CurrencyUpdate &update) {
-    currency_updates_.push_back(update);
-}
-
 std::vector<CurrencyUpdate> MemoryDataStore::GetAllCurrency() {
     return currency_updates_;
 }
 
+void MemoryDataStore::InsertCurrencySamples(const std::vector<CurrencySample> &samples) {
+    for (auto &sample : samples)
+        currency_samples_[std::make_pair(sample.timestamp, sample.currency)] = sample;
+}
+
+void MemoryDataStore::ForEachCurrencySample(long long from, long long to,
+                                            const std::function<bool(const CurrencySample&)> &callback) {
+    auto end = currency_samples_.lower_bound(std::make_pair(to, std::numeric_limits<int>::min()));
+    for (auto it = currency_samples_.lower_bound(std::make_pair(from, std::numeric_limits<int>::min())); it != end; ++it)
+        if (!callback(it->second))
+            return;
+}
+
+void MemoryDataStore::DownsampleCurrency(long long before, long long interval) {
+    if (interval <= 0)
+        return;
+    // the last timestamp of every interval
+    std::map<long long, long long> kept;
+    for (auto &sample : currency_samples_)
+        if (sample.first.first < before)
+            kept[sample.first.first / interval] = sample.first.first;
+    for (auto it = currency_samples_.begin(); it != currency_samples_.end() && it->first.first < before;) {
+        if (kept[it->first.first / interval] != it->first.first)
+            it = currency_samples_.erase(it);
+        else
+            ++it;
+    }
+}
+
 void MemoryDataStore::SetBool(const std::string &key, bool value) {
     SetInt(key, static_cast<int>(value));
 }
@@ -55,3 +83,64 @@ void MemoryDataStore::SetInt(const std::string &key, int value) {
 int MemoryDataStore::GetInt(const std::string &key, int default_value) {
     return std::stoi(Get(key, std::to_string(default_value)));
 }
+
+DataRows MemoryDataStore::GetRows(const std::string &collection) {
+    auto i = rows_.find(collection);
+    if (i == rows_.end())
+        return DataRows();
+    return i->second;
+}
+
+void MemoryDataStore::UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed) {
+    auto &rows = rows_[collection];
+    for (auto &row : changed)
+        rows[row.first] = row.second;
+    for (auto &key : removed)
+        rows.erase(key);
+}
+
+void MemoryDataStore::BeginBatch() {
+}
+
+void MemoryDataStore::Commit() {
+}
+
+void MemoryDataStore::ReplaceItems(const std::vector<ItemRecord> &items) {
+    items_ = items;
+}
+
+void MemoryDataStore::UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed) {
+    EraseItemRecords(&items_, removed);
+    items_.insert(items_.end(), added.begin(), added.end());
+}
+
+void MemoryDataStore::UpdateItemPrices(const std::map<std::string, ItemPrice> &prices) {
+    for (auto &item : items_) {
+        auto it = prices.find(item.uid);
+        if (it != prices.end())
+            item.price = it->second;
+    }
+}
+
+std::vector<ItemRecord> MemoryDataStore::GetItemsByHash(const std::string &hash) {
+    std::vector<ItemRecord> result;
+    for (auto &item : items_)
+        if (item.hash == hash)
+            result.push_back(item);
+    return result;
+}
+
+std::map<std::string, int> MemoryDataStore::CountItemsByTab() {
+    std::map<std::string, int> result;
+    for (auto &item : items_)
+        ++result[item.tab];
+    return result;
+}
+
+std::map<std::string, double> MemoryDataStore::PriceTotals(const std::string &tab) {
+    std::map<std::string, double> result;
+    for (auto &item : items_)
+        if (!item.price.currency.empty() && (tab.empty() || item.tab == tab))
+            result[item.price.currency] += item.price.value;
+    return result;
+}
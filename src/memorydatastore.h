@@ -29,13 +29,29 @@ class MemoryDataStore : public DataStore {
 public:
     void Set(const std::string &key, const std::string &value);
     std::string Get(const std::string &key, const std::string &default_value = "");
-    void InsertCurrencyUpdate(const CurrencyUpdate &update);
     std::vector<CurrencyUpdate> GetAllCurrency();
+    void InsertCurrencySamples(const std::vector<CurrencySample> &samples);
+    void ForEachCurrencySample(long long from, long long to, const std::function<bool(const CurrencySample&)> &callback);
+    void DownsampleCurrency(long long before, long long interval);
     void SetBool(const std::string &key, bool value);
     bool GetBool(const std::string &key, bool default_value = false);
     void SetInt(const std::string &key, int value);
     int GetInt(const std::string &key, int default_value = 0);
+    DataRows GetRows(const std::string &collection);
+    void UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed);
+    void BeginBatch();
+    void Commit();
+    void ReplaceItems(const std::vector<ItemRecord> &items);
+    void UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed);
+    void UpdateItemPrices(const std::map<std::string, ItemPrice> &prices);
+    std::vector<ItemRecord> GetItemsByHash(const std::string &hash);
+    std::map<std::string, int> CountItemsByTab();
+    std::map<std::string, double> PriceTotals(const std::string &tab = "");
 private:
     std::map<std::string, std::string> data_;
     std::vector<CurrencyUpdate> currency_updates_;
+    // ordered by timestamp and currency
+    std::map<std::pair<long long, int>, CurrencySample> currency_samples_;
+    std::map<std::string, DataRows> rows_;
+    std::vector<ItemRecord> items_;
 };
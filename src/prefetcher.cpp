@@ -0,0 +1,140 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "prefetcher.h"
+
+#include <QScrollBar>
+#include <QTreeView>
+
+#include "imagecache.h"
+#include "item.h"
+#include "itemtooltip.h"
+#include "rendercache.h"
+
+namespace {
+
+// Time to wait for the selection or view to settle before a pass
+const int kPrefetchDelayMs = 30;
+
+}
+
+Prefetcher::Prefetcher(QTreeView *view, ImageCache *images, RenderCache *renders,
+                       const std::function<std::shared_ptr<Item>(const QModelIndex&)> &lookup,
+                       QObject *parent):
+    QObject(parent),
+    view_(view),
+    images_(images),
+    renders_(renders),
+    lookup_(lookup)
+{
+    timer_.setSingleShot(true);
+    connect(&timer_, &QTimer::timeout, this, &Prefetcher::Run);
+    connect(view_->verticalScrollBar(), &QScrollBar::valueChanged, this, &Prefetcher::OnScrolled);
+    connect(view_, &QTreeView::expanded, this, &Prefetcher::Schedule);
+    connect(view_, &QTreeView::collapsed, this, &Prefetcher::Schedule);
+    connect(images_, &ImageCache::ImageReady, this, &Prefetcher::OnImageDone);
+    connect(images_, &ImageCache::ImageFailed, this, &Prefetcher::OnImageDone);
+    connect(renders_, &RenderCache::Rendered, this, &Prefetcher::OnRendered);
+}
+
+void Prefetcher::Attach() {
+    connect(view_->selectionModel(), &QItemSelectionModel::currentChanged, this, &Prefetcher::OnCurrentChanged,
+            Qt::UniqueConnection);
+    Schedule();
+}
+
+void Prefetcher::Schedule() {
+    if (!timer_.isActive())
+        timer_.start(kPrefetchDelayMs);
+}
+
+void Prefetcher::OnCurrentChanged(const QModelIndex &current, const QModelIndex &previous) {
+    if (current.isValid() && previous.isValid())
+        direction_ = view_->visualRect(current).top() < view_->visualRect(previous).top() ? -1 : 1;
+    Schedule();
+}
+
+void Prefetcher::OnScrolled(int value) {
+    direction_ = value < scroll_value_ ? -1 : 1;
+    scroll_value_ = value;
+    Schedule();
+}
+
+void Prefetcher::OnImageDone(const std::string &url) {
+    // a slot freed up, the last pass may have left images out
+    if (loading_.erase(url))
+        Schedule();
+}
+
+void Prefetcher::OnRendered() {
+    if (unfinished_)
+        Schedule();
+}
+
+void Prefetcher::Walk(QModelIndex index, int direction, int count, std::vector<QModelIndex> *rows) const {
+    for (int i = 0; i < count; ++i) {
+        index = direction > 0 ? view_->indexBelow(index) : view_->indexAbove(index);
+        if (!index.isValid())
+            break;
+        rows->push_back(index);
+    }
+}
+
+std::vector<std::shared_ptr<Item>> Prefetcher::Plan() const {
+    std::vector<QModelIndex> rows;
+    QModelIndex current = view_->currentIndex();
+    if (current.isValid()) {
+        rows.push_back(current);
+        Walk(current, direction_, kPrefetchAhead, &rows);
+    }
+    int height = view_->viewport()->height();
+    for (QModelIndex index = view_->indexAt(QPoint(0, 0));
+         index.isValid() && view_->visualRect(index).top() < height;
+         index = view_->indexBelow(index))
+        rows.push_back(index);
+    if (current.isValid())
+        Walk(current, -direction_, kPrefetchBehind, &rows);
+
+    std::vector<std::shared_ptr<Item>> items;
+    std::set<const Item*> seen;
+    for (auto &index : rows) {
+        std::shared_ptr<Item> item = lookup_(index);
+        if (item && seen.insert(item.get()).second)
+            items.push_back(item);
+    }
+    return items;
+}
+
+void Prefetcher::Run() {
+    if (!view_->model() || !view_->selectionModel())
+        return;
+
+    unfinished_ = false;
+    for (auto &item : Plan()) {
+        // the icon is rendered by a later pass if its image isn't loaded yet
+        QImage image;
+        std::string url = ItemIconUrl(*item);
+        if (!url.empty() && !loading_.count(url) && loading_.size() < kPrefetchMaxLoading
+                && !images_->Request(url, &image))
+            loading_.insert(url);
+
+        if (!renders_->Render(item, image))
+            unfinished_ = true;
+    }
+}
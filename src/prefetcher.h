@@ -0,0 +1,84 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QModelIndex>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+class ImageCache;
+class Item;
+class QTreeView;
+class RenderCache;
+
+// Rows prefetched in the direction the selection or view last moved, and the
+// other way
+const int kPrefetchAhead = 10;
+const int kPrefetchBehind = 3;
+// Images loaded at once, so prefetching doesn't compete with the selected item
+const size_t kPrefetchMaxLoading = 6;
+
+/*
+ * Prefetcher loads the icons and renders the icons and tooltips of the items
+ * around the current one and in the viewport of a QTreeView, so that moving
+ * through a tab doesn't wait on the network or rendering for each item.
+ * Rendering happens in the background through RenderCache, which also bounds
+ * how much of it is queued.
+ */
+class Prefetcher : public QObject {
+    Q_OBJECT
+public:
+    // lookup returns the item shown in a row, or null for rows without one
+    Prefetcher(QTreeView *view, ImageCache *images, RenderCache *renders,
+               const std::function<std::shared_ptr<Item>(const QModelIndex&)> &lookup,
+               QObject *parent = nullptr);
+    // Follows the current selection model of the view, must be called after
+    // the view's model is set
+    void Attach();
+public slots:
+    void Schedule();
+private slots:
+    void OnCurrentChanged(const QModelIndex &current, const QModelIndex &previous);
+    void OnScrolled(int value);
+    void OnImageDone(const std::string &url);
+    void OnRendered();
+    void Run();
+private:
+    std::vector<std::shared_ptr<Item>> Plan() const;
+    void Walk(QModelIndex index, int direction, int count, std::vector<QModelIndex> *rows) const;
+
+    QTreeView *view_;
+    ImageCache *images_;
+    RenderCache *renders_;
+    std::function<std::shared_ptr<Item>(const QModelIndex&)> lookup_;
+    // 1 when moving down, -1 when moving up
+    int direction_{1};
+    int scroll_value_{0};
+    // icon urls requested by prefetching that are still loading
+    std::set<std::string> loading_;
+    // the last pass couldn't queue every render
+    bool unfinished_{false};
+    QTimer timer_;
+};
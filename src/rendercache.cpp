@@ -0,0 +1,180 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rendercache.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <functional>
+
+#include "item.h"
+
+namespace {
+
+class RenderTask : public QRunnable {
+public:
+    explicit RenderTask(const std::function<void()> &task) : task_(task) {}
+    void run() { task_(); }
+private:
+    std::function<void()> task_;
+};
+
+// The item hash leaves out crafted and enchanted mods, flags and the icon, all
+// of which show up in the tooltip or the icon
+std::string RenderKey(const Item &item) {
+    std::string key = item.hash() + "~" + item.icon() + "~";
+    key += item.identified() ? "i" : "u";
+    key += item.corrupted() ? "c" : "";
+    key += item.shaper() ? "s" : (item.elder() ? "e" : "");
+    for (auto &mod_type : ITEM_MOD_TYPES)
+        for (auto &mod : item.text_mods().at(mod_type))
+            key += "~" + mod;
+    return key;
+}
+
+}
+
+RenderCache::RenderCache(size_t capacity, QObject *parent):
+    QObject(parent),
+    capacity_(capacity)
+{
+    connect(this, &RenderCache::Finished, this, &RenderCache::OnFinished, Qt::QueuedConnection);
+}
+
+RenderCache::~RenderCache() {
+    // tasks emit signals of this object
+    pool_.waitForDone();
+}
+
+RenderCache::Entry *RenderCache::Find(const std::string &key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+        return nullptr;
+    lru_.splice(lru_.end(), lru_, it->second.lru);
+    return &it->second;
+}
+
+RenderCache::Entry &RenderCache::Get(const std::string &key) {
+    Entry *entry = Find(key);
+    if (entry)
+        return *entry;
+    Entry &created = entries_[key];
+    created.lru = lru_.insert(lru_.end(), key);
+    return created;
+}
+
+void RenderCache::Evict() {
+    while (entries_.size() > capacity_) {
+        entries_.erase(lru_.front());
+        lru_.pop_front();
+        ++stats_.evictions;
+    }
+}
+
+const ItemTooltipText *RenderCache::Tooltip(const Item &item) {
+    Entry *entry = Find(RenderKey(item));
+    if (!entry || !entry->has_tooltip) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    return &entry->tooltip;
+}
+
+bool RenderCache::Icon(const Item &item, QPixmap *icon) {
+    Entry *entry = Find(RenderKey(item));
+    if (!entry || entry->icon.isNull()) {
+        ++stats_.misses;
+        return false;
+    }
+    ++stats_.hits;
+    *icon = entry->icon;
+    return true;
+}
+
+void RenderCache::Insert(const Item &item, const ItemTooltipText &tooltip) {
+    Entry &entry = Get(RenderKey(item));
+    entry.has_tooltip = true;
+    entry.tooltip = tooltip;
+    Evict();
+}
+
+void RenderCache::Insert(const Item &item, const QPixmap &icon) {
+    Get(RenderKey(item)).icon = icon;
+    Evict();
+}
+
+bool RenderCache::Render(const std::shared_ptr<Item> &item, const QImage &image) {
+    std::string key = RenderKey(*item);
+    if (queued_.count(key))
+        return true;
+    auto it = entries_.find(key);
+    bool tooltip = it == entries_.end() || !it->second.has_tooltip;
+    bool icon = !image.isNull() && (it == entries_.end() || it->second.icon.isNull());
+    if (!tooltip && !icon)
+        return true;
+    if (queued_.size() >= kRenderCacheMaxQueued)
+        return false;
+
+    queued_.insert(key);
+    pool_.start(new RenderTask([this, item, image, key, tooltip, icon]() {
+        Result result;
+        result.key = key;
+        result.has_tooltip = tooltip;
+        if (tooltip)
+            result.tooltip = GenerateItemTooltipText(*item);
+        if (icon)
+            result.icon = GenerateItemIcon(*item, image);
+        {
+            QMutexLocker locker(&results_mutex_);
+            results_.push_back(std::move(result));
+        }
+        emit Finished();
+    }));
+    return true;
+}
+
+void RenderCache::OnFinished() {
+    std::vector<Result> results;
+    {
+        QMutexLocker locker(&results_mutex_);
+        results.swap(results_);
+    }
+    if (results.empty())
+        return;
+    for (auto &result : results) {
+        queued_.erase(result.key);
+        Entry &entry = Get(result.key);
+        if (result.has_tooltip) {
+            entry.has_tooltip = true;
+            entry.tooltip = std::move(result.tooltip);
+        }
+        // pixmaps can only be made on the GUI thread
+        if (!result.icon.isNull())
+            entry.icon = QPixmap::fromImage(result.icon);
+        ++stats_.rendered;
+    }
+    Evict();
+    emit Rendered();
+}
+
+void RenderCache::Clear() {
+    entries_.clear();
+    lru_.clear();
+}
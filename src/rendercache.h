@@ -0,0 +1,110 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QPixmap>
+#include <QThreadPool>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "itemtooltip.h"
+
+class Item;
+
+// Items whose rendered tooltip and icon are kept
+const size_t kRenderCacheSize = 512;
+// Background renders queued at once
+const size_t kRenderCacheMaxQueued = 16;
+
+struct RenderCacheStats {
+    size_t hits{0};
+    size_t misses{0};
+    // entries filled by background renders
+    size_t rendered{0};
+    size_t evictions{0};
+};
+
+/*
+ * RenderCache keeps the tooltip HTML and the icon (background, image, sockets
+ * and links composed together) of recently shown items, so that showing an
+ * item again costs nothing.  Entries are keyed by the item hash and whatever
+ * else the rendering depends on, so a changed item is rendered again, and the
+ * least recently used are dropped first.  Render() does the work on a
+ * background thread.
+ */
+class RenderCache : public QObject {
+    Q_OBJECT
+public:
+    explicit RenderCache(size_t capacity = kRenderCacheSize, QObject *parent = nullptr);
+    ~RenderCache();
+    // Returns the tooltip of item, or null if it wasn't rendered
+    const ItemTooltipText *Tooltip(const Item &item);
+    // Sets *icon and returns true if the icon of item was rendered
+    bool Icon(const Item &item, QPixmap *icon);
+    void Insert(const Item &item, const ItemTooltipText &tooltip);
+    void Insert(const Item &item, const QPixmap &icon);
+    // Renders what isn't cached yet of item on a background thread: its
+    // tooltip, and its icon unless image is null.  Returns false if too many
+    // renders are queued already.
+    bool Render(const std::shared_ptr<Item> &item, const QImage &image);
+    void Clear();
+    const RenderCacheStats &stats() const { return stats_; }
+signals:
+    // Background renders were added to the cache
+    void Rendered();
+    // emitted by background tasks
+    void Finished();
+private slots:
+    void OnFinished();
+private:
+    struct Entry {
+        bool has_tooltip{false};
+        ItemTooltipText tooltip;
+        QPixmap icon;
+        std::list<std::string>::iterator lru;
+    };
+    struct Result {
+        std::string key;
+        bool has_tooltip;
+        ItemTooltipText tooltip;
+        QImage icon;
+    };
+    Entry *Find(const std::string &key);
+    Entry &Get(const std::string &key);
+    void Evict();
+
+    size_t capacity_;
+    std::unordered_map<std::string, Entry> entries_;
+    // least recently used first
+    std::list<std::string> lru_;
+    // keys of items being rendered
+    std::set<std::string> queued_;
+    QMutex results_mutex_;
+    std::vector<Result> results_;
+    QThreadPool pool_;
+    RenderCacheStats stats_;
+};
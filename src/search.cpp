@@ -27,6 +27,7 @@
 #include "bucket.h"
 #include "column.h"
 #include "filters.h"
+#include "itemstore.h"
 #include "porting.h"
 #include "QsLog.h"
 #include <QMessageBox>
@@ -115,37 +116,37 @@ const std::unique_ptr<Bucket> &Search::bucket(int row) const {
 
 }
 
-void Search::FilterItems(const Items &items) {
+void Search::FilterItems(const ItemStore &store) {
     // If we're just changing tabs we don't need to update anything
     if (refresh_reason_ == RefreshReason::TabChanged)
         return;
 
     QLOG_DEBUG() << "FilterItems: reason(" << refresh_reason_ << ")";
-    items_.clear();
-    for (const auto &item : items) {
+    result_.Clear();
+    const Items &items = store.items();
+    for (ItemId id = 0; id < items.size(); ++id) {
         bool matches = true;
         for (auto &filter : filters_)
-            if (!filter->Matches(item)) {
+            if (!filter->Matches(items[id])) {
                 matches = false;
                 break;
             }
         if (matches)
-            items_.push_back(item);
+            result_.Add(id);
     }
 
-    UpdateItemCounts(items);
+    UpdateItemCounts(store);
 
     // Single bucket with null location is used to view all items at once
     bucket_.clear();
-    bucket_.push_back(std::make_unique<Bucket>(ItemLocation()));
+    bucket_.push_back(std::make_unique<Bucket>(ItemLocation(), store, result_));
 
+    // Tab buckets are the search result intersected with the items of each location
     std::map<ItemLocation, std::unique_ptr<Bucket>> bucketed_tabs;
-    for (const auto &item : items_) {
-        ItemLocation location = item->location();
-        if (!bucketed_tabs.count(location))
-            bucketed_tabs[location] = std::make_unique<Bucket>(location);
-        bucketed_tabs[location]->AddItem(item);        
-        bucket_.front()->AddItem(item);
+    for (auto &location : store.locations()) {
+        ItemBitmap ids = result_ & location.second;
+        if (!ids.Empty())
+            bucketed_tabs[location.first] = std::make_unique<Bucket>(location.first, store, ids);
     }
 
     // We need to add empty tabs here as there are no items to force their addition
@@ -205,9 +206,9 @@ uint Search::GetItemsCount() {
     return filtered_item_count_total_;
 }
 
-void Search::Activate(const Items &items) {
+void Search::Activate(const ItemStore &store) {
     FromForm();
-    FilterItems(items);
+    FilterItems(store);
     view_->setSortingEnabled(false);
     view_->setModel(model_.get());
     view_->header()->setSortIndicator(model_->GetSortColumn(), model_->GetSortOrder());
@@ -241,14 +242,15 @@ void Search::RestoreViewProperties() {
 }
 
 bool Search::IsAnyFilterActive() const {
-    return (items_.size() != unfiltered_item_count_);
+    return (result_.Cardinality() != unfiltered_item_count_);
 }
 
-void Search::UpdateItemCounts(const Items &items) {
-    unfiltered_item_count_ = items.size();
+void Search::UpdateItemCounts(const ItemStore &store) {
+    unfiltered_item_count_ = store.size();
 
     filtered_item_count_total_ = 0;
-    for (auto &item : items_)
-        filtered_item_count_total_ += item->count();
+    result_.ForEach([&](ItemId id) {
+        filtered_item_count_total_ += store.item(id)->count();
+    });
 }
 
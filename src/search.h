@@ -26,11 +26,13 @@
 #include "item.h"
 #include "column.h"
 #include "bucket.h"
+#include "itembitmap.h"
 #include "util.h"
 
 class BuyoutManager;
 class Filter;
 class FilterData;
+class ItemStore;
 class ItemsModel;
 class QTreeView;
 class QModelIndex;
@@ -44,19 +46,19 @@ public:
 
 public:
     Search(BuyoutManager &bo, const std::string &caption, const std::vector<std::unique_ptr<Filter>> &filters, QTreeView *view);
-    void FilterItems(const Items &items);
+    void FilterItems(const ItemStore &store);
     void FromForm();
     void ToForm();
     void ResetForm();
     const std::string &caption() const { return caption_; }
-    const Items &items() const { return items_; }
+    const ItemBitmap &result() const { return result_; }
     const std::vector<std::unique_ptr<Column>> &columns() const { return columns_; }
     const std::vector<std::unique_ptr<Bucket>> &buckets() const;
     QString GetCaption();
     uint GetItemsCount();
     bool IsAnyFilterActive() const;
     // Sets this search as current, will display items in passed QTreeView.
-    void Activate(const Items &items);
+    void Activate(const ItemStore &store);
     void RestoreViewProperties();
     void SaveViewProperties();
     ItemLocation GetTabLocation(const QModelIndex & index) const;
@@ -64,13 +66,15 @@ public:
     int GetViewMode() { return current_mode_; }
     const std::unique_ptr<Bucket> &bucket(int row) const;
     void SetRefreshReason(RefreshReason::Type reason) { refresh_reason_ = reason;}
+    ItemsModel *model() const { return model_.get(); }
 private:
-    void UpdateItemCounts(const Items &items);
+    void UpdateItemCounts(const ItemStore &store);
 
     std::vector<std::unique_ptr<FilterData>> filters_;
     std::vector<std::unique_ptr<Column>> columns_;
     std::string caption_;
-    Items items_;
+    // ids of items in the ItemStore that match this search
+    ItemBitmap result_;
     QTreeView *view_{nullptr};
     BuyoutManager &bo_manager_;
     std::unique_ptr<ItemsModel> model_;
@@ -19,6 +19,7 @@
 
 #include "shop.h"
 
+#include <algorithm>
 #include <QApplication>
 #include <QClipboard>
 #include <QNetworkReply>
@@ -30,22 +31,49 @@
 #include "application.h"
 #include "buyoutmanager.h"
 #include "datastore.h"
+#include "htmlform.h"
 #include "itemsmanager.h"
 #include "porting.h"
 #include "util.h"
 #include "mainwindow.h"
 #include "replytimeout.h"
+#include "shoplayout.h"
 
 const std::string kPoeEditThread = "https://www.pathofexile.com/forum/edit-thread/";
+const std::string kPoeTradeVerify = "http://verify.poe.trade/";
 const std::string kShopTemplateItems = "[items]";
 const int kMaxCharactersInPost = 50000;
 const int kSpoilerOverhead = 19; // "[spoiler][/spoiler]" length
+// Prefix of the data keys holding the hash of what was last submitted to a thread
+const std::string kShopThreadHash = "shop_hash_";
+// Bytes of a forum page read at a time
+const int kPageChunk = 16 * 1024;
+
+namespace {
+
+// Feeds the body of reply to reader a piece at a time, rather than copying the
+// whole page first
+void ReadPage(QNetworkReply *reply, HtmlFormReader *reader) {
+    std::vector<char> buffer(kPageChunk);
+    qint64 size;
+    while ((size = reply->read(buffer.data(), buffer.size())) > 0)
+        reader->Feed(buffer.data(), size);
+}
+
+}
 
 Shop::Shop(Application &app) :
     app_(app),
     shop_data_outdated_(true),
-    submitting_(false)
+    submitting_(false),
+    running_(0),
+    finished_(0),
+    total_(0),
+    edit_thread_url_(kPoeEditThread),
+    verify_url_(kPoeTradeVerify)
 {
+    rate_limit_timer_.setSingleShot(true);
+    connect(&rate_limit_timer_, &QTimer::timeout, this, &Shop::StartThreads);
     threads_ = Util::StringSplit(app_.data().Get("shop"), ';');
     auto_update_ = app_.data().GetBool("shop_update", true);
     shop_template_ = app_.data().Get("shop_template");
@@ -59,7 +87,14 @@ void Shop::SetThread(const std::vector<std::string> &threads) {
     threads_ = threads;
     app_.data().Set("shop", Util::StringJoin(threads, ";"));
     ExpireShopData();
-    app_.data().Set("shop_hash", "");
+    // submit the new threads even if they seem unchanged
+    for (auto &thread : threads_)
+        app_.data().Set(kShopThreadHash + thread, "");
+}
+
+void Shop::SetForumUrls(const std::string &edit_thread, const std::string &verify) {
+    edit_thread_url_ = edit_thread;
+    verify_url_ = verify;
 }
 
 void Shop::SetAutoUpdate(bool update) {
@@ -88,7 +123,6 @@ void Shop::Update() {
     }
     shop_data_outdated_ = false;
     shop_data_.clear();
-    std::string data = "";
     std::vector<AugmentedItem> aug_items;
     AugmentedItem tmp = AugmentedItem();
     //Get all buyouts to be able to sort them
@@ -106,31 +140,27 @@ void Shop::Update() {
         return;
     std::sort(aug_items.begin(), aug_items.end());
 
+    std::vector<ShopGroup> groups;
     Buyout current_bo = aug_items[0].bo;
-    data += SpoilerBuyout(current_bo);
     for (auto &aug : aug_items) {
-        if (aug.bo.type != current_bo.type || aug.bo.currency != current_bo.currency || aug.bo.value != current_bo.value) {
+        if (groups.empty() || aug.bo.type != current_bo.type || aug.bo.currency != current_bo.currency || aug.bo.value != current_bo.value) {
             current_bo = aug.bo;
-            data += "[/spoiler]";
-            data += SpoilerBuyout(current_bo);
-        }
-        std::string item_string = aug.item->location().GetForumCode(app_.league());
-        if (data.size() + item_string.size() + shop_template_.size()+ kSpoilerOverhead + QString("[/spoiler]").size() > kMaxCharactersInPost) {
-            data +="[/spoiler]";
-            shop_data_.push_back(data);
-            data = SpoilerBuyout(current_bo);
-            data += item_string;
-        } else {
-            data += item_string;
+            groups.push_back(ShopGroup{ SpoilerBuyout(current_bo), {} });
         }
+        groups.back().items.push_back(aug.item->location().GetForumCode(app_.league()));
     }
-    if (!data.empty())
-        shop_data_.push_back(data);
+    // items with the same buyout come in no particular order, which would
+    // change posts that didn't really change
+    for (auto &group : groups)
+        std::sort(group.items.begin(), group.items.end());
+
+    int capacity = std::max(kMaxCharactersInPost - static_cast<int>(shop_template_.size()) - kSpoilerOverhead, 0);
+    ShopPlacement placement = DeserializeShopPlacement(app_.data().Get("shop_layout"));
+    shop_data_ = LayoutShop(groups, capacity, &placement);
+    app_.data().Set("shop_layout", SerializeShopPlacement(placement));
 
     for (size_t i = 0; i < shop_data_.size(); ++i)
         shop_data_[i] = Util::StringReplace(shop_template_, kShopTemplateItems, "[spoiler]" + shop_data_[i] + "[/spoiler]");
-
-    shop_hash_ = Util::Md5(Util::StringJoin(shop_data_, ";"));
 }
 
 void Shop::ExpireShopData() {
@@ -150,97 +180,203 @@ void Shop::SubmitShopToForum(bool force) {
     if (shop_data_outdated_)
         Update();
 
-    std::string previous_hash = app_.data().Get("shop_hash");
-    // Don't update the shop if it hasn't changed
-    if (previous_hash == shop_hash_ && !force)
-        return;
-
     if (threads_.size() < shop_data_.size()) {
         QLOG_WARN() << "Need" << shop_data_.size() - threads_.size() << "more shops defined to fit all your items.";
     }
 
-    requests_completed_ = 0;
+    thread_status_.clear();
+    queue_.clear();
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        ShopThread thread;
+        thread.id = threads_[i];
+        thread.content = i < shop_data_.size() ? shop_data_[i] : "Empty";
+        thread.hash = Util::Md5(thread.content);
+        thread.attempts = 0;
+        // Don't update threads that haven't changed
+        if (force || app_.data().Get(kShopThreadHash + thread.id) != thread.hash) {
+            thread.state = ShopThreadState::Queued;
+            queue_.push_back(i);
+        } else {
+            thread.state = ShopThreadState::Unchanged;
+        }
+        thread_status_.push_back(thread);
+    }
+    if (queue_.empty())
+        return;
+
+    QLOG_DEBUG() << "Submitting" << queue_.size() << "of" << threads_.size() << "shop threads";
+    running_ = 0;
+    finished_ = 0;
+    total_ = queue_.size();
     submitting_ = true;
-    SubmitSingleShop();
+    ReportProgress();
+    StartThreads();
 }
 
-std::string Shop::ShopEditUrl(int idx) {
-    return kPoeEditThread + threads_[idx];
+std::string Shop::ShopEditUrl(const std::string &thread) {
+    return edit_thread_url_ + thread;
 }
 
-void Shop::SubmitSingleShop() {
+void Shop::ReportProgress() {
     CurrentStatusUpdate status = CurrentStatusUpdate();
-    status.state = ProgramState::ShopSubmitting;
-    status.progress = requests_completed_;
-    status.total = threads_.size();
-    if (requests_completed_ == threads_.size()) {
-        status.state = ProgramState::ShopCompleted;
-        submitting_ = false;
-        app_.data().Set("shop_hash", shop_hash_);
+    status.state = submitting_ ? ProgramState::ShopSubmitting : ProgramState::ShopCompleted;
+    status.progress = finished_;
+    status.total = total_;
+    emit StatusUpdate(status);
+}
+
+void Shop::StartThreads() {
+    if (rate_limit_timer_.isActive())
+        return;
+    while (running_ < kShopMaxParallel && !queue_.empty()) {
+        size_t thread = queue_.front();
+        queue_.pop_front();
+        ++running_;
+        FetchEditPage(thread);
+    }
+}
+
+void Shop::FetchEditPage(size_t thread) {
+    ShopThread &shop_thread = thread_status_[thread];
+    shop_thread.state = ShopThreadState::Submitting;
+    ++shop_thread.attempts;
+    // first, get to the edit-thread page to grab CSRF token
+    QNetworkReply *fetched = app_.logged_in_nm().get(QNetworkRequest(QUrl(ShopEditUrl(shop_thread.id).c_str())));
+    fetched->setProperty("shop_thread", static_cast<qulonglong>(thread));
+    new QReplyTimeout(fetched, kEditThreadTimeout);
+    connect(fetched, SIGNAL(finished()), this, SLOT(OnEditPageFinished()));
+}
+
+bool Shop::RetryThread(size_t thread, QNetworkReply *reply) {
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool rate_limited = status == 429;
+    // timeouts close the reply, which cancels it
+    bool transient = reply->error() == QNetworkReply::OperationCanceledError
+        || reply->error() == QNetworkReply::TimeoutError
+        || reply->error() == QNetworkReply::RemoteHostClosedError
+        || reply->error() == QNetworkReply::TemporaryNetworkFailureError
+        || status == 502 || status == 503 || status == 504;
+    if (!rate_limited && !transient)
+        return false;
+    ShopThread &shop_thread = thread_status_[thread];
+    if (shop_thread.attempts >= kShopMaxAttempts) {
+        QLOG_WARN() << "Giving up on shop thread" << shop_thread.id.c_str() << "after" << shop_thread.attempts << "tries";
+        return false;
+    }
+
+    int delay = kShopRetryDelay * shop_thread.attempts;
+    bool ok = false;
+    int retry_after = reply->rawHeader("Retry-After").toInt(&ok);
+    if (rate_limited && ok)
+        delay = retry_after * 1000;
+    shop_thread.state = ShopThreadState::Queued;
+    --running_;
+    if (rate_limited) {
+        // hold back every thread, not only this one
+        QLOG_WARN() << "The forum is limiting our requests, waiting" << delay / 1000 << "seconds before continuing";
+        if (!rate_limit_timer_.isActive() || rate_limit_timer_.remainingTime() < delay)
+            rate_limit_timer_.start(delay);
+        queue_.push_front(thread);
     } else {
-        // first, get to the edit-thread page to grab CSRF token
-        QNetworkReply *fetched = app_.logged_in_nm().get(QNetworkRequest(QUrl(ShopEditUrl(requests_completed_).c_str())));
-        new QReplyTimeout(fetched, kEditThreadTimeout);
-        connect(fetched, SIGNAL(finished()), this, SLOT(OnEditPageFinished()));
+        QLOG_WARN() << "Shop thread" << shop_thread.id.c_str() << "failed with" << reply->errorString() << ", trying again";
+        QTimer::singleShot(delay, this, [this, thread]() {
+            queue_.push_front(thread);
+            StartThreads();
+        });
     }
-    emit StatusUpdate(status);
+    StartThreads();
+    return true;
+}
+
+void Shop::FinishThread(size_t thread, bool success) {
+    ShopThread &shop_thread = thread_status_[thread];
+    shop_thread.state = success ? ShopThreadState::Submitted : ShopThreadState::Failed;
+    if (success)
+        app_.data().Set(kShopThreadHash + shop_thread.id, shop_thread.hash);
+    --running_;
+    ++finished_;
+    if (finished_ == total_)
+        submitting_ = false;
+    ReportProgress();
+    StartThreads();
 }
 
 void Shop::OnEditPageFinished() {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
-    QByteArray bytes = reply->readAll();
-    std::string page(bytes.constData(), bytes.size());
-    std::string hash = Util::GetCsrfToken(page, "hash");
+    reply->deleteLater();
+    size_t index = reply->property("shop_thread").toULongLong();
+    const ShopThread &thread = thread_status_[index];
+    if (RetryThread(index, reply))
+        return;
+    if (reply->error()) {
+        QLOG_ERROR() << "Can't update shop thread" << thread.id.c_str() << "--" << reply->errorString();
+        FinishThread(index, false);
+        return;
+    }
+    HtmlFormReader reader;
+    ReadPage(reply, &reader);
+    // the edit form is the one with the CSRF token
+    const HtmlForm *form = reader.page().FindForm("hash");
+    std::string hash = form ? form->fields.at("hash") : "";
     if (hash.empty()) {
         QLOG_ERROR() << "Can't update shop -- cannot extract CSRF token from the page. Check if thread ID is valid."
             << "If you're using Steam to login make sure you use the same login method (steam or login/password) in Acquisition, Path of Exile website and Path of Exile game client."
             << "For example, if you created a shop thread while using Steam to log into the website and then logged into Acquisition with login/password it will not work."
             << "In this case you should either recreate your shop thread or use a correct login method in Acquisition.";
-        submitting_ = false;
+        FinishThread(index, false);
         return;
     }
 
     // now submit our edit
-
-    // holy shit give me some html parser library please
-    std::string title = Util::FindTextBetween(page, "<input type=\"text\" name=\"title\" id=\"title\" onkeypress=\"return&#x20;event.keyCode&#x21;&#x3D;13\" value=\"", "\">");
-    if (title.empty()) {
+    auto title = form->fields.find("title");
+    if (title == form->fields.end() || title->second.empty()) {
         QLOG_ERROR() << "Can't update shop -- title is empty. Check if thread ID is valid.";
-        submitting_ = false;
+        FinishThread(index, false);
         return;
     }
 
     QUrlQuery query;
     query.addQueryItem("hash", hash.c_str());
-    query.addQueryItem("title", Util::Decode(title).c_str());
-    query.addQueryItem("content", requests_completed_ < shop_data_.size() ? shop_data_[requests_completed_].c_str() : "Empty");
+    query.addQueryItem("title", title->second.c_str());
+    query.addQueryItem("content", thread.content.c_str());
     query.addQueryItem("submit", "Submit");
 
     QByteArray data(query.query().toUtf8());
-    QNetworkRequest request((QUrl(ShopEditUrl(requests_completed_).c_str())));
+    QNetworkRequest request((QUrl(ShopEditUrl(thread.id).c_str())));
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
     QNetworkReply *submitted = app_.logged_in_nm().post(request, data);
+    submitted->setProperty("shop_thread", static_cast<qulonglong>(index));
     new QReplyTimeout(submitted, kEditThreadTimeout);
     connect(submitted, SIGNAL(finished()), this, SLOT(OnShopSubmitted()));
 }
 
 void Shop::OnShopSubmitted() {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
-    QByteArray bytes = reply->readAll();
-    std::string page(bytes.constData(), bytes.size());
-    std::string error = Util::FindTextBetween(page, "<ul class=\"errors\"><li>", "</li></ul>");
-    if (!error.empty()) {
-        QLOG_ERROR() << "Error while submitting shop to forums:" << error.c_str();
-        submitting_ = false;
+    reply->deleteLater();
+    size_t index = reply->property("shop_thread").toULongLong();
+    const ShopThread &thread = thread_status_[index];
+    if (RetryThread(index, reply))
+        return;
+    if (reply->error()) {
+        QLOG_ERROR() << "Error while submitting shop thread" << thread.id.c_str() << "--" << reply->errorString();
+        FinishThread(index, false);
+        return;
+    }
+    HtmlFormReader reader;
+    ReadPage(reply, &reader);
+    const std::vector<std::string> &errors = reader.page().errors;
+    if (!errors.empty()) {
+        QLOG_ERROR() << "Error while submitting shop to forums:" << Util::StringJoin(errors, " ").c_str();
+        FinishThread(index, false);
         return;
     }
 
     // now let's hope that shop was submitted successfully and notify poe.trade
-    QNetworkRequest request(QUrl(("http://verify.poe.trade/" + threads_[requests_completed_] + "/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa").c_str()));
-    app_.logged_in_nm().get(request);
+    QNetworkRequest request(QUrl((verify_url_ + thread.id + "/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa").c_str()));
+    QNetworkReply *verified = app_.logged_in_nm().get(request);
+    connect(verified, &QNetworkReply::finished, verified, &QNetworkReply::deleteLater);
 
-    ++requests_completed_;
-    SubmitSingleShop();
+    FinishThread(index, true);
 }
 
 void Shop::CopyToClipboard() {
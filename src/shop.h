@@ -20,13 +20,23 @@
 #pragma once
 
 #include <QObject>
+#include <QTimer>
+#include <deque>
 #include <string>
 #include <vector>
 #include "item.h"
 #include "buyoutmanager.h"
 
 struct CurrentStatusUpdate;
+class QNetworkReply;
 extern const std::string kShopTemplateItems;
+// Threads submitted at the same time
+const size_t kShopMaxParallel = 3;
+// Tries for a thread whose requests time out or are rate limited
+const int kShopMaxAttempts = 3;
+// Wait before trying a thread again, times the number of tries so far, unless
+// the forum says how long to wait
+const int kShopRetryDelay = 5000;
 struct AugmentedItem {
     Item *item;
     Buyout bo;
@@ -42,6 +52,24 @@ struct AugmentedItem {
 };
 class Application;
 
+enum class ShopThreadState {
+    // the content is the same as when the thread was last submitted
+    Unchanged,
+    Queued,
+    Submitting,
+    Submitted,
+    Failed
+};
+
+struct ShopThread {
+    std::string id;
+    // what is posted to the thread, and its hash
+    std::string content;
+    std::string hash;
+    ShopThreadState state;
+    int attempts;
+};
+
 class Shop : public QObject {
     Q_OBJECT
 public:
@@ -52,28 +80,49 @@ public:
     void Update();
     void CopyToClipboard();
     void ExpireShopData();
+    // Submits the threads whose content changed since they were last
+    // submitted, or all of them if force is set
     void SubmitShopToForum(bool force = false);
     bool auto_update() const { return auto_update_; }
+    bool submitting() const { return submitting_; }
+    // The threads of the last submission
+    const std::vector<ShopThread> &thread_status() const { return thread_status_; }
     const std::vector<std::string> &threads() const { return threads_; }
     const std::vector<std::string> &shop_data() const { return shop_data_; }
     const std::string &shop_template() const { return shop_template_; }
+    // Where threads are edited and poe.trade is notified, used by tests
+    void SetForumUrls(const std::string &edit_thread, const std::string &verify);
 public slots:
     void OnEditPageFinished();
     void OnShopSubmitted();
 signals:
     void StatusUpdate(const CurrentStatusUpdate &status);
 private:
-    void SubmitSingleShop();
-    std::string ShopEditUrl(int idx);
+    // Starts queued threads while fewer than kShopMaxParallel are submitting
+    void StartThreads();
+    void FetchEditPage(size_t thread);
+    // Queues thread again if reply failed in a way worth retrying
+    bool RetryThread(size_t thread, QNetworkReply *reply);
+    void FinishThread(size_t thread, bool success);
+    void ReportProgress();
+    std::string ShopEditUrl(const std::string &thread);
     std::string SpoilerBuyout(Buyout &bo);
 
     Application &app_;
     std::vector<std::string> threads_;
     std::vector<std::string> shop_data_;
-    std::string shop_hash_;
     std::string shop_template_;
     bool shop_data_outdated_;
     bool auto_update_;
     bool submitting_;
-    size_t requests_completed_;
+    std::vector<ShopThread> thread_status_;
+    // indices into thread_status_ of the threads waiting to be submitted
+    std::deque<size_t> queue_;
+    size_t running_;
+    size_t finished_;
+    size_t total_;
+    // no thread is started while this runs, after the forum rate limited us
+    QTimer rate_limit_timer_;
+    std::string edit_thread_url_;
+    std::string verify_url_;
 };
@@ -0,0 +1,282 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "shoplayout.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+const std::string kSpoilerEnd = "[/spoiler]";
+
+// A group, or a part of one that was split
+struct Piece {
+    size_t group;
+    size_t begin, end;
+    size_t size;
+};
+
+struct Bin {
+    size_t used;
+    std::vector<Piece> pieces;
+};
+
+typedef std::vector<Bin> Bins;
+
+class Layout {
+public:
+    Layout(const std::vector<ShopGroup> &groups, size_t capacity):
+        groups_(groups),
+        capacity_(capacity)
+    {}
+
+    size_t Size(size_t group, size_t begin, size_t end) const {
+        size_t size = groups_[group].header.size() + kSpoilerEnd.size();
+        for (size_t i = begin; i < end; ++i)
+            size += groups_[group].items[i].size();
+        return size;
+    }
+
+    // Splits groups that don't fit in a post.  The full parts get a post each
+    // and the rest of the group is returned as a piece.
+    std::vector<Piece> Pieces(Bins *full) const {
+        std::vector<Piece> pieces;
+        for (size_t group = 0; group < groups_.size(); ++group) {
+            size_t begin = 0;
+            size_t count = groups_[group].items.size();
+            while (Size(group, begin, count) > capacity_) {
+                size_t end = begin;
+                size_t size = groups_[group].header.size() + kSpoilerEnd.size();
+                // always take one item so an oversized item can't loop forever
+                do {
+                    size += groups_[group].items[end].size();
+                    ++end;
+                } while (end < count && size + groups_[group].items[end].size() <= capacity_);
+                full->push_back(Bin{ size, { Piece{ group, begin, end, size } } });
+                begin = end;
+            }
+            if (begin < count)
+                pieces.push_back(Piece{ group, begin, count, Size(group, begin, count) });
+        }
+        return pieces;
+    }
+
+    // Spreads piece over the room left in bins, most room first.  Returns false
+    // and leaves bins alone if it doesn't fit.
+    bool Split(const Piece &piece, Bins *bins) const {
+        Bins trial = *bins;
+        std::vector<size_t> order(trial.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return trial[a].used < trial[b].used;
+        });
+        auto &items = groups_[piece.group].items;
+        size_t begin = piece.begin;
+        for (size_t i : order) {
+            Bin &bin = trial[i];
+            size_t end = begin;
+            size_t size = groups_[piece.group].header.size() + kSpoilerEnd.size();
+            while (end < piece.end && bin.used + size + items[end].size() <= capacity_) {
+                size += items[end].size();
+                ++end;
+            }
+            if (end == begin)
+                break;
+            bin.used += size;
+            bin.pieces.push_back(Piece{ piece.group, begin, end, size });
+            begin = end;
+            if (begin == piece.end) {
+                *bins = std::move(trial);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // First fit decreasing, after putting pieces back into their previous
+    // post where they fit.  A piece that fits in no post whole is split over
+    // several if that saves a post.
+    Bins Pack(const std::vector<Piece> &pieces, const Bins &full, const ShopPlacement &previous) const {
+        Bins bins = full;
+        std::vector<Piece> rest;
+        // a layout never needs more posts than this
+        size_t limit = full.size() + pieces.size();
+        for (auto &piece : pieces) {
+            size_t begin = piece.begin;
+            auto it = previous.find(groups_[piece.group].header);
+            if (it != previous.end()) {
+                for (auto &part : it->second) {
+                    // the posts of split off full parts are made by Pieces()
+                    if (part.post < full.size())
+                        continue;
+                    if (begin == piece.end || part.post >= limit)
+                        break;
+                    if (bins.size() <= part.post)
+                        bins.resize(part.post + 1, Bin{ 0, {} });
+                    Bin &bin = bins[part.post];
+                    size_t end = std::min(piece.end, begin + part.items);
+                    size_t size = Size(piece.group, begin, end);
+                    if (bin.used + size > capacity_)
+                        break;
+                    bin.used += size;
+                    bin.pieces.push_back(Piece{ piece.group, begin, end, size });
+                    begin = end;
+                }
+            }
+            if (begin < piece.end)
+                rest.push_back(Piece{ piece.group, begin, piece.end, Size(piece.group, begin, piece.end) });
+        }
+        std::stable_sort(rest.begin(), rest.end(), [](const Piece &a, const Piece &b) {
+            return a.size > b.size;
+        });
+        for (auto &piece : rest) {
+            auto bin = std::find_if(bins.begin(), bins.end(), [&](const Bin &bin) {
+                return bin.used + piece.size <= capacity_;
+            });
+            if (bin == bins.end()) {
+                if (Split(piece, &bins))
+                    continue;
+                bin = bins.insert(bins.end(), Bin{ 0, {} });
+            }
+            bin->used += piece.size;
+            bin->pieces.push_back(piece);
+        }
+        bins.erase(std::remove_if(bins.begin(), bins.end(), [](const Bin &bin) {
+            return bin.pieces.empty();
+        }), bins.end());
+        return bins;
+    }
+
+    // Fills posts one after another, splitting groups at post boundaries
+    Bins Fill(const std::vector<Piece> &pieces, const Bins &full) const {
+        Bins bins = full;
+        Bin bin{ 0, {} };
+        for (auto &piece : pieces) {
+            size_t begin = piece.begin;
+            while (begin < piece.end) {
+                size_t end = begin;
+                size_t size = groups_[piece.group].header.size() + kSpoilerEnd.size();
+                while (end < piece.end && bin.used + size + groups_[piece.group].items[end].size() <= capacity_) {
+                    size += groups_[piece.group].items[end].size();
+                    ++end;
+                }
+                if (end == begin) {
+                    // not even one item fits, start a new post
+                    bins.push_back(bin);
+                    bin = Bin{ 0, {} };
+                    continue;
+                }
+                bin.used += size;
+                bin.pieces.push_back(Piece{ piece.group, begin, end, size });
+                begin = end;
+            }
+        }
+        if (!bin.pieces.empty())
+            bins.push_back(bin);
+        return bins;
+    }
+
+    std::vector<std::string> Render(Bins *bins, ShopPlacement *placement) const {
+        std::vector<std::string> posts;
+        // parts of each group with the index of their first item
+        std::map<std::string, std::vector<std::pair<size_t, ShopPart>>> parts;
+        for (size_t i = 0; i < bins->size(); ++i) {
+            auto &pieces = (*bins)[i].pieces;
+            std::sort(pieces.begin(), pieces.end(), [](const Piece &a, const Piece &b) {
+                return a.group != b.group ? a.group < b.group : a.begin < b.begin;
+            });
+            std::string post;
+            for (auto &piece : pieces) {
+                auto &group = groups_[piece.group];
+                post += group.header;
+                for (size_t item = piece.begin; item < piece.end; ++item)
+                    post += group.items[item];
+                post += kSpoilerEnd;
+                parts[group.header].push_back({ piece.begin, ShopPart{ i, piece.end - piece.begin } });
+            }
+            posts.push_back(post);
+        }
+
+        placement->clear();
+        for (auto &group : parts) {
+            std::sort(group.second.begin(), group.second.end(), [](const std::pair<size_t, ShopPart> &a,
+                                                                   const std::pair<size_t, ShopPart> &b) {
+                return a.first < b.first;
+            });
+            auto &out = (*placement)[group.first];
+            for (auto &part : group.second)
+                out.push_back(part.second);
+        }
+        return posts;
+    }
+
+private:
+    const std::vector<ShopGroup> &groups_;
+    size_t capacity_;
+};
+
+}
+
+std::vector<std::string> LayoutShop(const std::vector<ShopGroup> &groups, size_t capacity,
+                                    ShopPlacement *placement) {
+    Layout layout(groups, capacity);
+    Bins full;
+    std::vector<Piece> pieces = layout.Pieces(&full);
+
+    // candidates in order of preference when they need as many posts
+    Bins best = layout.Pack(pieces, full, *placement);
+    for (Bins bins : { layout.Pack(pieces, full, ShopPlacement()), layout.Fill(pieces, full) })
+        if (bins.size() < best.size())
+            best = std::move(bins);
+    return layout.Render(&best, placement);
+}
+
+// One line per group: its parts as post:items separated by spaces, a tab and
+// the header
+std::string SerializeShopPlacement(const ShopPlacement &placement) {
+    std::string data;
+    for (auto &entry : placement) {
+        for (auto &part : entry.second)
+            data += std::to_string(part.post) + ":" + std::to_string(part.items) + " ";
+        data += "\t" + entry.first + "\n";
+    }
+    return data;
+}
+
+ShopPlacement DeserializeShopPlacement(const std::string &data) {
+    ShopPlacement placement;
+    std::istringstream stream(data);
+    std::string line;
+    while (std::getline(stream, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+            continue;
+        std::vector<ShopPart> parts;
+        std::istringstream parts_stream(line.substr(0, tab));
+        size_t post, items;
+        char colon;
+        while (parts_stream >> post >> colon >> items && colon == ':')
+            parts.push_back(ShopPart{ post, items });
+        if (!parts.empty())
+            placement[line.substr(tab + 1)] = parts;
+    }
+    return placement;
+}
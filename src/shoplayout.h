@@ -0,0 +1,55 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Items sharing a buyout, posted inside one [spoiler="..."] tag
+struct ShopGroup {
+    // the opening tag, which also identifies the group between updates
+    std::string header;
+    std::vector<std::string> items;
+};
+
+// A run of consecutive items of a group that went into one post
+struct ShopPart {
+    size_t post;
+    size_t items;
+};
+
+// The parts of each group in item order, by group header
+typedef std::map<std::string, std::vector<ShopPart>> ShopPlacement;
+
+/*
+ * Lays groups out into as few posts of at most `capacity` characters as it
+ * can.  Groups are kept whole where possible and split into several spoilers
+ * where that saves a post.  Parts of groups go back into the posts *placement
+ * says they were in last time if they still fit there, so a change to one
+ * group tends to change only the posts it is in; that is only done if it costs
+ * no extra posts.  Groups keep their relative order inside a post.
+ * *placement is updated to the new layout.
+ */
+std::vector<std::string> LayoutShop(const std::vector<ShopGroup> &groups, size_t capacity,
+                                    ShopPlacement *placement);
+
+std::string SerializeShopPlacement(const ShopPlacement &placement);
+ShopPlacement DeserializeShopPlacement(const std::string &data);
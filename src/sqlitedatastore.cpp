@@ -20,15 +20,33 @@
 #include "sqlitedatastore.h"
 
 #include "sqlite/sqlite3.h"
+#include <QByteArray>
 #include <QCryptographicHash>
 #include <QDir>
+#include <algorithm>
 #include <ctime>
+#include <mutex>
 #include <stdexcept>
 
+#include "QsLog.h"
+
 #include "currencymanager.h"
 
-SqliteDataStore::SqliteDataStore(const std::string &filename) :
-    filename_(filename)
+namespace {
+
+// Can't be the start of a value stored as is, those are text
+const char kCompressedHeader[] = { '\0', 'z' };
+
+std::string ColumnText(sqlite3_stmt *stmt, int column) {
+    const char *text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+    return text ? std::string(text, sqlite3_column_bytes(stmt, column)) : std::string();
+}
+
+}
+
+SqliteDataStore::SqliteDataStore(const std::string &filename, size_t compression_threshold) :
+    filename_(filename),
+    compression_threshold_(compression_threshold)
 {
     QDir dir(QDir::cleanPath((filename + "/..").c_str()));
     if (!dir.exists())
@@ -36,8 +54,34 @@ SqliteDataStore::SqliteDataStore(const std::string &filename) :
     if (sqlite3_open(filename_.c_str(), &db_) != SQLITE_OK) {
         throw std::runtime_error("Failed to open sqlite3 database.");
     }
+    // With a write-ahead log commits don't have to rewrite pages in place, and
+    // synchronous=NORMAL only syncs on checkpoints while still never corrupting
+    // the database.
+    Exec("PRAGMA journal_mode=WAL");
+    Exec("PRAGMA synchronous=NORMAL");
     CreateTable("data", "key TEXT PRIMARY KEY, value BLOB");
+    // only read to migrate it to currency_history
     CreateTable("currency", "timestamp INTEGER PRIMARY KEY, value TEXT");
+    CreateTable("currency_history", "timestamp INTEGER, currency INTEGER, count REAL, chaos_value REAL, "
+                "PRIMARY KEY (timestamp, currency)");
+    CreateTable("collection_rows", "collection TEXT, key TEXT, value BLOB, PRIMARY KEY (collection, key)");
+    // Items are still loaded from the "items" value on startup, these tables are
+    // what can be queried.  price and currency are NULL for items without a price.
+    // Databases of older versions have an unused json column, left NULL, and no
+    // uid column.  Their rows are replaced by the first store of a session anyway.
+    CreateTable("items", "id INTEGER PRIMARY KEY, uid TEXT, hash TEXT, tab TEXT, category TEXT, frame_type INTEGER, "
+                "price REAL, currency TEXT");
+    if (!HasColumn("items", "uid"))
+        Exec("ALTER TABLE items ADD COLUMN uid TEXT");
+    CreateIndex("items", "uid");
+    CreateIndex("items", "hash");
+    CreateIndex("items", "tab");
+    CreateIndex("items", "category");
+    CreateIndex("items", "frame_type");
+    CreateIndex("items", "currency, price");
+    CreateTable("item_mods", "item INTEGER, mod TEXT, value REAL");
+    CreateIndex("item_mods", "item");
+    CreateIndex("item_mods", "mod, value");
 }
 
 void SqliteDataStore::CreateTable(const std::string &name, const std::string &fields) {
@@ -47,42 +91,85 @@ void SqliteDataStore::CreateTable(const std::string &name, const std::string &fi
     }
 }
 
-std::string SqliteDataStore::Get(const std::string &key, const std::string &default_value) {
-    std::string query = "SELECT value FROM data WHERE key = ?";
+void SqliteDataStore::CreateIndex(const std::string &table, const std::string &columns) {
+    std::string name = table + "_" + columns;
+    name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+    std::replace(name.begin(), name.end(), ',', '_');
+    std::string query = "CREATE INDEX IF NOT EXISTS " + name + " ON " + table + "(" + columns + ")";
+    if (sqlite3_exec(db_, query.c_str(), 0, 0, 0) != SQLITE_OK) {
+        throw std::runtime_error("Failed to create index " + name + ".");
+    }
+}
+
+bool SqliteDataStore::HasColumn(const std::string &table, const std::string &column) {
+    std::string query = "PRAGMA table_info(" + table + ")";
     sqlite3_stmt *stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-    std::string result(default_value);
-    if (sqlite3_step(stmt) == SQLITE_ROW)
-        result = std::string(static_cast<const char*>(sqlite3_column_blob(stmt, 0)), sqlite3_column_bytes(stmt, 0));
+    if (sqlite3_prepare_v2(db_, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to read the columns of table " + table + ".");
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW)
+        found = ColumnText(stmt, 1) == column;
     sqlite3_finalize(stmt);
-    return result;
+    return found;
 }
 
-void SqliteDataStore::Set(const std::string &key, const std::string &value) {
-    std::string query = "INSERT OR REPLACE INTO data (key, value) VALUES (?, ?)";
+void SqliteDataStore::Exec(const char *query) {
+    if (sqlite3_exec(db_, query, 0, 0, 0) != SQLITE_OK)
+        QLOG_ERROR() << "Failed to execute" << query << ":" << sqlite3_errmsg(db_);
+}
+
+sqlite3_stmt *SqliteDataStore::Statement(const char *query) {
+    auto it = statements_.find(query);
+    if (it != statements_.end()) {
+        sqlite3_reset(it->second);
+        sqlite3_clear_bindings(it->second);
+        return it->second;
+    }
     sqlite3_stmt *stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
+    if (sqlite3_prepare_v2(db_, query, -1, &stmt, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to prepare statement: " + std::string(query));
+    statements_[query] = stmt;
+    return stmt;
+}
+
+std::string SqliteDataStore::Get(const std::string &key, const std::string &default_value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT value FROM data WHERE key = ?");
     sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 2, value.c_str(), value.size(), SQLITE_STATIC);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    std::string result(default_value);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *data = static_cast<const char*>(sqlite3_column_blob(stmt, 0));
+        size_t size = sqlite3_column_bytes(stmt, 0);
+        if (!Uncompress(data, size, &result)) {
+            QLOG_ERROR() << "Failed to uncompress the value of" << key.c_str();
+            result = default_value;
+        }
+    }
+    // don't hold a read transaction open until the statement is used again
+    sqlite3_reset(stmt);
+    return result;
 }
 
-void SqliteDataStore::InsertCurrencyUpdate(const CurrencyUpdate &update) {
-    std::string query = "INSERT INTO currency (timestamp, value) VALUES (?, ?)";
-    sqlite3_stmt *stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
-    sqlite3_bind_int64(stmt, 1, update.timestamp);
-    sqlite3_bind_text(stmt, 2, update.value.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+void SqliteDataStore::Set(const std::string &key, const std::string &value) {
+    // compress before taking the lock, nothing else needs the connection for that
+    std::string compressed;
+    if (value.size() >= compression_threshold_)
+        compressed = Compress(value);
+    bool use_compressed = !compressed.empty() && compressed.size() < value.size();
+    const std::string &stored = use_compressed ? compressed : value;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("INSERT OR REPLACE INTO data (key, value) VALUES (?, ?)");
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 2, stored.c_str(), stored.size(), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        QLOG_ERROR() << "Failed to set" << key.c_str() << ":" << sqlite3_errmsg(db_);
+    sqlite3_reset(stmt);
 }
 
 std::vector<CurrencyUpdate> SqliteDataStore::GetAllCurrency() {
-    std::string query = "SELECT timestamp, value FROM currency ORDER BY timestamp ASC";
-    sqlite3_stmt* stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT timestamp, value FROM currency ORDER BY timestamp ASC");
     std::vector<CurrencyUpdate> result;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         CurrencyUpdate update = CurrencyUpdate();
@@ -90,10 +177,65 @@ std::vector<CurrencyUpdate> SqliteDataStore::GetAllCurrency() {
         update.value = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
         result.push_back(update);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return result;
 }
 
+void SqliteDataStore::InsertCurrencySamples(const std::vector<CurrencySample> &samples) {
+    if (samples.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    Exec("SAVEPOINT insert_currency");
+    sqlite3_stmt *stmt = Statement("INSERT OR REPLACE INTO currency_history (timestamp, currency, count, chaos_value) "
+                                   "VALUES (?, ?, ?, ?)");
+    for (auto &sample : samples) {
+        sqlite3_bind_int64(stmt, 1, sample.timestamp);
+        sqlite3_bind_int(stmt, 2, sample.currency);
+        sqlite3_bind_double(stmt, 3, sample.count);
+        sqlite3_bind_double(stmt, 4, sample.chaos_value);
+        ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+    if (!ok) {
+        QLOG_ERROR() << "Failed to store currency:" << sqlite3_errmsg(db_);
+        Exec("ROLLBACK TO insert_currency");
+    }
+    Exec("RELEASE insert_currency");
+}
+
+void SqliteDataStore::ForEachCurrencySample(long long from, long long to,
+                                            const std::function<bool(const CurrencySample&)> &callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT timestamp, currency, count, chaos_value FROM currency_history "
+                                   "WHERE timestamp >= ? AND timestamp < ? ORDER BY timestamp, currency");
+    sqlite3_bind_int64(stmt, 1, from);
+    sqlite3_bind_int64(stmt, 2, to);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        CurrencySample sample;
+        sample.timestamp = sqlite3_column_int64(stmt, 0);
+        sample.currency = sqlite3_column_int(stmt, 1);
+        sample.count = sqlite3_column_double(stmt, 2);
+        sample.chaos_value = sqlite3_column_double(stmt, 3);
+        if (!callback(sample))
+            break;
+    }
+    sqlite3_reset(stmt);
+}
+
+void SqliteDataStore::DownsampleCurrency(long long before, long long interval) {
+    if (interval <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("DELETE FROM currency_history WHERE timestamp < ?1 AND timestamp NOT IN "
+                                   "(SELECT MAX(timestamp) FROM currency_history WHERE timestamp < ?1 GROUP BY timestamp / ?2)");
+    sqlite3_bind_int64(stmt, 1, before);
+    sqlite3_bind_int64(stmt, 2, interval);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        QLOG_ERROR() << "Failed to downsample currency:" << sqlite3_errmsg(db_);
+    sqlite3_reset(stmt);
+}
+
 void SqliteDataStore::SetBool(const std::string &key, bool value) {
     SetInt(key, static_cast<int>(value));
 }
@@ -110,7 +252,240 @@ int SqliteDataStore::GetInt(const std::string &key, int default_value) {
     return std::stoi(Get(key, std::to_string(default_value)));
 }
 
+DataRows SqliteDataStore::GetRows(const std::string &collection) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT key, value FROM collection_rows WHERE collection = ?");
+    sqlite3_bind_text(stmt, 1, collection.c_str(), -1, SQLITE_STATIC);
+    DataRows result;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::string key(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        result[key] = std::string(static_cast<const char*>(sqlite3_column_blob(stmt, 1)), sqlite3_column_bytes(stmt, 1));
+    }
+    sqlite3_reset(stmt);
+    return result;
+}
+
+void SqliteDataStore::UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed) {
+    if (changed.empty() && removed.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // a savepoint rather than a transaction so that this also works inside a batch
+    bool ok = true;
+    Exec("SAVEPOINT update_rows");
+
+    sqlite3_stmt *stmt = Statement("INSERT OR REPLACE INTO collection_rows (collection, key, value) VALUES (?, ?, ?)");
+    for (auto &row : changed) {
+        sqlite3_bind_text(stmt, 1, collection.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, row.first.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 3, row.second.c_str(), row.second.size(), SQLITE_STATIC);
+        ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+
+    stmt = Statement("DELETE FROM collection_rows WHERE collection = ? AND key = ?");
+    for (auto &key : removed) {
+        sqlite3_bind_text(stmt, 1, collection.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, key.c_str(), -1, SQLITE_STATIC);
+        ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+
+    if (!ok) {
+        QLOG_ERROR() << "Failed to update" << collection.c_str() << "rows:" << sqlite3_errmsg(db_);
+        Exec("ROLLBACK TO update_rows");
+    }
+    Exec("RELEASE update_rows");
+}
+
+void SqliteDataStore::BeginBatch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (batch_depth_++ == 0)
+        Exec("BEGIN TRANSACTION");
+}
+
+void SqliteDataStore::Commit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (batch_depth_ == 0) {
+        QLOG_WARN() << "Commit called without BeginBatch";
+        return;
+    }
+    if (--batch_depth_ == 0)
+        Exec("COMMIT");
+}
+
+namespace {
+
+void BindPrice(sqlite3_stmt *stmt, int column, const ItemPrice &price) {
+    if (price.currency.empty()) {
+        sqlite3_bind_null(stmt, column);
+        sqlite3_bind_null(stmt, column + 1);
+    } else {
+        sqlite3_bind_double(stmt, column, price.value);
+        sqlite3_bind_text(stmt, column + 1, price.currency.c_str(), -1, SQLITE_STATIC);
+    }
+}
+
+}
+
+bool SqliteDataStore::InsertItems(const std::vector<ItemRecord> &items) {
+    sqlite3_stmt *item_stmt = Statement("INSERT INTO items (uid, hash, tab, category, frame_type, price, currency) "
+                                        "VALUES (?, ?, ?, ?, ?, ?, ?)");
+    for (auto &item : items) {
+        sqlite3_bind_text(item_stmt, 1, item.uid.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(item_stmt, 2, item.hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(item_stmt, 3, item.tab.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(item_stmt, 4, item.category.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(item_stmt, 5, item.frame_type);
+        BindPrice(item_stmt, 6, item.price);
+        bool ok = sqlite3_step(item_stmt) == SQLITE_DONE;
+        sqlite3_reset(item_stmt);
+        if (!ok)
+            return false;
+
+        sqlite3_int64 id = sqlite3_last_insert_rowid(db_);
+        sqlite3_stmt *mod_stmt = Statement("INSERT INTO item_mods (item, mod, value) VALUES (?, ?, ?)");
+        for (auto &mod : item.mods) {
+            sqlite3_bind_int64(mod_stmt, 1, id);
+            sqlite3_bind_text(mod_stmt, 2, mod.first.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_double(mod_stmt, 3, mod.second);
+            ok = sqlite3_step(mod_stmt) == SQLITE_DONE;
+            sqlite3_reset(mod_stmt);
+            if (!ok)
+                return false;
+        }
+    }
+    return true;
+}
+
+void SqliteDataStore::ReplaceItems(const std::vector<ItemRecord> &items) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Exec("SAVEPOINT replace_items");
+    Exec("DELETE FROM item_mods");
+    Exec("DELETE FROM items");
+    if (!InsertItems(items)) {
+        QLOG_ERROR() << "Failed to store items:" << sqlite3_errmsg(db_);
+        Exec("ROLLBACK TO replace_items");
+    }
+    Exec("RELEASE replace_items");
+}
+
+void SqliteDataStore::UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed) {
+    if (added.empty() && removed.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    Exec("SAVEPOINT update_items");
+    for (auto &uid : removed) {
+        // only one row, identical items without a uid share it
+        sqlite3_stmt *stmt = Statement("SELECT id FROM items WHERE uid = ? LIMIT 1");
+        sqlite3_bind_text(stmt, 1, uid.c_str(), -1, SQLITE_STATIC);
+        int result = sqlite3_step(stmt);
+        sqlite3_int64 id = result == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        if (result == SQLITE_DONE)
+            continue;
+        ok = result == SQLITE_ROW;
+        if (!ok)
+            break;
+        stmt = Statement("DELETE FROM item_mods WHERE item = ?");
+        sqlite3_bind_int64(stmt, 1, id);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        stmt = Statement("DELETE FROM items WHERE id = ?");
+        sqlite3_bind_int64(stmt, 1, id);
+        ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        if (!ok)
+            break;
+    }
+    ok = ok && InsertItems(added);
+
+    if (!ok) {
+        QLOG_ERROR() << "Failed to update items:" << sqlite3_errmsg(db_);
+        Exec("ROLLBACK TO update_items");
+    }
+    Exec("RELEASE update_items");
+}
+
+void SqliteDataStore::UpdateItemPrices(const std::map<std::string, ItemPrice> &prices) {
+    if (prices.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Exec("SAVEPOINT update_item_prices");
+    sqlite3_stmt *stmt = Statement("UPDATE items SET price = ?, currency = ? WHERE uid = ?");
+    for (auto &price : prices) {
+        BindPrice(stmt, 1, price.second);
+        sqlite3_bind_text(stmt, 3, price.first.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+            QLOG_ERROR() << "Failed to update the price of" << price.first.c_str() << ":" << sqlite3_errmsg(db_);
+        sqlite3_reset(stmt);
+    }
+    Exec("RELEASE update_item_prices");
+}
+
+std::vector<ItemRecord> SqliteDataStore::GetItemsByHash(const std::string &hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT id, uid, tab, category, frame_type, price, currency FROM items WHERE hash = ?");
+    sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_STATIC);
+    std::vector<ItemRecord> result;
+    std::vector<sqlite3_int64> ids;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ItemRecord item;
+        item.hash = hash;
+        ids.push_back(sqlite3_column_int64(stmt, 0));
+        item.uid = ColumnText(stmt, 1);
+        item.tab = ColumnText(stmt, 2);
+        item.category = ColumnText(stmt, 3);
+        item.frame_type = sqlite3_column_int(stmt, 4);
+        if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
+            item.price.value = sqlite3_column_double(stmt, 5);
+            item.price.currency = ColumnText(stmt, 6);
+        }
+        result.push_back(item);
+    }
+    sqlite3_reset(stmt);
+
+    stmt = Statement("SELECT mod, value FROM item_mods WHERE item = ?");
+    for (size_t i = 0; i < ids.size(); ++i) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, ids[i]);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            result[i].mods[ColumnText(stmt, 0)] = sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_reset(stmt);
+    return result;
+}
+
+std::map<std::string, int> SqliteDataStore::CountItemsByTab() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt = Statement("SELECT tab, COUNT(*) FROM items GROUP BY tab");
+    std::map<std::string, int> result;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        result[ColumnText(stmt, 0)] = sqlite3_column_int(stmt, 1);
+    sqlite3_reset(stmt);
+    return result;
+}
+
+std::map<std::string, double> SqliteDataStore::PriceTotals(const std::string &tab) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3_stmt *stmt;
+    if (tab.empty()) {
+        stmt = Statement("SELECT currency, SUM(price) FROM items WHERE currency IS NOT NULL GROUP BY currency");
+    } else {
+        stmt = Statement("SELECT currency, SUM(price) FROM items WHERE currency IS NOT NULL AND tab = ? GROUP BY currency");
+        sqlite3_bind_text(stmt, 1, tab.c_str(), -1, SQLITE_STATIC);
+    }
+    std::map<std::string, double> result;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        result[ColumnText(stmt, 0)] = sqlite3_column_double(stmt, 1);
+    sqlite3_reset(stmt);
+    return result;
+}
+
 SqliteDataStore::~SqliteDataStore() {
+    for (auto &statement : statements_)
+        sqlite3_finalize(statement.second);
     sqlite3_close(db_);
 }
 
@@ -118,3 +493,25 @@ std::string SqliteDataStore::MakeFilename(const std::string &name, const std::st
     std::string key = name + "|" + league;
     return QString(QCryptographicHash::hash(key.c_str(), QCryptographicHash::Md5).toHex()).toStdString();
 }
+
+std::string SqliteDataStore::Compress(const std::string &value) {
+    QByteArray compressed = qCompress(reinterpret_cast<const uchar*>(value.c_str()), value.size());
+    std::string result(kCompressedHeader, sizeof(kCompressedHeader));
+    result.append(compressed.constData(), compressed.size());
+    return result;
+}
+
+bool SqliteDataStore::Uncompress(const char *data, size_t size, std::string *value) {
+    if (size < sizeof(kCompressedHeader) || !std::equal(kCompressedHeader, kCompressedHeader + sizeof(kCompressedHeader), data)) {
+        // stored as is, e.g. by a version that didn't compress
+        value->assign(data, size);
+        return true;
+    }
+    QByteArray uncompressed = qUncompress(reinterpret_cast<const uchar*>(data) + sizeof(kCompressedHeader),
+                                          size - sizeof(kCompressedHeader));
+    // qUncompress gives an empty array on errors, and only non-empty values are compressed
+    if (uncompressed.isEmpty())
+        return false;
+    value->assign(uncompressed.constData(), uncompressed.size());
+    return true;
+}
@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -27,23 +29,55 @@
 class Application;
 struct CurrencyUpdate;
 struct sqlite3;
+struct sqlite3_stmt;
+
+// Values at least this big are stored compressed
+const size_t kCompressionThreshold = 4096;
 
 class SqliteDataStore : public DataStore {
 public:
-    SqliteDataStore(const std::string &filename_);
+    SqliteDataStore(const std::string &filename_, size_t compression_threshold = kCompressionThreshold);
     ~SqliteDataStore();
     void Set(const std::string &key, const std::string &value);
     std::string Get(const std::string &key, const std::string &default_value = "");
-    void InsertCurrencyUpdate(const CurrencyUpdate &update);
     std::vector<CurrencyUpdate> GetAllCurrency();
+    void InsertCurrencySamples(const std::vector<CurrencySample> &samples);
+    void ForEachCurrencySample(long long from, long long to, const std::function<bool(const CurrencySample&)> &callback);
+    void DownsampleCurrency(long long before, long long interval);
     void SetBool(const std::string &key, bool value);
     bool GetBool(const std::string &key, bool default_value = false);
     void SetInt(const std::string &key, int value);
     int GetInt(const std::string &key, int default_value = 0);
+    DataRows GetRows(const std::string &collection);
+    void UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed);
+    void BeginBatch();
+    void Commit();
+    void ReplaceItems(const std::vector<ItemRecord> &items);
+    void UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed);
+    void UpdateItemPrices(const std::map<std::string, ItemPrice> &prices);
+    std::vector<ItemRecord> GetItemsByHash(const std::string &hash);
+    std::map<std::string, int> CountItemsByTab();
+    std::map<std::string, double> PriceTotals(const std::string &tab = "");
     static std::string MakeFilename(const std::string &name, const std::string &league);
+    // Values are stored as they are, or as kCompressedHeader followed by qCompress output
+    static std::string Compress(const std::string &value);
+    static bool Uncompress(const char *data, size_t size, std::string *value);
 private:
     void CreateTable(const std::string &name, const std::string &fields);
+    void CreateIndex(const std::string &table, const std::string &columns);
+    bool HasColumn(const std::string &table, const std::string &column);
+    void Exec(const char *query);
+    // Returns the statement for query, prepared the first time it is used
+    sqlite3_stmt *Statement(const char *query);
+    // Inserts items and their mods, called with mutex_ held inside a savepoint
+    bool InsertItems(const std::vector<ItemRecord> &items);
 
     std::string filename_;
+    size_t compression_threshold_;
     sqlite3 *db_;
+    // Cached statements are shared by all threads using the data store, so
+    // only one may use the connection at a time
+    std::mutex mutex_;
+    std::map<std::string, sqlite3_stmt*> statements_;
+    int batch_depth_{0};
 };
@@ -1,8 +1,14 @@
 #include "tabcache.h"
 #include "QsLog.h"
 
-#include <QDir>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 
 // TabCache
 //
@@ -43,40 +49,287 @@
 //
 // Request(url, <flags>);
 //
-// Where <flags> can be used to force an eviction, causing a reload
+// Where <flags> can be used to mark the entry stale, causing a reload
 //   Request(url, TabCache::Refresh);
 //
 // If 'Refresh' is not specified we're guaranteed to hit in cache if entry exists
-// and fetch otherwise.
+// and fetch otherwise.  A stale entry keeps its body until the reload is
+// inserted, so a tab that didn't change isn't written again.
 //
 // So, to minimize overall API requests it will become a matter of minimizing requests
 // that ask for a refresh.  From the point of view of the rest of the application it will
 // always appear as if we request all the tabs.
+//
+// Storage
+//
+// Bodies are stored compressed under blobs/<sha1 of the body>, so tabs with
+// identical contents (empty tabs, or a tab refreshed without changes) share
+// one file, and reads can check that the body is intact.  The index maps every
+// URL to its meta data and body hash; it is kept in memory and written to
+// 'index' in least recently used first order, which is also the order entries
+// are evicted in when the cache grows past its maximum size.  Bodies that are
+// no longer used are only deleted after the index is written, so an index left
+// behind by a crash still finds the bodies it refers to.
+
+namespace {
+
+const quint32 kIndexMagic = 0x54414243;
+// version 1 didn't store when entries were inserted
+const quint32 kIndexVersion = 2;
+
+QByteArray BodyHash(const QByteArray &body) {
+    return QCryptographicHash::hash(body, QCryptographicHash::Sha1);
+}
+
+}
 
 TabCache::TabCache(QObject* parent)
-    :QNetworkDiskCache(parent)
+    :QAbstractNetworkCache(parent)
 {
 }
 
+TabCache::~TabCache() {
+    // persists the order of recent reads
+    SaveIndex();
+    for (auto &pending : inserting_)
+        delete pending.first;
+}
+
 QNetworkRequest TabCache::Request(const QUrl &url, Flags flags) {
     QNetworkRequest request{url};
-    bool evicted = false;
+    bool expired = false;
 
     if (flags.testFlag(Refresh)) {
-        remove(url);
-        evicted = true;
+        auto it = entries_.find(url);
+        if (it != entries_.end()) {
+            // an expired entry isn't fresh, so it is fetched again
+            it->second.meta_data.setExpirationDate(QDateTime::currentDateTime().addSecs(-1));
+            index_dirty_ = true;
+            expired = true;
+        }
     }
 
-    // At this point we've evicted any request that should be refreshed, so we always
+    // At this point we've expired any entry that should be refreshed, so we always
     // tell the 'real' request to prefer but not require the entry be in the cache.
     // If it is not in the cache it will be fetched from the network regardless.
     request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, QNetworkRequest::PreferCache);
-    QLOG_DEBUG() << "Evicted:" << evicted << ":" << url.toDisplayString();
+    QLOG_DEBUG() << "Expired:" << expired << ":" << url.toDisplayString();
 
     return request;
 }
 
+void TabCache::setCacheDirectory(const QString &directory) {
+    directory_ = directory;
+    QDir dir(directory_);
+    // left behind by the QNetworkDiskCache this class used to be
+    for (auto &name : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        if (name.startsWith("data") || name == "prepared")
+            QDir(dir.filePath(name)).removeRecursively();
+    dir.mkpath("blobs");
+    LoadIndex();
+}
+
+void TabCache::setMaximumCacheSize(qint64 size) {
+    maximum_size_ = size;
+    size_t evictions = stats_.evictions;
+    Evict();
+    if (stats_.evictions != evictions)
+        index_dirty_ = true;
+}
+
+void TabCache::Sync() {
+    if (index_dirty_)
+        SaveIndex();
+}
+
+QString TabCache::BodyPath(const QByteArray &hash) const {
+    return directory_ + "/blobs/" + QString(hash.toHex());
+}
+
+void TabCache::LoadIndex() {
+    entries_.clear();
+    bodies_.clear();
+    unused_bodies_.clear();
+    lru_.clear();
+    cache_size_ = 0;
+
+    QFile file(directory_ + "/index");
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream in(&file);
+        quint32 magic, version, count;
+        in >> magic >> version >> count;
+        if (magic != kIndexMagic || version < 1 || version > kIndexVersion)
+            count = 0;
+        QDateTime now = QDateTime::currentDateTime();
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            QUrl url;
+            Entry entry;
+            in >> url >> entry.meta_data >> entry.hash;
+            QDateTime expiration = entry.meta_data.expirationDate();
+            if (version >= 2)
+                in >> entry.stored;
+            else
+                entry.stored = expiration.addDays(-kCacheExpireInDays);
+            if (in.status() != QDataStream::Ok || entries_.count(url))
+                break;
+            if (expiration.isValid() && expiration < now)
+                continue;
+            auto body = bodies_.find(entry.hash);
+            if (body == bodies_.end()) {
+                QFileInfo info(BodyPath(entry.hash));
+                if (!info.exists()) {
+                    ++stats_.corrupt;
+                    continue;
+                }
+                body = bodies_.insert({ entry.hash, Body{ info.size(), 0 } }).first;
+                cache_size_ += info.size();
+            }
+            ++body->second.refs;
+            entry.lru = lru_.insert(lru_.end(), url);
+            entries_[url] = entry;
+        }
+    }
+
+    // bodies of entries that expired, or that were written just before a crash
+    QDir blobs(directory_ + "/blobs");
+    for (auto &name : blobs.entryList(QDir::Files))
+        if (!bodies_.count(QByteArray::fromHex(name.toLatin1())))
+            blobs.remove(name);
+
+    QLOG_DEBUG() << "Tab cache has" << entries_.size() << "entries with" << bodies_.size() << "distinct bodies,"
+                 << cache_size_ / 1024 << "kB";
+}
+
+void TabCache::SaveIndex() {
+    if (directory_.isEmpty())
+        return;
+    QSaveFile file(directory_ + "/index");
+    if (!file.open(QIODevice::WriteOnly)) {
+        QLOG_WARN() << "Failed to write the tab cache index:" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out << kIndexMagic << kIndexVersion << static_cast<quint32>(entries_.size());
+    for (auto &url : lru_) {
+        auto &entry = entries_.at(url);
+        out << url << entry.meta_data << entry.hash << entry.stored;
+    }
+    if (!file.commit()) {
+        QLOG_WARN() << "Failed to write the tab cache index:" << file.errorString();
+        return;
+    }
+    index_dirty_ = false;
+    for (auto &hash : unused_bodies_)
+        if (!bodies_.count(hash))
+            QFile::remove(BodyPath(hash));
+    unused_bodies_.clear();
+}
+
+void TabCache::RemoveEntry(std::map<QUrl, Entry>::iterator it) {
+    auto body = bodies_.find(it->second.hash);
+    if (body != bodies_.end() && --body->second.refs == 0) {
+        unused_bodies_.insert(body->first);
+        cache_size_ -= body->second.size;
+        bodies_.erase(body);
+    }
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+void TabCache::Touch(Entry *entry) {
+    lru_.splice(lru_.end(), lru_, entry->lru);
+}
+
+void TabCache::Evict() {
+    if (maximum_size_ <= 0)
+        return;
+    while (cache_size_ > maximum_size_ && !lru_.empty()) {
+        RemoveEntry(entries_.find(lru_.front()));
+        ++stats_.evictions;
+    }
+}
+
+QDateTime TabCache::stored(const QUrl &url) const {
+    auto it = entries_.find(url);
+    return it == entries_.end() ? QDateTime() : it->second.stored;
+}
+
+QNetworkCacheMetaData TabCache::metaData(const QUrl &url) {
+    auto it = entries_.find(url);
+    if (it == entries_.end())
+        return QNetworkCacheMetaData();
+    return it->second.meta_data;
+}
+
+void TabCache::updateMetaData(const QNetworkCacheMetaData &metaData) {
+    auto it = entries_.find(metaData.url());
+    if (it == entries_.end())
+        return;
+    it->second.meta_data = metaData;
+    index_dirty_ = true;
+}
+
+QIODevice *TabCache::data(const QUrl &url) {
+    auto it = entries_.find(url);
+    if (it == entries_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+
+    QByteArray body;
+    QFile file(BodyPath(it->second.hash));
+    if (file.open(QIODevice::ReadOnly))
+        body = qUncompress(file.readAll());
+    if (BodyHash(body) != it->second.hash) {
+        QLOG_WARN() << "Dropping damaged tab cache entry for" << url.toDisplayString();
+        // the body is just as damaged for every other entry sharing it
+        QByteArray hash = it->second.hash;
+        for (auto entry = entries_.begin(); entry != entries_.end();) {
+            if (entry->second.hash == hash) {
+                RemoveEntry(entry++);
+                ++stats_.corrupt;
+            } else {
+                ++entry;
+            }
+        }
+        // no use keeping it around for the index on disk
+        QFile::remove(BodyPath(hash));
+        unused_bodies_.erase(hash);
+        ++stats_.misses;
+        index_dirty_ = true;
+        return nullptr;
+    }
+
+    Touch(&it->second);
+    ++stats_.hits;
+    stats_.bytes_read += body.size();
+    QBuffer *buffer = new QBuffer;
+    buffer->setData(body);
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
+
+bool TabCache::remove(const QUrl &url) {
+    for (auto it = inserting_.begin(); it != inserting_.end();) {
+        if (it->second.url() == url) {
+            delete it->first;
+            it = inserting_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    auto it = entries_.find(url);
+    if (it == entries_.end())
+        return false;
+    RemoveEntry(it);
+    index_dirty_ = true;
+    return true;
+}
+
 QIODevice *TabCache::prepare(const QNetworkCacheMetaData &metaData) {
+    if (directory_.isEmpty() || !metaData.isValid())
+        return nullptr;
+
     QNetworkCacheMetaData local{metaData};
 
     //Default policy based on received HTTP headers is to not save to disk.
@@ -105,6 +358,69 @@ QIODevice *TabCache::prepare(const QNetworkCacheMetaData &metaData) {
     }
     local.setRawHeaders(headers);
 
-    return QNetworkDiskCache::prepare(local);
+    QBuffer *buffer = new QBuffer;
+    buffer->open(QIODevice::ReadWrite);
+    inserting_[buffer] = local;
+    return buffer;
+}
+
+void TabCache::insert(QIODevice *device) {
+    auto pending = inserting_.find(device);
+    if (pending == inserting_.end()) {
+        QLOG_WARN() << "Tab cache asked to insert a device it didn't prepare";
+        return;
+    }
+    QNetworkCacheMetaData meta_data = pending->second;
+    inserting_.erase(pending);
+    QByteArray body = static_cast<QBuffer*>(device)->data();
+    delete device;
+
+    QUrl url = meta_data.url();
+    QByteArray hash = BodyHash(body);
+    ++stats_.inserts;
+    auto it = entries_.find(url);
+    if (it != entries_.end()) {
+        if (it->second.hash == hash) {
+            // refreshed without changes
+            it->second.meta_data = meta_data;
+            it->second.stored = QDateTime::currentDateTime();
+            Touch(&it->second);
+            ++stats_.deduplicated;
+            index_dirty_ = true;
+            return;
+        }
+        RemoveEntry(it);
+    }
+
+    auto body_it = bodies_.find(hash);
+    if (body_it == bodies_.end()) {
+        QByteArray compressed = qCompress(body);
+        QSaveFile file(BodyPath(hash));
+        if (!file.open(QIODevice::WriteOnly) || file.write(compressed) != compressed.size() || !file.commit()) {
+            QLOG_WARN() << "Failed to write the tab cache entry for" << url.toDisplayString() << ":" << file.errorString();
+            index_dirty_ = true;
+            return;
+        }
+        body_it = bodies_.insert({ hash, Body{ compressed.size(), 0 } }).first;
+        cache_size_ += compressed.size();
+        stats_.bytes_written += compressed.size();
+    } else {
+        ++stats_.deduplicated;
+    }
+    ++body_it->second.refs;
+
+    Entry entry;
+    entry.meta_data = meta_data;
+    entry.hash = hash;
+    entry.stored = QDateTime::currentDateTime();
+    entry.lru = lru_.insert(lru_.end(), url);
+    entries_[url] = entry;
+    Evict();
+    index_dirty_ = true;
 }
 
+void TabCache::clear() {
+    while (!entries_.empty())
+        RemoveEntry(entries_.begin());
+    index_dirty_ = true;
+}
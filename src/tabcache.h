@@ -2,11 +2,30 @@
 
 #include <QObject>
 #include <QAbstractNetworkCache>
-#include <QNetworkDiskCache>
+#include <QDateTime>
 #include <QIODevice>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <list>
+#include <map>
 #include <set>
 
-class TabCache : public QNetworkDiskCache
+struct TabCacheStats {
+    // data() calls that found a valid entry, and the bytes they returned
+    size_t hits{0};
+    size_t misses{0};
+    qint64 bytes_read{0};
+    size_t inserts{0};
+    // inserted bodies that were already stored
+    size_t deduplicated{0};
+    // compressed bytes written for new bodies
+    qint64 bytes_written{0};
+    size_t evictions{0};
+    // entries dropped because their body was missing or damaged
+    size_t corrupt{0};
+};
+
+class TabCache : public QAbstractNetworkCache
 {
     Q_OBJECT
 
@@ -20,15 +39,72 @@ public:
 public:
     TabCache(QObject * parent = 0);
 
-    ~TabCache() {};
+    ~TabCache();
 
     QNetworkRequest Request(const QUrl & url, Flags flags = None);
 
+    // Loads the index of the cache in directory, creating it if needed
+    void setCacheDirectory(const QString &directory);
+    void setMaximumCacheSize(qint64 size);
+    // Writes the index if it changed since it was last written.  Changes are
+    // only written here and on destruction, so call this once per refresh.
+    void Sync();
+    const TabCacheStats &stats() const { return stats_; }
+    size_t entry_count() const { return entries_.size(); }
+    // Number of distinct bodies stored
+    size_t body_count() const { return bodies_.size(); }
+    // When a body for url was last inserted, invalid if there is none
+    QDateTime stored(const QUrl &url) const;
+
+    QNetworkCacheMetaData metaData(const QUrl &url);
+    void updateMetaData(const QNetworkCacheMetaData &metaData);
+    QIODevice *data(const QUrl &url);
+    bool remove(const QUrl &url);
+    qint64 cacheSize() const { return cache_size_; }
     QIODevice *prepare(const QNetworkCacheMetaData &metaData);
+    void insert(QIODevice *device);
+
+public slots:
+    void clear();
 
 private:
+    struct Entry {
+        QNetworkCacheMetaData meta_data;
+        // hash of the uncompressed body, which is stored under BodyPath(hash)
+        QByteArray hash;
+        QDateTime stored;
+        // position in lru_
+        std::list<QUrl>::iterator lru;
+    };
+    struct Body {
+        // compressed size on disk
+        qint64 size;
+        // number of entries with this body
+        int refs;
+    };
+
+    QString BodyPath(const QByteArray &hash) const;
+    void LoadIndex();
+    void SaveIndex();
+    void RemoveEntry(std::map<QUrl, Entry>::iterator it);
+    void Touch(Entry *entry);
+    void Evict();
+
+    QString directory_;
+    qint64 maximum_size_{0};
+    qint64 cache_size_{0};
+    bool index_dirty_{false};
+    std::map<QUrl, Entry> entries_;
+    std::map<QByteArray, Body> bodies_;
+    // bodies no entry uses anymore, only deleted once an index without them is
+    // written: until then the index on disk may still refer to them
+    std::set<QByteArray> unused_bodies_;
+    // least recently used first
+    std::list<QUrl> lru_;
+    // devices handed out by prepare() that weren't inserted or removed yet
+    std::map<QIODevice*, QNetworkCacheMetaData> inserting_;
+    TabCacheStats stats_;
     const int kCacheExpireInDays{7};
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(TabCache::Flags)
-
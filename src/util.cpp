@@ -27,7 +27,6 @@
 #include <QLabel>
 #include <QFontMetrics>
 #include <QNetworkReply>
-#include <QTextDocument>
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 #include <sstream>
@@ -218,12 +217,6 @@ std::string Util::TimeAgoInWords(const QDateTime buyout_time){
     }
 }
 
-std::string Util::Decode(const std::string &entity) {
-    QTextDocument text;
-    text.setHtml(entity.c_str());
-    return text.toPlainText().toStdString();
-}
-
 QDebug &operator<<(QDebug &os, const RefreshReason::Type &obj)
 {
     const QMetaObject *meta = &RefreshReason::staticMetaObject;
@@ -102,6 +102,4 @@ bool MatchMod(const char *match, const char *mod, double *output);
 std::string Capitalise(const std::string &str);
 
 std::string TimeAgoInWords(const QDateTime buyout_time);
-
-std::string Decode(const std::string &entity);
 }
@@ -0,0 +1,401 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "writebehinddatastore.h"
+
+#include <QElapsedTimer>
+#include <algorithm>
+#include <chrono>
+
+#include "QsLog.h"
+
+#include "currencymanager.h"
+
+size_t WriteBehindDataStore::Pending::size() const {
+    size_t result = values.size() + currency.size() + downsample.size() + items.size() + added_items.size()
+        + removed_items.size() + prices.size();
+    for (auto &collection : rows)
+        result += collection.second.changed.size() + collection.second.removed.size();
+    return result;
+}
+
+WriteBehindDataStore::WriteBehindDataStore(std::unique_ptr<DataStore> backend) :
+    backend_(std::move(backend))
+{
+    thread_ = std::thread(&WriteBehindDataStore::Run, this);
+}
+
+WriteBehindDataStore::~WriteBehindDataStore() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    queue_changed_.notify_all();
+    thread_.join();
+    QLOG_DEBUG() << "Write-behind data store did" << stats_.flushes << "flushes, coalesced" << stats_.coalesced
+                 << "writes, max queue depth" << stats_.max_queue_depth << "max flush" << stats_.max_flush_ms << "ms";
+}
+
+void WriteBehindDataStore::Queued(size_t replaced) {
+    ++written_;
+    stats_.coalesced += replaced;
+    stats_.queue_depth = pending_.size();
+    stats_.max_queue_depth = std::max(stats_.max_queue_depth, stats_.queue_depth);
+}
+
+void WriteBehindDataStore::Set(const std::string &key, const std::string &value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t replaced = pending_.values.count(key);
+        pending_.values[key] = value;
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+std::string WriteBehindDataStore::Get(const std::string &key, const std::string &default_value) {
+    {
+        // Anything not queued here has already reached the backend
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.values.find(key);
+        if (it != pending_.values.end())
+            return it->second;
+        it = in_flight_.values.find(key);
+        if (it != in_flight_.values.end())
+            return it->second;
+    }
+    return backend_->Get(key, default_value);
+}
+
+std::vector<CurrencyUpdate> WriteBehindDataStore::GetAllCurrency() {
+    // nothing writes these anymore
+    return backend_->GetAllCurrency();
+}
+
+void WriteBehindDataStore::InsertCurrencySamples(const std::vector<CurrencySample> &samples) {
+    if (samples.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t replaced = 0;
+        for (auto &sample : samples) {
+            auto key = std::make_pair(sample.timestamp, sample.currency);
+            replaced += pending_.currency.count(key);
+            pending_.currency[key] = sample;
+        }
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::ForEachCurrencySample(long long from, long long to,
+                                                 const std::function<bool(const CurrencySample&)> &callback) {
+    FlushCurrency();
+    backend_->ForEachCurrencySample(from, to, callback);
+}
+
+void WriteBehindDataStore::DownsampleCurrency(long long before, long long interval) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.downsample.push_back(std::make_pair(before, interval));
+        Queued(0);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::SetBool(const std::string &key, bool value) {
+    SetInt(key, static_cast<int>(value));
+}
+
+bool WriteBehindDataStore::GetBool(const std::string &key, bool default_value) {
+    return static_cast<bool>(GetInt(key, static_cast<int>(default_value)));
+}
+
+void WriteBehindDataStore::SetInt(const std::string &key, int value) {
+    Set(key, std::to_string(value));
+}
+
+int WriteBehindDataStore::GetInt(const std::string &key, int default_value) {
+    return std::stoi(Get(key, std::to_string(default_value)));
+}
+
+void WriteBehindDataStore::ApplyRows(const std::map<std::string, PendingRows> &rows, const std::string &collection,
+        DataRows *result) {
+    auto it = rows.find(collection);
+    if (it == rows.end())
+        return;
+    for (auto &row : it->second.changed)
+        (*result)[row.first] = row.second;
+    for (auto &key : it->second.removed)
+        result->erase(key);
+}
+
+DataRows WriteBehindDataStore::GetRows(const std::string &collection) {
+    // Take the queued rows before reading the backend: whatever is written in
+    // between is then both in the backend and in the overlay.
+    std::map<std::string, PendingRows> in_flight, pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = in_flight_.rows.find(collection);
+        if (it != in_flight_.rows.end())
+            in_flight[collection] = it->second;
+        it = pending_.rows.find(collection);
+        if (it != pending_.rows.end())
+            pending[collection] = it->second;
+    }
+    DataRows result = backend_->GetRows(collection);
+    ApplyRows(in_flight, collection, &result);
+    ApplyRows(pending, collection, &result);
+    return result;
+}
+
+void WriteBehindDataStore::UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed) {
+    if (changed.empty() && removed.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &rows = pending_.rows[collection];
+        size_t replaced = 0;
+        for (auto &row : changed) {
+            replaced += rows.changed.count(row.first) + rows.removed.erase(row.first);
+            rows.changed[row.first] = row.second;
+        }
+        for (auto &key : removed) {
+            replaced += rows.changed.erase(key) + rows.removed.count(key);
+            rows.removed.insert(key);
+        }
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::ReplaceItems(const std::vector<ItemRecord> &items) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the new items come with their current prices
+        size_t replaced = pending_.items.size() + pending_.prices.size();
+        pending_.replace_items = true;
+        pending_.items = items;
+        pending_.added_items.clear();
+        pending_.removed_items.clear();
+        pending_.prices.clear();
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed) {
+    if (added.empty() && removed.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t replaced = 0;
+        // the added items come with their current prices
+        for (auto &uid : removed)
+            replaced += pending_.prices.erase(uid);
+        for (auto &item : added)
+            replaced += pending_.prices.erase(item.uid);
+        if (pending_.replace_items) {
+            replaced += EraseItemRecords(&pending_.items, removed);
+            pending_.items.insert(pending_.items.end(), added.begin(), added.end());
+        } else {
+            for (auto &uid : removed) {
+                auto it = pending_.added_items.find(uid);
+                if (it != pending_.added_items.end()) {
+                    pending_.added_items.erase(it);
+                    ++replaced;
+                } else {
+                    pending_.removed_items.push_back(uid);
+                }
+            }
+            for (auto &item : added)
+                pending_.added_items.emplace(item.uid, item);
+        }
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::UpdateItemPrices(const std::map<std::string, ItemPrice> &prices) {
+    if (prices.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t replaced = 0;
+        for (auto &price : prices) {
+            replaced += pending_.prices.count(price.first);
+            pending_.prices[price.first] = price.second;
+        }
+        Queued(replaced);
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::FlushItems() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_.has_items() && !in_flight_.has_items())
+            return;
+    }
+    Flush();
+}
+
+void WriteBehindDataStore::FlushCurrency() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_.has_currency() && !in_flight_.has_currency())
+            return;
+    }
+    Flush();
+}
+
+std::vector<ItemRecord> WriteBehindDataStore::GetItemsByHash(const std::string &hash) {
+    FlushItems();
+    return backend_->GetItemsByHash(hash);
+}
+
+std::map<std::string, int> WriteBehindDataStore::CountItemsByTab() {
+    FlushItems();
+    return backend_->CountItemsByTab();
+}
+
+std::map<std::string, double> WriteBehindDataStore::PriceTotals(const std::string &tab) {
+    FlushItems();
+    return backend_->PriceTotals(tab);
+}
+
+void WriteBehindDataStore::BeginBatch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++batch_depth_;
+}
+
+void WriteBehindDataStore::Commit() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (batch_depth_ == 0) {
+            QLOG_WARN() << "Commit called without BeginBatch";
+            return;
+        }
+        --batch_depth_;
+    }
+    queue_changed_.notify_all();
+}
+
+void WriteBehindDataStore::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (batch_depth_ > 0) {
+        QLOG_WARN() << "Flush called inside a batch, the batch is written on Commit";
+        return;
+    }
+    flush_requested_ = true;
+    queue_changed_.notify_all();
+    flushed_.wait(lock, [this]() { return pending_.empty() && in_flight_.empty(); });
+    flush_requested_ = false;
+}
+
+uint64_t WriteBehindDataStore::WriteSequence() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+}
+
+uint64_t WriteBehindDataStore::StoredSequence() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // writes that cancelled each other out leave nothing to store
+    if (pending_.empty() && in_flight_.empty())
+        return written_;
+    return stored_;
+}
+
+WriteBehindStats WriteBehindDataStore::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void WriteBehindDataStore::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        queue_changed_.wait(lock, [this]() { return stop_ || (!pending_.empty() && batch_depth_ == 0); });
+        if (pending_.empty())
+            break;
+        // let more writes to the same keys come in
+        if (!stop_ && !flush_requested_)
+            queue_changed_.wait_for(lock, std::chrono::milliseconds(kWriteBehindDelay),
+                                    [this]() { return stop_ || flush_requested_; });
+        lock.unlock();
+        WriteQueued();
+        lock.lock();
+    }
+}
+
+void WriteBehindDataStore::WriteQueued() {
+    size_t depth;
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a batch that started while waiting must be written as a whole later
+        if (pending_.empty() || (batch_depth_ > 0 && !stop_))
+            return;
+        in_flight_ = std::move(pending_);
+        pending_ = Pending();
+        depth = in_flight_.size();
+        // everything queued so far is in this write
+        sequence = written_;
+        stats_.queue_depth = 0;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    backend_->BeginBatch();
+    for (auto &value : in_flight_.values)
+        backend_->Set(value.first, value.second);
+    for (auto &rows : in_flight_.rows)
+        backend_->UpdateRows(rows.first, rows.second.changed, rows.second.removed);
+    if (!in_flight_.currency.empty()) {
+        std::vector<CurrencySample> samples;
+        samples.reserve(in_flight_.currency.size());
+        for (auto &sample : in_flight_.currency)
+            samples.push_back(sample.second);
+        backend_->InsertCurrencySamples(samples);
+    }
+    for (auto &downsample : in_flight_.downsample)
+        backend_->DownsampleCurrency(downsample.first, downsample.second);
+    if (in_flight_.replace_items)
+        backend_->ReplaceItems(in_flight_.items);
+    if (!in_flight_.added_items.empty() || !in_flight_.removed_items.empty()) {
+        std::vector<ItemRecord> added;
+        added.reserve(in_flight_.added_items.size());
+        for (auto &item : in_flight_.added_items)
+            added.push_back(item.second);
+        backend_->UpdateItems(added, in_flight_.removed_items);
+    }
+    backend_->UpdateItemPrices(in_flight_.prices);
+    backend_->Commit();
+    double elapsed = timer.nsecsElapsed() / 1e6;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_ = Pending();
+        stored_ = sequence;
+        ++stats_.flushes;
+        stats_.last_flush_ms = elapsed;
+        stats_.max_flush_ms = std::max(stats_.max_flush_ms, elapsed);
+    }
+    flushed_.notify_all();
+    QLOG_DEBUG() << "Wrote" << depth << "queued changes in" << elapsed << "ms";
+}
@@ -0,0 +1,141 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "datastore.h"
+
+// How long the I/O thread waits for more writes before storing them, in ms
+const int kWriteBehindDelay = 100;
+
+struct WriteBehindStats {
+    // changes waiting to be written right now
+    size_t queue_depth{0};
+    size_t max_queue_depth{0};
+    // writes that were replaced by a later write to the same key before reaching the backend
+    size_t coalesced{0};
+    size_t flushes{0};
+    double last_flush_ms{0};
+    double max_flush_ms{0};
+};
+
+/*
+ * Decorates a DataStore so that writes return right away and are stored by a
+ * dedicated I/O thread.  Writes to the same key that happen before the thread
+ * gets to them are coalesced, and everything queued at once is stored in a
+ * single batch.  Reads see all earlier writes, whether they reached the
+ * backend yet or not (item and currency queries wait for queued writes of theirs to be stored).
+ * The destructor stores everything that is still queued.
+ */
+class WriteBehindDataStore : public DataStore {
+public:
+    explicit WriteBehindDataStore(std::unique_ptr<DataStore> backend);
+    ~WriteBehindDataStore();
+    void Set(const std::string &key, const std::string &value);
+    std::string Get(const std::string &key, const std::string &default_value = "");
+    std::vector<CurrencyUpdate> GetAllCurrency();
+    void InsertCurrencySamples(const std::vector<CurrencySample> &samples);
+    void ForEachCurrencySample(long long from, long long to, const std::function<bool(const CurrencySample&)> &callback);
+    void DownsampleCurrency(long long before, long long interval);
+    void SetBool(const std::string &key, bool value);
+    bool GetBool(const std::string &key, bool default_value = false);
+    void SetInt(const std::string &key, int value);
+    int GetInt(const std::string &key, int default_value = 0);
+    DataRows GetRows(const std::string &collection);
+    void UpdateRows(const std::string &collection, const DataRows &changed, const std::set<std::string> &removed);
+    // Writes queued between BeginBatch and Commit are only stored after the outermost Commit,
+    // all in the same backend batch.
+    void BeginBatch();
+    void Commit();
+    void ReplaceItems(const std::vector<ItemRecord> &items);
+    void UpdateItems(const std::vector<ItemRecord> &added, const std::vector<std::string> &removed);
+    void UpdateItemPrices(const std::map<std::string, ItemPrice> &prices);
+    std::vector<ItemRecord> GetItemsByHash(const std::string &hash);
+    std::map<std::string, int> CountItemsByTab();
+    std::map<std::string, double> PriceTotals(const std::string &tab = "");
+    // Blocks until everything queued so far is stored
+    void Flush();
+    uint64_t WriteSequence();
+    uint64_t StoredSequence();
+    WriteBehindStats stats();
+private:
+    struct PendingRows {
+        DataRows changed;
+        std::set<std::string> removed;
+    };
+    struct Pending {
+        std::map<std::string, std::string> values;
+        std::map<std::string, PendingRows> rows;
+        std::map<std::pair<long long, int>, CurrencySample> currency;
+        // (before, interval) of DownsampleCurrency calls, applied after the samples in order
+        std::vector<std::pair<long long, long long>> downsample;
+        // set if items have to be replaced by `items`, prices are applied afterwards
+        bool replace_items{false};
+        std::vector<ItemRecord> items;
+        // UpdateItems calls since, by uid.  Removing an item that is still queued
+        // cancels its addition, the rest is deleted before added ones are stored.
+        std::multimap<std::string, ItemRecord> added_items;
+        std::vector<std::string> removed_items;
+        std::map<std::string, ItemPrice> prices;
+        bool empty() const {
+            return values.empty() && rows.empty() && currency.empty() && downsample.empty() && !has_items();
+        }
+        bool has_items() const {
+            return replace_items || !added_items.empty() || !removed_items.empty() || !prices.empty();
+        }
+        bool has_currency() const { return !currency.empty() || !downsample.empty(); }
+        size_t size() const;
+    };
+    static void ApplyRows(const std::map<std::string, PendingRows> &rows, const std::string &collection, DataRows *result);
+    void Run();
+    void WriteQueued();
+    // Item queries go to the backend, so queued item writes have to be stored first
+    void FlushItems();
+    // Same for currency queries
+    void FlushCurrency();
+    // Called with mutex_ held after something was queued
+    void Queued(size_t replaced);
+
+    std::unique_ptr<DataStore> backend_;
+    // Protects everything below
+    std::mutex mutex_;
+    std::condition_variable queue_changed_;
+    std::condition_variable flushed_;
+    // written by the user, not handed to the I/O thread yet
+    Pending pending_;
+    // being written by the I/O thread
+    Pending in_flight_;
+    int batch_depth_{0};
+    bool flush_requested_{false};
+    // sequence numbers of the last queued and the last stored write
+    uint64_t written_{0};
+    uint64_t stored_{0};
+    bool stop_{false};
+    WriteBehindStats stats_;
+    std::thread thread_;
+};
@@ -0,0 +1,127 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mockforum.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrlQuery>
+#include <algorithm>
+
+namespace {
+
+const std::string kEditThread = "/forum/edit-thread/";
+const std::string kVerify = "/verify/";
+const char kToken[] = "0123456789abcdef";
+
+QByteArray Response(const QByteArray &status, const QByteArray &body, const QByteArray &headers = QByteArray()) {
+    return "HTTP/1.1 " + status + "\r\n"
+        + "Content-Type: text/html\r\n"
+        + "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+        + "Connection: close\r\n"
+        + headers
+        + "\r\n"
+        + body;
+}
+
+}
+
+MockForum::MockForum(QObject *parent):
+    QObject(parent)
+{
+    connect(&server_, &QTcpServer::newConnection, this, &MockForum::OnConnection);
+    server_.listen(QHostAddress::LocalHost);
+}
+
+std::string MockForum::edit_thread_url() const {
+    return "http://127.0.0.1:" + std::to_string(server_.serverPort()) + kEditThread;
+}
+
+std::string MockForum::verify_url() const {
+    return "http://127.0.0.1:" + std::to_string(server_.serverPort()) + kVerify;
+}
+
+void MockForum::OnConnection() {
+    while (QTcpSocket *socket = server_.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &MockForum::OnReadyRead);
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        connect(socket, &QTcpSocket::destroyed, this, [this, socket]() { buffers_.erase(socket); });
+    }
+}
+
+void MockForum::OnReadyRead() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    QByteArray &buffer = buffers_[socket];
+    buffer += socket->readAll();
+
+    int header_end = buffer.indexOf("\r\n\r\n");
+    if (header_end < 0)
+        return;
+    QList<QByteArray> lines = buffer.left(header_end).split('\n');
+    QList<QByteArray> request_line = lines.value(0).trimmed().split(' ');
+    int content_length = 0;
+    for (auto &line : lines) {
+        int colon = line.indexOf(':');
+        if (colon > 0 && line.left(colon).trimmed().toLower() == "content-length")
+            content_length = line.mid(colon + 1).trimmed().toInt();
+    }
+    if (buffer.size() < header_end + 4 + content_length)
+        return;
+
+    QByteArray body = buffer.mid(header_end + 4, content_length);
+    QByteArray response = Handle(request_line.value(0), request_line.value(1).toStdString(), body);
+    buffer.clear();
+
+    ++concurrent_;
+    max_concurrent_ = std::max(max_concurrent_, concurrent_);
+    QTimer::singleShot(delay_, socket, [this, socket, response]() {
+        --concurrent_;
+        socket->write(response);
+        socket->disconnectFromHost();
+    });
+}
+
+QByteArray MockForum::Handle(const QByteArray &method, const std::string &path, const QByteArray &body) {
+    ++requests_;
+    if (path.compare(0, kVerify.size(), kVerify) == 0) {
+        ++verified_;
+        return Response("200 OK", "verified");
+    }
+    if (path.compare(0, kEditThread.size(), kEditThread) != 0)
+        return Response("404 Not Found", "Not found");
+    if (rate_limited_ > 0) {
+        --rate_limited_;
+        ++limited_requests_;
+        return Response("429 Too Many Requests", "Slow down", "Retry-After: 0\r\n");
+    }
+
+    std::string thread = path.substr(kEditThread.size());
+    if (missing_.count(thread))
+        return Response("404 Not Found", "Not found");
+    if (method == "POST") {
+        QUrlQuery query(QString::fromUtf8(body));
+        if (query.queryItemValue("hash") != kToken)
+            return Response("200 OK", "<ul class=\"errors\"><li>Invalid token</li></ul>");
+        posts_[thread] = query.queryItemValue("content", QUrl::FullyDecoded).toStdString();
+        return Response("200 OK", "Thread updated");
+    }
+    return Response("200 OK", QByteArray("<form><input type=\"hidden\" name=\"hash\" value=\"") + kToken + "\">"
+        + "<input type=\"text\" name=\"title\" id=\"title\" onkeypress=\"return&#x20;event.keyCode&#x21;&#x3D;13\" value=\"Shop "
+        + thread.c_str() + "\"></form>");
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QTcpServer>
+#include <map>
+#include <set>
+#include <string>
+
+class QTcpSocket;
+
+/*
+ * A local HTTP server that answers like the forum's edit-thread pages and the
+ * poe.trade verification url, for testing shop submission.  Every connection
+ * carries one request and is closed after the response.
+ */
+class MockForum : public QObject {
+    Q_OBJECT
+public:
+    explicit MockForum(QObject *parent = nullptr);
+    // e.g. http://127.0.0.1:1234/forum/edit-thread/
+    std::string edit_thread_url() const;
+    std::string verify_url() const;
+    // Holds every response back for ms, so requests overlap
+    void SetDelay(int ms) { delay_ = ms; }
+    // Answers the next count requests with 429 Too Many Requests
+    void SetRateLimited(int count) { rate_limited_ = count; }
+    // Answers requests for thread with 404 Not Found
+    void SetMissing(const std::string &thread) { missing_.insert(thread); }
+    // Content posted to each thread
+    const std::map<std::string, std::string> &posts() const { return posts_; }
+    int requests() const { return requests_; }
+    int limited_requests() const { return limited_requests_; }
+    // The most requests that were being answered at the same time
+    int max_concurrent() const { return max_concurrent_; }
+    int verified() const { return verified_; }
+private slots:
+    void OnConnection();
+    void OnReadyRead();
+private:
+    QByteArray Handle(const QByteArray &method, const std::string &path, const QByteArray &body);
+
+    // before server_, which deletes the sockets that erase themselves from it
+    std::map<QTcpSocket*, QByteArray> buffers_;
+    QTcpServer server_;
+    int delay_{0};
+    int rate_limited_{0};
+    std::set<std::string> missing_;
+    std::map<std::string, std::string> posts_;
+    int requests_{0};
+    int limited_requests_{0};
+    int concurrent_{0};
+    int max_concurrent_{0};
+    int verified_{0};
+};
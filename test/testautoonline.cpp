@@ -0,0 +1,88 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testautoonline.h"
+
+#include <QSignalSpy>
+#include <QTemporaryDir>
+
+#include "autoonline.h"
+#include "memorydatastore.h"
+
+namespace {
+
+// Adds a process to a directory laid out like /proc
+void AddProcess(const QTemporaryDir &proc, const QString &pid, const QByteArray &command_line) {
+    QDir(proc.path()).mkdir(pid);
+    QFile file(proc.path() + "/" + pid + "/cmdline");
+    file.open(QIODevice::WriteOnly);
+    file.write(command_line);
+}
+
+}
+
+void TestAutoOnline::ProcessScan() {
+    QTemporaryDir proc;
+    QVERIFY2(proc.isValid(), "Failed to create a temporary directory");
+    AddProcess(proc, "1", QByteArray("/sbin/init\0splash", 17));
+    AddProcess(proc, "self", "PathOfExile");
+    QVERIFY2(!IsProcessRunning(proc.path(), "PathOfExile"), "Only directories named by a pid are processes");
+
+    AddProcess(proc, "4242", QByteArray("wine\0C:\\Games\\PathOfExile_x64.exe\0", 34));
+    QVERIFY(IsProcessRunning(proc.path(), "PathOfExile"));
+    QVERIFY(!IsProcessRunning(proc.path() + "/missing", "PathOfExile"));
+}
+
+void TestAutoOnline::RemoteScript() {
+#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+    MemoryDataStore data, sensitive_data;
+    AutoOnline online(data, sensitive_data);
+    QSignalSpy updates(&online, &AutoOnline::Update);
+
+    online.SetRemoteScript("exit 0");
+    online.Check();
+    QVERIFY2(updates.isEmpty(), "The script must not be waited for");
+    QTRY_VERIFY_WITH_TIMEOUT(updates.count() == 1, 5000);
+    QVERIFY(updates[0][0].toBool());
+
+    online.SetRemoteScript("exit 1");
+    online.Check();
+    QTRY_VERIFY_WITH_TIMEOUT(updates.count() == 2, 5000);
+    QVERIFY(!updates[1][0].toBool());
+#endif
+}
+
+void TestAutoOnline::RemoteScriptTimeout() {
+#if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+    MemoryDataStore data, sensitive_data;
+    AutoOnline online(data, sensitive_data);
+    QSignalSpy updates(&online, &AutoOnline::Update);
+
+    online.SetRemoteScriptTimeout(100);
+    online.SetRemoteScript("sleep 10");
+    online.Check();
+    QTest::qWait(1000);
+    QVERIFY2(updates.isEmpty(), "A script that was stopped must not change the status");
+
+    online.SetRemoteScript("exit 0");
+    online.Check();
+    QTRY_VERIFY_WITH_TIMEOUT(updates.count() == 1, 5000);
+    QVERIFY2(updates[0][0].toBool(), "Checks must go on after a script timed out");
+#endif
+}
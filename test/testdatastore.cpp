@@ -0,0 +1,368 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testdatastore.h"
+
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <limits>
+
+#include "buyoutmanager.h"
+#include "porting.h"
+#include "sqlitedatastore.h"
+#include "testdata.h"
+#include "writebehinddatastore.h"
+
+namespace {
+
+const int kBenchmarkWrites = 1000;
+// Number of items of the "large account" saved by the compression benchmark
+const int kBenchmarkItems = 1000;
+
+CurrencySample Sample(long long timestamp, int currency, double count) {
+    CurrencySample sample;
+    sample.timestamp = timestamp;
+    sample.currency = currency;
+    sample.count = count;
+    sample.chaos_value = count * 2;
+    return sample;
+}
+
+// Timestamps of the snapshots from..to in the data store
+std::vector<long long> Snapshots(DataStore &data, long long from, long long to) {
+    std::vector<long long> result;
+    data.ForEachCurrencySample(from, to, [&](const CurrencySample &sample) {
+        if (result.empty() || result.back() != sample.timestamp)
+            result.push_back(sample.timestamp);
+        return true;
+    });
+    return result;
+}
+
+// Items JSON as ItemsManagerWorker saves it
+std::string AccountItems(int count) {
+    const std::vector<const std::string*> items = { &kItem1, &kCategoriesItemBelt, &kCategoriesItemBow,
+        &kCategoriesItemClaw, &kCategoriesItemVaalGem, &kSocketedItem };
+    std::string result = "[";
+    for (int i = 0; i < count; ++i) {
+        if (i > 0)
+            result += ",";
+        result += *items[i % items.size()];
+    }
+    return result + "]";
+}
+
+qint64 DatabaseSize(const std::string &filename) {
+    return QFileInfo(QString::fromStdString(filename)).size() + QFileInfo(QString::fromStdString(filename + "-wal")).size();
+}
+
+}
+
+void TestDataStore::SqliteBatch() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string filename = (dir.path() + "/data").toStdString();
+    SqliteDataStore data(filename);
+
+    data.BeginBatch();
+    data.Set("first", "1");
+    data.BeginBatch();
+    data.SetInt("second", 2);
+    data.Commit();
+    QVERIFY2(data.Get("first") == "1" && data.GetInt("second") == 2, "Writes must be visible inside a batch");
+    {
+        SqliteDataStore other(filename);
+        QVERIFY2(other.Get("first").empty(), "A batch must not be visible to others before the outermost Commit");
+    }
+    data.Commit();
+
+    SqliteDataStore other(filename);
+    QVERIFY2(other.Get("first") == "1" && other.GetInt("second") == 2, "A committed batch must be stored");
+    QVERIFY2(QFile::exists(QString::fromStdString(filename + "-wal")), "The database must use a write-ahead log");
+}
+
+void TestDataStore::SqliteRows() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    SqliteDataStore data((dir.path() + "/data").toStdString());
+
+    data.UpdateRows("rows", { { "a", "1" }, { "b", "2" } }, {});
+    data.BeginBatch();
+    data.UpdateRows("rows", { { "c", "3" } }, { "a" });
+    data.Set("key", "value");
+    data.Commit();
+
+    DataRows expected = { { "b", "2" }, { "c", "3" } };
+    QVERIFY2(data.GetRows("rows") == expected, "Rows must be updated inside and outside of batches");
+    QVERIFY2(data.Get("key") == "value", "Cached statements must work for every query");
+}
+
+void TestDataStore::SqliteWrites_data() {
+    QTest::addColumn<bool>("batch");
+    QTest::newRow("autocommit") << false;
+    QTest::newRow("batch") << true;
+}
+
+// Writes kBenchmarkWrites keys either each in its own transaction, which is
+// what every Set did before batches, or all in one batch.
+void TestDataStore::SqliteWrites() {
+    QFETCH(bool, batch);
+
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    SqliteDataStore data((dir.path() + "/data").toStdString());
+
+    qint64 elapsed = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        if (batch)
+            data.BeginBatch();
+        for (int i = 0; i < kBenchmarkWrites; ++i)
+            data.Set("key" + std::to_string(i), "value" + std::to_string(i));
+        if (batch)
+            data.Commit();
+        elapsed = timer.nsecsElapsed();
+    }
+    qDebug() << QTest::currentDataTag() << kBenchmarkWrites * 1e9 / std::max<qint64>(elapsed, 1) << "writes/s";
+    QVERIFY(data.Get("key0") == "value0");
+}
+
+void TestDataStore::SqliteItems() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    SqliteDataStore data((dir.path() + "/data").toStdString());
+
+    ItemRecord gem;
+    gem.uid = "gem id";
+    gem.hash = "gem";
+    gem.tab = "first";
+    gem.category = "gems";
+    gem.frame_type = 4;
+    gem.price.value = 5;
+    gem.price.currency = "chaos";
+    ItemRecord belt;
+    belt.uid = "belt id";
+    belt.hash = "belt";
+    belt.tab = "second";
+    belt.category = "belts";
+    belt.mods["+# to maximum Life"] = 40;
+    data.ReplaceItems({ gem, belt });
+
+    auto found = data.GetItemsByHash("belt");
+    QVERIFY2(found.size() == 1 && found.front().category == "belts" && found.front().mods == belt.mods,
+             "Items must be found by hash with their mods");
+    QVERIFY2(found.front().price.currency.empty(), "Items without a price must not get one");
+    auto counts = data.CountItemsByTab();
+    QVERIFY2(counts["first"] == 1 && counts["second"] == 1, "Items must be counted per tab");
+
+    ItemPrice price;
+    price.value = 1;
+    price.currency = "exa";
+    data.UpdateItemPrices({ { "belt id", price } });
+    auto totals = data.PriceTotals();
+    QVERIFY2(totals.size() == 2 && totals["chaos"] == 5 && totals["exa"] == 1, "Prices must be summed per currency");
+    QVERIFY2(data.PriceTotals("first").size() == 1, "Price totals must be limited to the tab");
+
+    gem.tab = "second";
+    data.UpdateItems({ gem }, { "gem id" });
+    counts = data.CountItemsByTab();
+    QVERIFY2(counts.size() == 1 && counts["second"] == 2, "Updated items must replace their old rows");
+    QVERIFY2(data.GetItemsByHash("gem").size() == 1 && data.GetItemsByHash("gem").front().uid == "gem id",
+             "Updated items must not be stored twice");
+    data.UpdateItems({}, { "belt id" });
+    QVERIFY2(data.GetItemsByHash("belt").empty(), "Removed items must be gone");
+
+    // identical items share a hash, and without a uid also their key
+    ItemRecord copy = gem;
+    copy.uid = "gem";
+    data.UpdateItems({ copy, copy }, {});
+    data.UpdateItems({}, { "gem" });
+    QVERIFY2(data.GetItemsByHash("gem").size() == 2, "Removing an item must only delete its own row");
+
+    data.ReplaceItems({ belt });
+    QVERIFY2(data.GetItemsByHash("gem").empty() && data.CountItemsByTab().size() == 1, "Replaced items must be gone");
+}
+
+void TestDataStore::SqliteCurrency() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    SqliteDataStore data((dir.path() + "/data").toStdString());
+
+    std::vector<CurrencySample> samples;
+    // a snapshot every 6 hours for 10 days
+    for (long long timestamp = 0; timestamp < 10 * 86400; timestamp += 6 * 3600) {
+        samples.push_back(Sample(timestamp, CURRENCY_NONE, 3));
+        samples.push_back(Sample(timestamp, CURRENCY_CHAOS_ORB, 10));
+    }
+    // inserted out of order, and the last one replaces the first
+    std::reverse(samples.begin(), samples.end());
+    samples.push_back(Sample(0, CURRENCY_NONE, 4));
+    data.InsertCurrencySamples(samples);
+
+    std::vector<CurrencySample> found;
+    data.ForEachCurrencySample(86400, 2 * 86400, [&](const CurrencySample &sample) {
+        found.push_back(sample);
+        return true;
+    });
+    QVERIFY2(found.size() == 8, "Range queries must include from and exclude to");
+    QVERIFY2(found[0].timestamp == 86400 && found[0].currency == CURRENCY_NONE && found[1].currency == CURRENCY_CHAOS_ORB
+             && found[1].count == 10 && found[1].chaos_value == 20, "Samples must be ordered by timestamp and currency");
+    found.clear();
+    data.ForEachCurrencySample(0, 1, [&](const CurrencySample &sample) {
+        found.push_back(sample);
+        return false;
+    });
+    QVERIFY2(found.size() == 1 && found[0].count == 4, "Iteration must stop when asked to, and samples must be replaced");
+
+    data.DownsampleCurrency(5 * 86400, 86400);
+    std::vector<long long> expected;
+    for (long long day = 0; day < 5; ++day)
+        expected.push_back(day * 86400 + 18 * 3600);
+    for (long long timestamp = 5 * 86400; timestamp < 10 * 86400; timestamp += 6 * 3600)
+        expected.push_back(timestamp);
+    QVERIFY2(Snapshots(data, 0, std::numeric_limits<long long>::max()) == expected,
+             "Only the last snapshot of every day before the cutoff must remain");
+    found.clear();
+    data.ForEachCurrencySample(18 * 3600, 18 * 3600 + 1, [&](const CurrencySample &sample) {
+        found.push_back(sample);
+        return true;
+    });
+    QVERIFY2(found.size() == 2, "Downsampling must keep whole snapshots");
+}
+
+void TestDataStore::SqliteCompression() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string filename = (dir.path() + "/data").toStdString();
+    std::string items = AccountItems(10);
+    {
+        // written by a version that didn't compress
+        SqliteDataStore data(filename, std::numeric_limits<size_t>::max());
+        data.Set("old", items);
+    }
+    SqliteDataStore data(filename);
+    QVERIFY2(data.Get("old") == items, "Uncompressed values must stay readable");
+    data.Set("items", items);
+    data.Set("small", "small");
+    data.Set("empty", "");
+    QVERIFY2(data.Get("items") == items, "Compressed values must read back unchanged");
+    QVERIFY2(data.Get("small") == "small" && data.Get("empty", "default").empty(), "Small values must be stored as they are");
+
+    std::string compressed = SqliteDataStore::Compress(items);
+    QVERIFY2(compressed.size() < items.size() / 2, "Item JSON should compress well");
+    std::string result;
+    QVERIFY(SqliteDataStore::Uncompress(compressed.c_str(), compressed.size(), &result) && result == items);
+    compressed.resize(compressed.size() / 2);
+    QVERIFY2(!SqliteDataStore::Uncompress(compressed.c_str(), compressed.size(), &result), "Corrupt values must be detected");
+}
+
+void TestDataStore::SqliteCompressionBenchmark_data() {
+    QTest::addColumn<bool>("compress");
+    QTest::newRow("raw") << false;
+    QTest::newRow("compressed") << true;
+}
+
+// Saves and loads the items of a large account, reports the database size
+void TestDataStore::SqliteCompressionBenchmark() {
+    QFETCH(bool, compress);
+
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string filename = (dir.path() + "/data").toStdString();
+    SqliteDataStore data(filename, compress ? kCompressionThreshold : std::numeric_limits<size_t>::max());
+    std::string items = AccountItems(kBenchmarkItems);
+
+    qint64 save_ns = 0, load_ns = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        data.Set("items", items);
+        save_ns = timer.nsecsElapsed();
+        timer.restart();
+        QVERIFY(data.Get("items").size() == items.size());
+        load_ns = timer.nsecsElapsed();
+    }
+    qDebug() << QTest::currentDataTag() << items.size() / 1024 << "kB of items, database" << DatabaseSize(filename) / 1024
+             << "kB, save" << save_ns / 1e6 << "ms, load" << load_ns / 1e6 << "ms";
+}
+
+void TestDataStore::WriteBehind() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string filename = (dir.path() + "/data").toStdString();
+    {
+        WriteBehindDataStore data(std::make_unique<SqliteDataStore>(filename));
+        for (int i = 0; i < kBenchmarkWrites; ++i)
+            data.SetInt("counter", i);
+        data.UpdateRows("rows", { { "a", "1" }, { "b", "2" } }, {});
+        data.UpdateRows("rows", {}, { "a" });
+        data.InsertCurrencySamples({ Sample(1, CURRENCY_NONE, 1) });
+        ItemRecord item;
+        item.uid = "item";
+        item.hash = "item";
+        item.tab = "tab";
+        data.ReplaceItems({ item });
+        ItemRecord other = item;
+        other.uid = "other";
+        other.hash = "other";
+        data.UpdateItems({ other }, {});
+        data.UpdateItems({}, { "other" });
+        data.UpdateItems({ item }, {});
+        data.UpdateItems({}, { "item" });
+        QVERIFY2(data.GetInt("counter") == kBenchmarkWrites - 1, "Reads must see queued writes");
+        DataRows expected = { { "b", "2" } };
+        QVERIFY2(data.GetRows("rows") == expected, "Rows must see queued updates");
+        QVERIFY2(Snapshots(data, 0, 2).size() == 1, "Currency must see queued samples");
+        QVERIFY2(data.CountItemsByTab()["tab"] == 1, "Item queries must see queued items");
+        data.UpdateItems({ item }, {});
+        data.UpdateItems({}, { "item" });
+        QVERIFY2(data.CountItemsByTab()["tab"] == 1, "Queued removals must only delete one row of identical items");
+
+        data.Flush();
+        SqliteDataStore other(filename);
+        QVERIFY2(other.GetInt("counter") == kBenchmarkWrites - 1 && other.GetRows("rows") == expected,
+                 "Flush must store everything queued");
+        WriteBehindStats stats = data.stats();
+        QVERIFY2(stats.queue_depth == 0 && stats.flushes > 0, "Stats must reflect the flush");
+        QVERIFY2(stats.coalesced > 0, "Repeated writes to a key must be coalesced");
+
+        data.Set("last", "value");
+    }
+    SqliteDataStore other(filename);
+    QVERIFY2(other.Get("last") == "value", "Queued writes must be stored on destruction");
+}
+
+void TestDataStore::WriteBehindBatch() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string filename = (dir.path() + "/data").toStdString();
+    WriteBehindDataStore data(std::make_unique<SqliteDataStore>(filename));
+    SqliteDataStore other(filename);
+
+    data.BeginBatch();
+    data.Set("first", "1");
+    QTest::qWait(3 * kWriteBehindDelay);
+    QVERIFY2(other.Get("first").empty(), "Writes in a batch must wait for Commit");
+    data.Set("second", "2");
+    data.Commit();
+    data.Flush();
+    QVERIFY2(other.Get("first") == "1" && other.Get("second") == "2", "A committed batch must be stored");
+}
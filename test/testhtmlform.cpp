@@ -0,0 +1,125 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testhtmlform.h"
+
+#include <QElapsedTimer>
+#include <algorithm>
+#include <random>
+
+#include "htmlform.h"
+
+namespace {
+
+// Items in the shop of the benchmark page, which is about 50000 characters
+const int kBenchmarkItems = 500;
+const size_t kBenchmarkChunk = 16 * 1024;
+
+// An edit-thread page shaped like the forum's, with things that look like the
+// form in places where they must be skipped
+std::string EditThreadPage(int items) {
+    std::string page = "<!DOCTYPE html><html><head><title>Edit Thread &amp; stuff</title>"
+        "<script type=\"text/javascript\">var s = '<input name=\"hash\" value=\"wrong\">'; if (a < b) {}</script>"
+        "<style>a > b { color: red }</style></head><body>"
+        "<!-- <form><input name=\"title\" value=\"commented\"></form> -->"
+        "<form action=\"/search\"><input type=\"text\" name=\"q\" value=\"\"></form>"
+        "<form method=\"post\" action=\"/forum/edit-thread/123\">"
+        "<input type=\"hidden\" name=\"hash\" value=\"abc-123\">"
+        "<input type=\"text\" name=\"title\" id=\"title\" onkeypress=\"return&#x20;event.keyCode&#x21;&#x3D;13\""
+        " value=\"Shop &lt;3 &#8212; &quot;cheap&quot;\">"
+        "<textarea name=\"content\">";
+    std::mt19937 rng(1);
+    for (int i = 0; i < items; ++i) {
+        page += "[spoiler=&quot;~b/o " + std::to_string(rng() % 100) + " chaos&quot;]"
+            "[linkItem location=&quot;Stash" + std::to_string(i) + "&quot; league=&quot;Standard&quot; x=&quot;1&quot; y=&quot;2&quot;]"
+            "&lt;input name=&quot;title&quot;&gt;[/spoiler]\n";
+    }
+    page += "</textarea><input type=submit name=submit value=Submit></form>"
+        "<div class='footer'>a <<b> text</div></body></html>";
+    return page;
+}
+
+}
+
+void TestHtmlForm::Fields() {
+    HtmlFormReader reader;
+    reader.Feed(EditThreadPage(10));
+    const HtmlPage &page = reader.page();
+    QVERIFY2(page.forms.size() == 2, "Forms in comments must be skipped");
+
+    const HtmlForm *form = page.FindForm("title");
+    QVERIFY(form != nullptr);
+    QVERIFY(form == page.FindForm("hash"));
+    QVERIFY(form->action == "/forum/edit-thread/123");
+    QVERIFY2(form->fields.at("hash") == "abc-123", "Inputs in scripts must be skipped");
+    QVERIFY(form->fields.at("title") == "Shop <3 \xE2\x80\x94 \"cheap\"");
+    QVERIFY2(form->fields.at("submit") == "Submit", "Unquoted values must be read");
+    QVERIFY2(!form->fields.count("content"), "Textareas must be skipped");
+    QVERIFY(page.FindForm("missing") == nullptr);
+    QVERIFY(page.errors.empty());
+}
+
+void TestHtmlForm::Errors() {
+    HtmlFormReader reader;
+    reader.Feed("<div><ul class=\"list errors\"><li>Invalid &amp; <b>expired</b> token</li>"
+                "<li> Title is too long\n</ul><ul><li>Not an error</li></ul></div>");
+    const std::vector<std::string> &errors = reader.page().errors;
+    QVERIFY(errors.size() == 2);
+    QVERIFY(errors[0] == "Invalid & expired token");
+    QVERIFY2(errors[1] == "Title is too long", "An error list item doesn't need to be closed");
+}
+
+void TestHtmlForm::Entities() {
+    QVERIFY(DecodeHtmlEntities("no entities") == "no entities");
+    QVERIFY(DecodeHtmlEntities("&lt;&gt;&amp;&quot;&apos;") == "<>&\"'");
+    QVERIFY(DecodeHtmlEntities("return&#x20;event.keyCode&#x21;&#x3D;13") == "return event.keyCode!=13");
+    QVERIFY(DecodeHtmlEntities("&#61;&#x1F600;") == "=\xF0\x9F\x98\x80");
+    QVERIFY2(DecodeHtmlEntities("a&#61b") == "a=b", "Numeric references don't need a semicolon");
+    QVERIFY2(DecodeHtmlEntities("&bogus; &amp &#x; &") == "&bogus; &amp &#x; &", "Unknown references must be kept");
+    QVERIFY2(DecodeHtmlEntities("&#0;&#99999999999;") == "\xEF\xBF\xBD\xEF\xBF\xBD", "Invalid characters must be replaced");
+}
+
+void TestHtmlForm::Chunks() {
+    std::string page = EditThreadPage(20);
+    HtmlFormReader whole;
+    whole.Feed(page);
+    for (size_t chunk : { 1, 2, 3, 7, 100 }) {
+        HtmlFormReader reader;
+        for (size_t i = 0; i < page.size(); i += chunk)
+            reader.Feed(page.data() + i, std::min(chunk, page.size() - i));
+        QVERIFY(reader.page().forms.size() == whole.page().forms.size());
+        QVERIFY2(reader.page().forms[1].fields == whole.page().forms[1].fields,
+                 "Where a page is split must not matter");
+    }
+}
+
+void TestHtmlForm::Benchmark() {
+    std::string page = EditThreadPage(kBenchmarkItems);
+    qint64 elapsed = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        HtmlFormReader reader;
+        for (size_t i = 0; i < page.size(); i += kBenchmarkChunk)
+            reader.Feed(page.data() + i, std::min(kBenchmarkChunk, page.size() - i));
+        elapsed = timer.nsecsElapsed();
+        QVERIFY(reader.page().FindForm("hash") != nullptr);
+    }
+    qDebug() << page.size() << "bytes," << page.size() * 1e3 / std::max<qint64>(elapsed, 1) << "MB/s";
+}
@@ -0,0 +1,188 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testimagecache.h"
+
+#include <QSignalSpy>
+#include <QTemporaryDir>
+
+#include "imagecache.h"
+#include "imagepack.h"
+#include "util.h"
+
+namespace {
+
+// Writes a size x size image to dir and returns its url
+std::string MakeImage(const QTemporaryDir &dir, const QString &name, int size) {
+    QImage image(size, size, QImage::Format_ARGB32);
+    image.fill(Qt::red);
+    QString path = dir.path() + "/" + name + ".png";
+    image.save(path);
+    return QUrl::fromLocalFile(path).toString().toStdString();
+}
+
+// Requests url and waits until the cache has it
+bool Load(ImageCache &cache, const std::string &url) {
+    QImage image;
+    if (cache.Request(url, &image))
+        return true;
+    QSignalSpy spy(&cache, &ImageCache::ImageReady);
+    return spy.wait(5000);
+}
+
+}
+
+void TestImageCache::Tiers() {
+    QTemporaryDir source, dir;
+    QVERIFY2(source.isValid() && dir.isValid(), "Failed to create a temporary directory");
+    std::string url = MakeImage(source, "icon", 16);
+    {
+        ImageCache cache(dir.path().toStdString());
+        QVERIFY2(Load(cache, url), "Images must be downloaded");
+        QVERIFY2(cache.stats().downloads == 1, "The first request must download the image");
+        QImage image;
+        QVERIFY2(cache.Request(url, &image) && image.width() == 16, "Loaded images must be returned from memory");
+        QVERIFY2(cache.stats().memory_hits == 1, "The second request must be a memory hit");
+    }
+    ImageCache cache(dir.path().toStdString());
+    QVERIFY2(Load(cache, url), "Images must be loaded from disk");
+    QVERIFY2(cache.stats().disk_hits == 1 && cache.stats().downloads == 0, "Downloaded images must be stored on disk");
+}
+
+void TestImageCache::Coalescing() {
+    QTemporaryDir source, dir;
+    QVERIFY2(source.isValid() && dir.isValid(), "Failed to create a temporary directory");
+    std::string url = MakeImage(source, "icon", 16);
+    ImageCache cache(dir.path().toStdString());
+    QSignalSpy spy(&cache, &ImageCache::ImageReady);
+    QImage image;
+    QVERIFY(!cache.Request(url, &image));
+    QVERIFY(!cache.Request(url, &image));
+    QVERIFY2(spy.wait(5000), "The image must be loaded");
+    // give a second load the chance to finish too
+    QTest::qWait(100);
+    QVERIFY2(spy.count() == 1 && cache.stats().downloads == 1 && cache.stats().coalesced == 1,
+             "Requests for an image that is loading must not load it again");
+}
+
+void TestImageCache::MemoryBudget() {
+    QTemporaryDir source, dir;
+    QVERIFY2(source.isValid() && dir.isValid(), "Failed to create a temporary directory");
+    std::string first = MakeImage(source, "first", 32);
+    std::string second = MakeImage(source, "second", 32);
+    // room for one 32x32 ARGB image
+    ImageCache cache(dir.path().toStdString(), 32 * 32 * 4 * 3 / 2);
+    QVERIFY(Load(cache, first));
+    QVERIFY(Load(cache, second));
+    QVERIFY2(cache.stats().evictions == 1 && cache.stats().memory_bytes <= 32 * 32 * 4 * 3 / 2,
+             "Memory use must stay within the budget");
+    QImage image;
+    QVERIFY2(cache.Request(second, &image), "The most recently loaded image must be kept");
+    QVERIFY2(!cache.Request(first, &image), "The least recently used image must be evicted");
+}
+
+void TestImageCache::Failure() {
+    QTemporaryDir source, dir;
+    QVERIFY2(source.isValid() && dir.isValid(), "Failed to create a temporary directory");
+    std::string url = QUrl::fromLocalFile(source.path() + "/missing.png").toString().toStdString();
+    ImageCache cache(dir.path().toStdString());
+    QSignalSpy failed(&cache, &ImageCache::ImageFailed);
+    QSignalSpy ready(&cache, &ImageCache::ImageReady);
+    QImage image;
+    QVERIFY(!cache.Request(url, &image));
+    QVERIFY2(failed.wait(5000), "Failed downloads must be reported");
+    QVERIFY2(ready.count() == 0 && cache.stats().downloads == 0, "Failed downloads must not be cached");
+    QVERIFY2(!cache.Request(url, &image) && failed.wait(5000), "Failed urls must be tried again");
+}
+
+void TestImageCache::ImportFiles() {
+    QTemporaryDir source, dir;
+    QVERIFY2(source.isValid() && dir.isValid(), "Failed to create a temporary directory");
+    std::string url = MakeImage(source, "icon", 16);
+    // the layout of older versions, one file named after the md5 of its url
+    QString old_path = dir.path() + "/" + QString::fromStdString(Util::Md5(url)) + ".png";
+    QVERIFY(QFile::copy(QUrl(url.c_str()).toLocalFile(), old_path));
+
+    ImageCache cache(dir.path().toStdString());
+    QVERIFY2(!QFile::exists(old_path), "Imported files must be removed");
+    QVERIFY2(Load(cache, url), "Imported images must be loaded");
+    QVERIFY2(cache.stats().disk_hits == 1 && cache.stats().downloads == 0, "Imported images must be read from the pack");
+}
+
+void TestImageCache::Pack() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    QString path = dir.path() + "/images.pack";
+    for (bool map : { true, false }) {
+        QFile::remove(path);
+        {
+            ImagePack pack(path, map);
+            QVERIFY2(pack.Read("a").isNull(), "Missing keys must read as null");
+            QVERIFY(pack.Write("a", "first"));
+            QVERIFY(pack.Write("b", "second"));
+            QVERIFY2(pack.Read("a") == "first", "Written data must be read back");
+            QVERIFY(pack.Write("a", "third"));
+            QVERIFY2(pack.Read("a") == "third" && pack.Read("b") == "second", "Writing a key again must replace it");
+        }
+        ImagePack pack(path, map);
+        QVERIFY2(pack.Read("a") == "third" && pack.Read("b") == "second", "Data must survive reopening the pack");
+        QVERIFY2(pack.stats().records == 2 && pack.stats().dead_bytes > 0, "The replaced record must be counted as dead");
+    }
+}
+
+void TestImageCache::PackCompaction() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    QString path = dir.path() + "/images.pack";
+    ImagePack pack(path);
+    QByteArray data(1000, 'x');
+    for (int i = 0; i < 10; ++i)
+        QVERIFY(pack.Write("same", data + QByteArray::number(i)));
+    QVERIFY(pack.Write("other", "other"));
+    qint64 before = QFileInfo(path).size();
+
+    QVERIFY(pack.Compact());
+    QVERIFY2(QFileInfo(path).size() < before / 5, "Compaction must drop dead records");
+    QVERIFY2(pack.stats().dead_bytes == 0 && pack.stats().records == 2, "Compaction must keep live records");
+    QVERIFY2(pack.Read("same") == data + "9" && pack.Read("other") == "other", "Live records must be readable after compaction");
+    QVERIFY(pack.Write("new", "new"));
+    QVERIFY2(pack.Read("new") == "new", "The compacted pack must accept writes");
+}
+
+void TestImageCache::PackTruncated() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    QString path = dir.path() + "/images.pack";
+    qint64 size;
+    {
+        ImagePack pack(path);
+        QVERIFY(pack.Write("a", "first"));
+        QVERIFY(pack.Write("b", "second"));
+        size = QFileInfo(path).size();
+    }
+    // cut the last record short, as a crash while writing would
+    QFile file(path);
+    QVERIFY(file.resize(size - 2));
+
+    ImagePack pack(path);
+    QVERIFY2(pack.Read("a") == "first", "Complete records must be kept");
+    QVERIFY2(pack.Read("b").isNull(), "An incomplete record must be dropped");
+    QVERIFY(pack.Write("b", "again"));
+    QVERIFY2(pack.Read("b") == "again", "Writes must follow the last complete record");
+}
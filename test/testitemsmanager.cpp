@@ -19,13 +19,89 @@
 
 #include "testitemsmanager.h"
 
+#include <QTemporaryDir>
+#include <QVariant>
+#include <random>
+#include <regex>
+
 #include "rapidjson/document.h"
 
 #include "buyoutmanager.h"
+#include "currencymanager.h"
 #include "datastore.h"
 #include "item.h"
 #include "itemsmanager.h"
+#include "memorydatastore.h"
+#include "porting.h"
 #include "testdata.h"
+#include "writebehinddatastore.h"
+
+namespace {
+
+const int kFuzzNotes = 5000;
+const int kBenchmarkNotes = 100000;
+
+// What StringToBuyout did before it got its own parser, plus fractional prices
+Buyout RegexBuyout(BuyoutManager &bo, const std::string &note) {
+    std::regex exp("(~\\S+)\\s+(\\d+\\.?\\d*)(?:/(\\d+\\.?\\d*))?\\s+(\\w+)");
+    std::smatch sm;
+    Buyout tmp;
+    if (std::regex_search(note, sm, exp)) {
+        double value = QVariant(sm[2].str().c_str()).toDouble();
+        if (sm[3].matched) {
+            double denominator = QVariant(sm[3].str().c_str()).toDouble();
+            if (denominator == 0)
+                return tmp;
+            value /= denominator;
+        }
+        tmp.type = bo.StringToBuyoutType(sm[1]);
+        tmp.value = value;
+        tmp.currency = bo.StringToCurrencyType(sm[4]);
+        tmp.source = BUYOUT_SOURCE_GAME;
+    }
+    return tmp;
+}
+
+// A stack of currency in a stash tab, icon_dir decides its category
+std::shared_ptr<Item> CurrencyStack(const std::string &id, const std::string &type_line, int size, int tab,
+                                    const std::string &icon_dir = "Currency") {
+    std::string json = "{\"id\":\"" + id + "\",\"typeLine\":\"" + type_line + "\",\"frameType\":5,"
+        "\"icon\":\"https://web.poecdn.com/image/Art/2DItems/" + icon_dir + "/Icon.png\",\"x\":0,\"y\":0,\"w\":1,\"h\":1,"
+        "\"properties\":[{\"name\":\"Stack Size\",\"values\":[[\"" + std::to_string(size) + "/40\",0]],\"displayMode\":0}],"
+        "\"_type\":0,\"_tab\":" + std::to_string(tab) + ",\"_tab_label\":\"tab" + std::to_string(tab) + "\"}";
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+    return std::make_shared<Item>(doc);
+}
+
+int JournalRecords(const std::string &filename) {
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    return file.readAll().count('\n');
+}
+
+int CurrencyCount(CurrencyManager &manager, CurrencyType type) {
+    for (auto &currency : manager.currencies())
+        if (currency->currency == type)
+            return currency->count;
+    return -1;
+}
+
+// Notes that are mostly close to something valid
+std::string RandomNote(std::mt19937 &rng) {
+    static const std::vector<std::string> junk = { "", " ", "~", "/", "\t", "note ", "~~", ",", "\xc3\xa9" };
+    static const std::vector<std::string> types = { "~b/o", "~price", "~c/o", "~gb/o", "~", "~~b/o", "b/o", "~pr ice", "~b/o~price" };
+    static const std::vector<std::string> spaces = { " ", "  ", "\t", "", "\n", " ~" };
+    static const std::vector<std::string> numbers = { "1", "10", "2.5", "3.", "0.25", ".5", "1/2", "3/0", "1.5/4", "1/",
+        "12345678901234567890.5", "0.1", "1.2.3", "x" };
+    static const std::vector<std::string> currencies = { "chaos", "exa", "exalted", "alch", "ex4", "_", "\xc3\xa9", "chaos,", "",
+        "aaaaaaaaaaaaaaaaaaaaaaaaa" };
+    auto pick = [&rng](const std::vector<std::string> &strings) { return strings[rng() % strings.size()]; };
+    return pick(junk) + pick(types) + pick(spaces) + pick(numbers) + pick(spaces) + pick(currencies) + pick(junk);
+}
+
+}
 
 void TestItemsManager::initTestCase() {
     auto null_nm = std::make_unique<QNetworkAccessManager>();
@@ -219,3 +295,336 @@ void TestItemsManager::ItemHashMigration() {
     auto buyout_from_mgr = bo.Get(item);
     QVERIFY2(buyout_from_mgr == buyout, "After migration: the buyout must match our data");
 }
+
+// Checks that a refresh is classified against the items of the previous one
+void TestItemsManager::RefreshChangeSet() {
+    ItemLocation first_tab(1, "first");
+    ItemLocation second_tab(2, "second");
+    auto kept = std::make_shared<Item>("Kept item", first_tab);
+    auto moved_before = std::make_shared<Item>("Moved item", first_tab);
+    auto removed = std::make_shared<Item>("Removed item", first_tab);
+
+    rapidjson::Document doc;
+    doc.Parse(kItem1.c_str());
+    auto changed_before = std::make_shared<Item>(doc);
+    doc["x"].SetInt(doc["x"].GetInt() + 1);
+    auto changed_after = std::make_shared<Item>(doc);
+    QVERIFY2(changed_before->uid() == changed_after->uid(), "Before/after must have equal uids");
+
+    auto tabs = { first_tab, second_tab };
+    app_.items_manager().OnItemsRefreshed({ kept, moved_before, removed, changed_before }, tabs, true);
+
+    auto moved_after = std::make_shared<Item>("Moved item", second_tab);
+    auto added = std::make_shared<Item>("Added item", second_tab);
+    app_.items_manager().OnItemsRefreshed({ kept, moved_after, added, changed_after }, tabs, false);
+
+    auto &changes = app_.items_manager().changes();
+    QVERIFY2(changes.size() == 4, "Unchanged items must not be part of the change set");
+    QVERIFY2(changes.added.size() == 1 && changes.added[0] == added, "The new item must be reported as added");
+    QVERIFY2(changes.removed.size() == 1 && changes.removed[0] == removed, "The missing item must be reported as removed");
+    QVERIFY2(changes.moved.size() == 1 && changes.moved[0].previous == moved_before && changes.moved[0].current == moved_after,
+             "The item in another tab must be reported as moved");
+    QVERIFY2(changes.changed.size() == 1 && changes.changed[0].previous == changed_before && changes.changed[0].current == changed_after,
+             "The item with different contents must be reported as changed");
+}
+
+// Checks that a refresh after which only some items changed propagates tab buyouts to them
+void TestItemsManager::IncrementalPropagation() {
+    ItemLocation first_tab(1, "first");
+    ItemLocation second_tab(2, "second");
+    auto first = std::make_shared<Item>("First item", first_tab);
+    auto second = std::make_shared<Item>("Second item", second_tab);
+    auto tabs = { first_tab, second_tab };
+    app_.items_manager().OnItemsRefreshed({ first, second }, tabs, true);
+
+    auto &bo = app_.buyout_manager();
+    QVERIFY2(!bo.all_tabs_changed(), "The next refresh must not need to process all items");
+
+    Buyout tab_buyout(456.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+    bo.SetTab(first_tab.GetUniqueHash(), tab_buyout);
+    auto added = std::make_shared<Item>("Added item", second_tab);
+    app_.items_manager().OnItemsRefreshed({ first, second, added }, tabs, false);
+
+    QVERIFY2(bo.Get(*first).IsActive(), "An unchanged item in a tab with a changed buyout must inherit it");
+    QVERIFY2(bo.GetRefreshLocked(first_tab), "The tab with a buyout must be locked for refresh");
+    QVERIFY2(!bo.Get(*added).IsActive(), "The added item must not have an active buyout");
+    QVERIFY2(!bo.GetRefreshLocked(second_tab), "The tab without buyouts must not be locked for refresh");
+
+    auto moved = std::make_shared<Item>("Second item", first_tab);
+    app_.items_manager().OnItemsRefreshed({ first, moved, added }, tabs, false);
+
+    QVERIFY2(app_.items_manager().changes().moved.size() == 1, "The second item must be reported as moved");
+    QVERIFY2(bo.Get(*moved).IsActive(), "The moved item must inherit the buyout of its new tab");
+}
+
+// Checks that setting a tab buyout only has to touch the items of that tab
+void TestItemsManager::TabBuyoutPropagation() {
+    ItemLocation first_tab(1, "first");
+    ItemLocation second_tab(2, "second");
+    auto first = std::make_shared<Item>("First item", first_tab);
+    auto second = std::make_shared<Item>("Second item", second_tab);
+    auto tabs = { first_tab, second_tab };
+    app_.items_manager().OnItemsRefreshed({ first, second }, tabs, true);
+
+    auto &bo = app_.buyout_manager();
+    Buyout tab_buyout(456.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+    bo.SetTab(first_tab.GetUniqueHash(), tab_buyout);
+    bo.SetTab(second_tab.GetUniqueHash(), tab_buyout);
+    app_.items_manager().PropagateTabBuyouts({ first_tab });
+
+    QVERIFY2(bo.Get(*first).IsActive(), "The item in the passed tab must inherit the tab buyout");
+    QVERIFY2(bo.GetRefreshLocked(first_tab), "The passed tab must be locked for refresh");
+    QVERIFY2(!bo.Get(*second).IsActive(), "Items in other tabs must not be touched");
+    QVERIFY2(!bo.GetRefreshLocked(second_tab), "Other tabs must not be locked");
+}
+
+// Checks that saving only writes the buyouts that changed, one row each
+void TestItemsManager::BuyoutRowStorage() {
+    auto &bo = app_.buyout_manager();
+    bo.Save();
+    ItemLocation tab(1, "first");
+    Item first("First item", tab);
+    Item second("Second item", tab);
+    Buyout buyout(123.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+
+    bo.Set(first, buyout);
+    bo.Set(second, buyout);
+    bo.Save();
+    auto rows = app_.data().GetRows("buyouts");
+    QVERIFY2(rows.count(first.hash()) && rows.count(second.hash()), "Each buyout must be stored as its own row");
+
+    // remove a row behind the manager's back, an unrelated save must not write it again
+    app_.data().UpdateRows("buyouts", {}, { second.hash() });
+    bo.Set(first, Buyout(5.0, BUYOUT_TYPE_FIXED, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime()));
+    bo.Save();
+    rows = app_.data().GetRows("buyouts");
+    QVERIFY2(rows.count(first.hash()) && !rows.count(second.hash()), "Only changed buyouts must be written");
+
+    bo.Load();
+    QVERIFY2(bo.Get(first).type == BUYOUT_TYPE_FIXED, "Buyouts must be loaded from their rows");
+
+    bo.Set(first, Buyout());
+    bo.Save();
+    QVERIFY2(!app_.data().GetRows("buyouts").count(first.hash()), "Buyouts that are not savable must be deleted");
+}
+
+void TestItemsManager::BuyoutJournalReplay() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    std::string journal = (dir.path() + "/buyouts.journal").toStdString();
+    MemoryDataStore data;
+    ItemLocation tab(1, "first");
+    Item item("First item", tab);
+    Buyout buyout(10.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+    Buyout tab_buyout(2.0, BUYOUT_TYPE_FIXED, CURRENCY_EXALTED_ORB, QDateTime::currentDateTime());
+
+    {
+        BuyoutManager bo(data, journal);
+        bo.BeginUserEdit();
+        bo.Set(item, buyout);
+        bo.SetTab(tab.GetUniqueHash(), tab_buyout);
+        bo.EndUserEdit();
+        // simulate a crash: the manager goes away without saving
+        QVERIFY2(data.GetRows("buyouts").empty(), "User edits must not be saved right away");
+        QFile(QString::fromStdString(journal)).copy(dir.path() + "/crashed.journal");
+    }
+
+    std::string crashed = (dir.path() + "/crashed.journal").toStdString();
+    {
+        // damaged records are skipped, not trusted
+        QFile file(QString::fromStdString(crashed));
+        QVERIFY(file.open(QIODevice::Append));
+        file.write("{\"tab\":1,\"key\":\"a\",\"before\":{},\"after\":{}}\n");
+        file.write("{\"tab\":false,\"key\":5,\"before\":{},\"after\":{}}\n");
+        file.write("{\"tab\":false,\"key\":\"b\",\"before\":{\"currency\":\"chaos\"},\"after\":[]}\n");
+        file.write("{\"tab\":false,\"key\":\"c\",\"bef\n");
+    }
+    BuyoutManager bo(data, crashed);
+    QVERIFY2(bo.Get(item) == buyout, "Item buyouts must be restored from the journal");
+    QVERIFY2(bo.GetTab(tab.GetUniqueHash()) == tab_buyout, "Tab buyouts must be restored from the journal");
+    QVERIFY2(data.GetRows("buyouts").count(item.hash()), "Replayed edits must be saved");
+    QVERIFY2(QFile(QString::fromStdString(crashed)).size() == 0, "The journal must be empty once it is saved");
+
+    // with a write-behind store the edits must reach the backend before the journal is cleared
+    auto backend = std::make_unique<MemoryDataStore>();
+    MemoryDataStore &stored = *backend;
+    WriteBehindDataStore write_behind(std::move(backend));
+    BuyoutManager delayed(write_behind, journal);
+    // keep the store from writing until the batch is committed
+    write_behind.BeginBatch();
+    delayed.BeginUserEdit();
+    delayed.Set(item, tab_buyout);
+    delayed.EndUserEdit();
+    delayed.Save();
+    QTest::qWait(kJournalCheckInterval * 3);
+    QVERIFY2(JournalRecords(journal) > 0, "The journal must be kept while its edits are only queued");
+    delayed.BeginUserEdit();
+    delayed.Set(item, buyout);
+    delayed.EndUserEdit();
+    write_behind.Commit();
+    QTRY_VERIFY2(stored.GetRows("buyouts").count(item.hash()), "Saved edits must be stored");
+    QTRY_VERIFY2(JournalRecords(journal) == 1, "Only the stored edits must leave the journal");
+    // EndUserEdit scheduled a save of the last edit
+    QTRY_VERIFY2(JournalRecords(journal) == 0, "The journal must be empty once everything is stored");
+}
+
+void TestItemsManager::BuyoutUndoRedo() {
+    auto &bo = app_.buyout_manager();
+    ItemLocation tab(1, "first");
+    Item first("First item", tab);
+    Item second("Second item", tab);
+    Buyout old_buyout(1.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+    Buyout new_buyout(3.0, BUYOUT_TYPE_FIXED, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime());
+
+    bo.Set(first, old_buyout);
+    QVERIFY2(!bo.CanUndo(), "Only user edits can be undone");
+
+    bo.BeginUserEdit();
+    bo.Set(first, new_buyout);
+    bo.Set(second, new_buyout);
+    bo.EndUserEdit();
+    QVERIFY(bo.CanUndo());
+
+    QVERIFY(bo.Undo());
+    QVERIFY2(bo.Get(first) == old_buyout && !bo.Get(second).IsActive(), "All buyouts of an edit must be undone together");
+    QVERIFY(bo.CanRedo());
+
+    QVERIFY(bo.Redo());
+    QVERIFY2(bo.Get(first) == new_buyout && bo.Get(second) == new_buyout, "Redo must apply the edit again");
+
+    bo.BeginUserEdit();
+    bo.Set(second, old_buyout);
+    bo.EndUserEdit();
+    QVERIFY2(!bo.CanRedo(), "A new edit must drop what could be redone");
+    QVERIFY(bo.Undo());
+    QVERIFY(bo.Undo());
+    QVERIFY(!bo.Undo());
+}
+
+void TestItemsManager::ItemRows() {
+    ItemLocation first_tab(1, "first");
+    ItemLocation second_tab(2, "second");
+    auto first = std::make_shared<Item>("First item", first_tab);
+    auto second = std::make_shared<Item>("Second item", first_tab);
+    auto third = std::make_shared<Item>("Third item", second_tab);
+    auto tabs = { first_tab, second_tab };
+    auto &bo = app_.buyout_manager();
+    bo.Set(*first, Buyout(2.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime()));
+    app_.items_manager().OnItemsRefreshed({ first, second, third }, tabs, true);
+
+    auto &data = app_.data();
+    auto counts = data.CountItemsByTab();
+    QVERIFY2(counts[first_tab.GetUniqueHash()] == 2 && counts[second_tab.GetUniqueHash()] == 1,
+             "Refreshed items must be stored as rows");
+    auto found = data.GetItemsByHash(first->hash());
+    QVERIFY2(found.size() == 1 && found.front().price.currency == "chaos", "Items must be found by hash with their price");
+
+    bo.SetTab(second_tab.GetUniqueHash(), Buyout(3.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime()));
+    app_.items_manager().PropagateTabBuyouts({ second_tab });
+    app_.items_manager().StoreItemPrices({ second_tab });
+    QVERIFY2(data.PriceTotals()["chaos"] == 5.0, "Prices must be updated after buyouts change");
+    QVERIFY2(data.PriceTotals(second_tab.GetUniqueHash())["chaos"] == 3.0, "Price totals must be available per tab");
+
+    // later refreshes only store what changed
+    auto fourth = std::make_shared<Item>("Fourth item", second_tab);
+    app_.items_manager().OnItemsRefreshed({ first, third, fourth }, tabs, false);
+    counts = data.CountItemsByTab();
+    QVERIFY2(counts[first_tab.GetUniqueHash()] == 1 && counts[second_tab.GetUniqueHash()] == 2,
+             "Rows of removed items must be deleted and added ones stored");
+    QVERIFY2(data.GetItemsByHash(second->hash()).empty(), "Removed items must not be found");
+    QVERIFY2(data.PriceTotals(second_tab.GetUniqueHash())["chaos"] == 6.0, "Added items must be stored with their price");
+}
+
+void TestItemsManager::IdenticalItemRows() {
+    std::vector<ItemLocation> tabs = { ItemLocation(1, "tab1") };
+    std::string tab = tabs.front().GetUniqueHash();
+    // same stack size in the same tab, so the hashes are the same
+    auto first = CurrencyStack("first", "Chaos Orb", 7, 1);
+    auto second = CurrencyStack("second", "Chaos Orb", 7, 1);
+    QVERIFY(first->hash() == second->hash());
+    // without a uid they are told apart by nothing
+    auto plain = std::make_shared<Item>("Plain item", tabs.front());
+    auto other_plain = std::make_shared<Item>("Plain item", tabs.front());
+    auto &bo = app_.buyout_manager();
+    bo.Set(*first, Buyout(1.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime()));
+    bo.Set(*plain, Buyout(2.0, BUYOUT_TYPE_BUYOUT, CURRENCY_CHAOS_ORB, QDateTime::currentDateTime()));
+    app_.items_manager().OnItemsRefreshed({ first, second, plain, other_plain }, tabs, false);
+
+    auto &data = app_.data();
+    QVERIFY2(data.CountItemsByTab()[tab] == 4, "Identical items must be stored as separate rows");
+    QVERIFY2(data.PriceTotals(tab)["chaos"] == 6.0, "Identical items must all be priced");
+
+    app_.items_manager().OnItemsRefreshed({ first, plain }, tabs, false);
+    QVERIFY2(data.CountItemsByTab()[tab] == 2, "Removing one of identical items must only delete its own row");
+    QVERIFY2(data.PriceTotals(tab)["chaos"] == 3.0, "Prices of the remaining identical items must be kept");
+
+    app_.items_manager().OnItemsRefreshed({ first, second, plain, other_plain }, tabs, false);
+    app_.items_manager().OnItemsRefreshed({ second, other_plain }, tabs, false);
+    QVERIFY2(data.CountItemsByTab()[tab] == 2, "Item rows must stay correct over several refreshes");
+}
+
+void TestItemsManager::CurrencyCounting() {
+    auto &currency = app_.currency_manager();
+    std::vector<ItemLocation> tabs = { ItemLocation(1, "tab1"), ItemLocation(2, "tab2") };
+    auto chaos = CurrencyStack("chaos", "Chaos Orb", 7, 1);
+    auto other_chaos = CurrencyStack("other chaos", "Chaos Orb", 3, 2);
+    auto wisdom = CurrencyStack("wisdom", "Scroll of Wisdom", 20, 1);
+    auto card = CurrencyStack("card", "Chaos Orb", 9, 2, "Divination");
+    app_.items_manager().OnItemsRefreshed({ chaos, other_chaos, wisdom, card }, tabs, false);
+    QVERIFY2(CurrencyCount(currency, CURRENCY_CHAOS_ORB) == 10, "Stacks of all tabs must be counted");
+    QVERIFY2(currency.TotalWisdomValue() == 20, "Wisdom scrolls must be counted");
+
+    auto bigger_stack = CurrencyStack("other chaos", "Chaos Orb", 5, 2);
+    app_.items_manager().OnItemsRefreshed({ chaos, bigger_stack, card }, tabs, false);
+    QVERIFY2(CurrencyCount(currency, CURRENCY_CHAOS_ORB) == 12, "Changed stacks must be recounted");
+    QVERIFY2(currency.TotalWisdomValue() == 0, "Removed stacks must not be counted");
+}
+
+void TestItemsManager::NoteParsing() {
+    auto &bo = app_.buyout_manager();
+    Buyout buyout = bo.StringToBuyout("~b/o 5 chaos");
+    QVERIFY2(buyout.type == BUYOUT_TYPE_BUYOUT && buyout.value == 5 && buyout.currency == CURRENCY_CHAOS_ORB,
+             "Failed to parse a simple buyout");
+    buyout = bo.StringToBuyout("my stuff ~price 1.5 exa, thanks");
+    QVERIFY2(buyout.type == BUYOUT_TYPE_FIXED && buyout.value == 1.5 && buyout.currency == CURRENCY_EXALTED_ORB,
+             "Failed to parse a buyout surrounded by other text");
+    buyout = bo.StringToBuyout("~price 1/2 exa");
+    QVERIFY2(buyout.type == BUYOUT_TYPE_FIXED && buyout.value == 0.5 && buyout.currency == CURRENCY_EXALTED_ORB,
+             "Failed to parse a fractional price");
+    QVERIFY2(!bo.StringToBuyout("~price 1/0 exa").IsGameSet(), "A zero denominator must not give a buyout");
+    QVERIFY2(!bo.StringToBuyout("~b/o chaos").IsGameSet(), "A note without a price must not give a buyout");
+}
+
+void TestItemsManager::NoteParsingFuzz() {
+    auto &bo = app_.buyout_manager();
+    std::mt19937 rng(1);
+    int matched = 0;
+    for (int i = 0; i < kFuzzNotes; ++i) {
+        std::string note = RandomNote(rng);
+        Buyout expected = RegexBuyout(bo, note);
+        Buyout actual = bo.StringToBuyout(note);
+        QVERIFY2(actual == expected,
+                 qPrintable("Parser and regex disagree on note: " + QString::fromStdString(note)));
+        if (expected.IsGameSet())
+            ++matched;
+    }
+    QVERIFY2(matched > kFuzzNotes / 20, "Too few random notes contained a price");
+}
+
+void TestItemsManager::NoteParsingBenchmark() {
+    auto &bo = app_.buyout_manager();
+    std::mt19937 rng(2);
+    std::vector<std::string> notes;
+    notes.reserve(kBenchmarkNotes);
+    for (int i = 0; i < kBenchmarkNotes; ++i)
+        notes.push_back(RandomNote(rng));
+
+    int priced = 0;
+    QBENCHMARK {
+        priced = 0;
+        for (auto &note : notes)
+            if (bo.StringToBuyout(note).IsGameSet())
+                ++priced;
+    }
+    qDebug() << kBenchmarkNotes << "notes," << priced << "with a buyout";
+}
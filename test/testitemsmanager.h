@@ -36,6 +36,18 @@ private slots:
     void MoveItemBoToNoBo();
     void MoveItemBoToBo();
     void ItemHashMigration();
+    void RefreshChangeSet();
+    void IncrementalPropagation();
+    void TabBuyoutPropagation();
+    void BuyoutRowStorage();
+    void BuyoutJournalReplay();
+    void BuyoutUndoRedo();
+    void ItemRows();
+    void IdenticalItemRows();
+    void CurrencyCounting();
+    void NoteParsing();
+    void NoteParsingFuzz();
+    void NoteParsingBenchmark();
 private:
     Application app_;
 };
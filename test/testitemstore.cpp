@@ -0,0 +1,137 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testitemstore.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "itemarena.h"
+#include "itemstore.h"
+
+namespace {
+
+const int kBenchmarkItems = 2000;
+
+// Peak resident set size of the process in kilobytes, 0 if unknown.
+long PeakRss() {
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : status.readAll().split('\n'))
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').first().toLong();
+    }
+#endif
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+Items MakeItems(const std::shared_ptr<ItemArena> &arena, int count) {
+    ItemLocation tab(1, "tab");
+    Items items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i)
+        items.push_back(arena->MakeItem("Item " + std::to_string(i), tab));
+    return items;
+}
+
+}
+
+void TestItemStore::ArenaRetiredOnReset() {
+    int live = ItemArena::live_count();
+    ItemStore store;
+    {
+        auto arena = std::make_shared<ItemArena>();
+        store.Reset(MakeItems(arena, 10));
+    }
+    QVERIFY2(ItemArena::live_count() == live + 1, "The store must keep its arena alive");
+    QVERIFY2(store.item(3)->name() == "Item 3", "Items must be readable through the store");
+
+    {
+        auto arena = std::make_shared<ItemArena>();
+        store.Reset(MakeItems(arena, 5));
+    }
+    QVERIFY2(ItemArena::live_count() == live + 1, "The previous arena must be released once its items are replaced");
+
+    store.Reset({});
+    QVERIFY2(ItemArena::live_count() == live, "No arena must be alive after the store is cleared");
+}
+
+void TestItemStore::StaleHandles() {
+    ItemStore store;
+    QVERIFY2(!store.IsValid(ItemHandle()), "A default handle must not resolve");
+
+    auto arena = std::make_shared<ItemArena>();
+    store.Reset(MakeItems(arena, 3));
+    ItemHandle handle = store.handle(1);
+    QVERIFY2(store.Get(handle) == store.item(1).get(), "A fresh handle must resolve to its item");
+    QVERIFY2(!store.IsValid(store.handle(3)), "A handle past the end must not resolve");
+
+    store.Reset(MakeItems(arena, 3));
+    QVERIFY2(store.Get(handle) == nullptr, "A handle from a previous refresh must not resolve");
+}
+
+void TestItemStore::ArenaAllocations_data() {
+    QTest::addColumn<bool>("use_arena");
+    QTest::newRow("make_shared") << false;
+    QTest::newRow("arena") << true;
+}
+
+// Compares building one refresh worth of items with one heap allocation per
+// Item against the arena.  The allocation count only covers the Item objects
+// themselves, the strings inside them allocate the same in both cases.
+void TestItemStore::ArenaAllocations() {
+    QFETCH(bool, use_arena);
+
+    ItemLocation tab(1, "tab");
+    ItemStore store;
+    size_t allocations = 0;
+    QBENCHMARK {
+        Items items;
+        items.reserve(kBenchmarkItems);
+        if (use_arena) {
+            auto arena = std::make_shared<ItemArena>();
+            for (int i = 0; i < kBenchmarkItems; ++i)
+                items.push_back(arena->MakeItem("Item " + std::to_string(i), tab));
+            // the arena itself and its control block
+            allocations = arena->chunk_count() + 1;
+        } else {
+            for (int i = 0; i < kBenchmarkItems; ++i)
+                items.push_back(std::make_shared<Item>("Item " + std::to_string(i), tab));
+            allocations = items.size();
+        }
+        store.Reset(items);
+    }
+    qDebug() << QTest::currentDataTag() << kBenchmarkItems << "items," << allocations
+             << "allocations, peak RSS" << PeakRss() << "kB";
+    QVERIFY(store.size() == static_cast<size_t>(kBenchmarkItems));
+    if (use_arena)
+        QVERIFY2(allocations < static_cast<size_t>(kBenchmarkItems) / 100, "The arena should allocate Items in bulk");
+}
@@ -4,9 +4,16 @@
 #include <memory>
 
 #include "porting.h"
+#include "testautoonline.h"
+#include "testdatastore.h"
+#include "testhtmlform.h"
+#include "testimagecache.h"
 #include "testitem.h"
 #include "testitemsmanager.h"
+#include "testitemstore.h"
+#include "testrendercache.h"
 #include "testshop.h"
+#include "testtabcache.h"
 #include "testutil.h"
 
 #define TEST(Class) result |= QTest::qExec(std::make_unique<Class>().get())
@@ -21,6 +28,13 @@ int test_main() {
     TEST(TestShop);
     TEST(TestUtil);
     TEST(TestItemsManager);
+    TEST(TestItemStore);
+    TEST(TestDataStore);
+    TEST(TestTabCache);
+    TEST(TestImageCache);
+    TEST(TestRenderCache);
+    TEST(TestHtmlForm);
+    TEST(TestAutoOnline);
 
     return result != 0 ? -1 : 0;
 }
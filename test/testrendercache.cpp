@@ -0,0 +1,86 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testrendercache.h"
+
+#include <QSignalSpy>
+#include "rapidjson/document.h"
+
+#include "item.h"
+#include "rendercache.h"
+#include "testdata.h"
+
+namespace {
+
+std::shared_ptr<Item> MakeItem(bool corrupted = false) {
+    rapidjson::Document doc;
+    doc.Parse(kItem1.c_str());
+    if (doc.HasMember("corrupted"))
+        doc["corrupted"].SetBool(corrupted);
+    else
+        doc.AddMember("corrupted", corrupted, doc.GetAllocator());
+    return std::make_shared<Item>(doc);
+}
+
+QImage MakeImage() {
+    QImage image(94, 94, QImage::Format_ARGB32);
+    image.fill(Qt::red);
+    return image;
+}
+
+}
+
+void TestRenderCache::Render() {
+    RenderCache cache;
+    auto item = MakeItem();
+    QPixmap icon;
+    QVERIFY2(!cache.Tooltip(*item) && !cache.Icon(*item, &icon), "Nothing must be cached at first");
+
+    QSignalSpy spy(&cache, &RenderCache::Rendered);
+    QVERIFY(cache.Render(item, MakeImage()));
+    QVERIFY2(spy.wait(5000), "The item must be rendered");
+    const ItemTooltipText *tooltip = cache.Tooltip(*item);
+    QVERIFY2(tooltip && tooltip->properties == GenerateItemTooltipText(*item).properties,
+             "The rendered tooltip must be cached");
+    QVERIFY2(cache.Icon(*item, &icon) && icon.width() == 94, "The rendered icon must be cached");
+
+    QVERIFY(cache.Render(item, MakeImage()));
+    QVERIFY2(!spy.wait(100) && cache.stats().rendered == 1, "Cached items must not be rendered again");
+}
+
+void TestRenderCache::ChangedItem() {
+    RenderCache cache;
+    auto item = MakeItem(false);
+    auto corrupted = MakeItem(true);
+    QVERIFY2(item->hash() == corrupted->hash(), "The test expects the flag to be left out of the hash");
+
+    cache.Insert(*item, GenerateItemTooltipText(*item));
+    QVERIFY2(cache.Tooltip(*item), "Inserted tooltips must be cached");
+    QVERIFY2(!cache.Tooltip(*corrupted), "A changed item must not get the tooltip of the old one");
+}
+
+void TestRenderCache::Eviction() {
+    RenderCache cache(1);
+    auto first = MakeItem(false);
+    auto second = MakeItem(true);
+    cache.Insert(*first, GenerateItemTooltipText(*first));
+    cache.Insert(*second, GenerateItemTooltipText(*second));
+    QVERIFY2(cache.Tooltip(*second) && !cache.Tooltip(*first), "The least recently used item must be evicted");
+    QVERIFY2(cache.stats().evictions == 1, "Evictions must be counted");
+}
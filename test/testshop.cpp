@@ -1,16 +1,79 @@
 #include "testshop.h"
 
 #include <QNetworkAccessManager>
+#include <QSignalSpy>
 #include <memory>
+#include <random>
 #include "rapidjson/document.h"
 
 #include "application.h"
 #include "buyoutmanager.h"
+#include "datastore.h"
 #include "itemsmanager.h"
+#include "mockforum.h"
 #include "porting.h"
 #include "shop.h"
+#include "shoplayout.h"
 #include "testdata.h"
+#include "util.h"
 
+namespace {
+
+const int kBenchmarkGroups = 300;
+
+// Points the shop at forum for as long as it lives
+class ForumSession {
+public:
+    ForumSession(Application &app, const MockForum &forum):
+        app_(app)
+    {
+        app_.logged_in_nm().setNetworkAccessible(QNetworkAccessManager::Accessible);
+        app_.shop().SetForumUrls(forum.edit_thread_url(), forum.verify_url());
+    }
+    ~ForumSession() {
+        app_.logged_in_nm().setNetworkAccessible(QNetworkAccessManager::NotAccessible);
+        app_.shop().SetForumUrls("https://www.pathofexile.com/forum/edit-thread/", "http://verify.poe.trade/");
+    }
+private:
+    Application &app_;
+};
+
+ShopGroup MakeGroup(const std::string &header, size_t items, size_t item_size) {
+    ShopGroup group;
+    group.header = header;
+    for (size_t i = 0; i < items; ++i) {
+        std::string item = "[" + header + std::to_string(i) + "]";
+        group.items.push_back(item + std::string(item_size - item.size(), 'x'));
+    }
+    return group;
+}
+
+// A shop shaped like a real one, with forum codes of realistic length
+std::vector<ShopGroup> MakeShop(std::mt19937 &rng) {
+    std::vector<ShopGroup> groups;
+    for (int i = 0; i < kBenchmarkGroups; ++i)
+        groups.push_back(MakeGroup("[spoiler=\"~price " + std::to_string(i) + " chaos\"]", rng() % 60 + 1, 70));
+    return groups;
+}
+
+// Checks that every item is posted exactly once and no post is too long
+bool Complete(const std::vector<ShopGroup> &groups, const std::vector<std::string> &posts, size_t capacity) {
+    std::string all;
+    for (auto &post : posts) {
+        if (post.size() > capacity)
+            return false;
+        all += post;
+    }
+    for (auto &group : groups)
+        for (auto &item : group.items) {
+            size_t pos = all.find(item);
+            if (pos == std::string::npos || all.find(item, pos + 1) != std::string::npos)
+                return false;
+        }
+    return true;
+}
+
+}
 
 void TestShop::initTestCase() {
     auto null_nm = std::make_unique<QNetworkAccessManager>();
@@ -57,3 +120,163 @@ void TestShop::TemplatedShopGeneration() {
     QVERIFY(shop[0].find("~price") != std::string::npos);
     QVERIFY(shop[0].find("My awesome shop") != std::string::npos);
 }
+
+void TestShop::SubmitChangedThreads() {
+    rapidjson::Document doc;
+    doc.Parse(kItem1.c_str());
+
+    Items items = { std::make_shared<Item>(doc) };
+    app_.items_manager().OnItemsRefreshed(items, {}, true);
+
+    Buyout bo;
+    bo.type = BUYOUT_TYPE_FIXED;
+    bo.value = 10;
+    bo.currency = CURRENCY_CHAOS_ORB;
+    app_.buyout_manager().Set(*items[0], bo);
+
+    Shop &shop = app_.shop();
+    shop.SetThread({ "111", "222" });
+    shop.Update();
+    QVERIFY(shop.shop_data().size() == 1);
+    // pretend the second, empty thread was submitted before
+    app_.data().Set("shop_hash_222", Util::Md5("Empty"));
+
+    shop.SubmitShopToForum();
+    QVERIFY(shop.thread_status().size() == 2);
+    QVERIFY2(shop.thread_status()[0].state == ShopThreadState::Submitting, "A new thread must be submitted");
+    QVERIFY2(shop.thread_status()[1].state == ShopThreadState::Unchanged, "An unchanged thread must not be submitted");
+
+    // there is no network, so the submission fails
+    QTRY_VERIFY_WITH_TIMEOUT(!shop.submitting(), 5000);
+    QVERIFY(shop.thread_status()[0].state == ShopThreadState::Failed);
+    QVERIFY2(app_.data().Get("shop_hash_111").empty(), "Failed threads must be submitted again next time");
+
+    app_.data().Set("shop_hash_111", shop.thread_status()[0].hash);
+    shop.SubmitShopToForum();
+    QVERIFY2(!shop.submitting(), "Nothing must be submitted if no thread changed");
+
+    shop.SubmitShopToForum(true);
+    QVERIFY2(shop.submitting() && shop.thread_status()[1].state == ShopThreadState::Submitting,
+             "Forced submissions must include unchanged threads");
+    QTRY_VERIFY_WITH_TIMEOUT(!shop.submitting(), 5000);
+}
+
+void TestShop::SubmitInParallel() {
+    MockForum forum;
+    forum.SetDelay(50);
+    ForumSession session(app_, forum);
+
+    Shop &shop = app_.shop();
+    shop.SetThread({ "1", "2", "3", "4", "5", "6", "7" });
+    QSignalSpy progress(&shop, SIGNAL(StatusUpdate(CurrentStatusUpdate)));
+    shop.SubmitShopToForum(true);
+    QTRY_VERIFY_WITH_TIMEOUT(!shop.submitting(), 10000);
+
+    for (auto &thread : shop.thread_status())
+        QVERIFY2(thread.state == ShopThreadState::Submitted, thread.id.c_str());
+    QVERIFY(forum.posts().size() == 7);
+    QVERIFY(forum.posts().at("7") == "Empty");
+    QVERIFY2(forum.max_concurrent() > 1, "Threads must be submitted in parallel");
+    QVERIFY2(forum.max_concurrent() <= static_cast<int>(kShopMaxParallel), "Too many threads submitted at once");
+    QTRY_VERIFY_WITH_TIMEOUT(forum.verified() == 7, 5000);
+    // one update when starting and one for each finished thread
+    QVERIFY(progress.count() == 8);
+    QVERIFY(app_.data().Get("shop_hash_3") == Util::Md5("Empty"));
+}
+
+void TestShop::SubmitRateLimited() {
+    MockForum forum;
+    forum.SetRateLimited(2);
+    ForumSession session(app_, forum);
+
+    Shop &shop = app_.shop();
+    shop.SetThread({ "1", "2", "3" });
+    shop.SubmitShopToForum(true);
+    QTRY_VERIFY_WITH_TIMEOUT(!shop.submitting(), 10000);
+
+    QVERIFY(forum.limited_requests() == 2);
+    for (auto &thread : shop.thread_status())
+        QVERIFY2(thread.state == ShopThreadState::Submitted, "Rate limited threads must be tried again");
+    QVERIFY(forum.posts().size() == 3);
+}
+
+void TestShop::SubmitMissingThread() {
+    MockForum forum;
+    forum.SetMissing("2");
+    ForumSession session(app_, forum);
+
+    Shop &shop = app_.shop();
+    shop.SetThread({ "1", "2", "3" });
+    shop.SubmitShopToForum(true);
+    QTRY_VERIFY_WITH_TIMEOUT(!shop.submitting(), 10000);
+
+    QVERIFY(shop.thread_status()[0].state == ShopThreadState::Submitted);
+    QVERIFY2(shop.thread_status()[1].state == ShopThreadState::Failed, "A missing thread must not be retried");
+    QVERIFY2(shop.thread_status()[2].state == ShopThreadState::Submitted, "A failed thread must not hold back the others");
+    QVERIFY(forum.posts().count("2") == 0);
+    QVERIFY(app_.data().Get("shop_hash_2").empty());
+}
+
+void TestShop::LayoutSplitsGroups() {
+    // three groups of 74 characters: kept whole they need three posts
+    std::vector<ShopGroup> groups;
+    for (auto header : { "[a]", "[b]", "[c]" })
+        groups.push_back(MakeGroup(header, 6, 10));
+    ShopPlacement placement;
+    std::vector<std::string> posts = LayoutShop(groups, 130, &placement);
+    QVERIFY2(posts.size() == 2, "Splitting a group must be preferred to an extra post");
+    QVERIFY(Complete(groups, posts, 130));
+
+    placement.clear();
+    posts = LayoutShop(groups, 160, &placement);
+    QVERIFY2(posts.size() == 2 && posts[1] == groups[2].header + Util::StringJoin(groups[2].items, "") + "[/spoiler]",
+             "Groups must be kept whole when that needs no more posts");
+}
+
+void TestShop::LayoutOversizedGroup() {
+    std::vector<ShopGroup> groups = { MakeGroup("[a]", 50, 10), MakeGroup("[b]", 1, 10) };
+    ShopPlacement placement;
+    std::vector<std::string> posts = LayoutShop(groups, 100, &placement);
+    QVERIFY2(posts.size() == 6, "A group larger than a post must fill whole posts");
+    QVERIFY(Complete(groups, posts, 100));
+}
+
+void TestShop::LayoutStable() {
+    std::mt19937 rng(3);
+    std::vector<ShopGroup> groups = MakeShop(rng);
+    const size_t capacity = 50000;
+    ShopPlacement placement;
+    std::vector<std::string> before = LayoutShop(groups, capacity, &placement);
+    QVERIFY(Complete(groups, before, capacity));
+
+    ShopPlacement same;
+    QVERIFY2(LayoutShop(groups, capacity, &same) == before, "Layouts must be deterministic");
+
+    // a new item with an existing buyout
+    groups[100].items.push_back(std::string(70, 'y'));
+    placement = DeserializeShopPlacement(SerializeShopPlacement(placement));
+    std::vector<std::string> after = LayoutShop(groups, capacity, &placement);
+    QVERIFY(Complete(groups, after, capacity));
+    QVERIFY2(after.size() == before.size(), "One more item must not need another post");
+    int changed = 0;
+    for (size_t i = 0; i < after.size(); ++i)
+        if (after[i] != before[i])
+            ++changed;
+    QVERIFY2(changed == 1, "Only the post with the changed group must change");
+}
+
+void TestShop::LayoutBenchmark() {
+    std::mt19937 rng(4);
+    std::vector<ShopGroup> groups = MakeShop(rng);
+    size_t items = 0, size = 0;
+    for (auto &group : groups)
+        items += group.items.size();
+    std::vector<std::string> posts;
+    QBENCHMARK {
+        ShopPlacement placement;
+        posts = LayoutShop(groups, 50000, &placement);
+    }
+    for (auto &post : posts)
+        size += post.size();
+    qDebug() << items << "items in" << posts.size() << "posts, at least" << (size + 49999) / 50000 << "needed";
+}
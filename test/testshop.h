@@ -11,6 +11,14 @@ private slots:
     void initTestCase();
     void SocketedGemsNotLinked();
     void TemplatedShopGeneration();
+    void SubmitChangedThreads();
+    void SubmitInParallel();
+    void SubmitRateLimited();
+    void SubmitMissingThread();
+    void LayoutSplitsGroups();
+    void LayoutOversizedGroup();
+    void LayoutStable();
+    void LayoutBenchmark();
 private:
     Application app_;
 };
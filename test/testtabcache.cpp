@@ -0,0 +1,198 @@
+/*
+    Copyright 2019 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testtabcache.h"
+
+#include <QDir>
+#include <QTemporaryDir>
+#include <memory>
+
+#include "tabcache.h"
+
+namespace {
+
+QUrl TabUrl(int index) {
+    return QUrl("https://www.pathofexile.com/character-window/get-stash-items?tabIndex=" + QString::number(index));
+}
+
+// Stores body for url the way QNetworkAccessManager does
+void Insert(TabCache &cache, const QUrl &url, const QByteArray &body) {
+    QNetworkCacheMetaData meta_data;
+    meta_data.setUrl(url);
+    QIODevice *device = cache.prepare(meta_data);
+    QVERIFY2(device, "The cache must accept entries");
+    device->write(body);
+    cache.insert(device);
+}
+
+QByteArray Read(TabCache &cache, const QUrl &url) {
+    std::unique_ptr<QIODevice> device(cache.data(url));
+    return device ? device->readAll() : QByteArray();
+}
+
+QByteArray Body(int tab) {
+    return "{\"numTabs\":3,\"items\":[{\"typeLine\":\"Tab " + QByteArray::number(tab) + "\"}]," + QByteArray(1000, ' ') + "}";
+}
+
+}
+
+void TestTabCache::Deduplication() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+
+    Insert(cache, TabUrl(1), Body(1));
+    qint64 size = cache.cacheSize();
+    QVERIFY2(size > 0 && size < Body(1).size(), "Bodies must be stored compressed");
+    Insert(cache, TabUrl(2), Body(1));
+    QVERIFY2(cache.entry_count() == 2 && cache.body_count() == 1 && cache.cacheSize() == size,
+             "Identical bodies must be stored once");
+    QVERIFY2(cache.stats().deduplicated == 1, "The second insert must be counted as deduplicated");
+    QVERIFY2(Read(cache, TabUrl(2)) == Body(1), "Deduplicated entries must read back their body");
+
+    cache.remove(TabUrl(1));
+    QVERIFY2(Read(cache, TabUrl(2)) == Body(1), "Removing an entry must keep bodies other entries use");
+    cache.remove(TabUrl(2));
+    QVERIFY2(cache.body_count() == 0 && cache.cacheSize() == 0, "Bodies no entry uses must be dropped");
+    cache.Sync();
+    QVERIFY2(QDir(dir.path() + "/blobs").isEmpty(), "Bodies no entry uses must be deleted once the index is written");
+    QVERIFY2(!cache.data(TabUrl(2)) && cache.stats().misses == 1, "Removed entries must miss");
+}
+
+void TestTabCache::LruEviction() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+
+    Insert(cache, TabUrl(1), Body(1));
+    qint64 entry_size = cache.cacheSize();
+    cache.setMaximumCacheSize(entry_size * 5 / 2);
+    Insert(cache, TabUrl(2), Body(2));
+    // reading the first tab makes the second one the least recently used
+    QVERIFY(!Read(cache, TabUrl(1)).isEmpty());
+    Insert(cache, TabUrl(3), Body(3));
+    QVERIFY2(cache.entry_count() == 2 && cache.stats().evictions == 1, "The cache must not grow past its maximum size");
+    QVERIFY2(cache.metaData(TabUrl(2)).isValid() == false, "The least recently used entry must be evicted");
+    QVERIFY2(cache.metaData(TabUrl(1)).isValid() && cache.metaData(TabUrl(3)).isValid(),
+             "Recently used entries must be kept");
+}
+
+void TestTabCache::Integrity() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+    Insert(cache, TabUrl(1), Body(1));
+    Insert(cache, TabUrl(2), Body(1));
+
+    QDir blobs(dir.path() + "/blobs");
+    QFile body(blobs.filePath(blobs.entryList(QDir::Files).first()));
+    QVERIFY(body.open(QIODevice::ReadWrite));
+    body.seek(body.size() / 2);
+    body.write("damage");
+    body.close();
+
+    QVERIFY2(!cache.data(TabUrl(1)), "Damaged bodies must not be returned");
+    QVERIFY2(cache.entry_count() == 0 && cache.stats().corrupt == 2, "Every entry with a damaged body must be dropped");
+    QVERIFY2(blobs.entryList(QDir::Files).isEmpty(), "Damaged bodies must be deleted");
+}
+
+void TestTabCache::Refresh() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+    Insert(cache, TabUrl(1), Body(1));
+    qint64 written = cache.stats().bytes_written;
+
+    cache.Request(TabUrl(1), TabCache::Refresh);
+    QVERIFY2(cache.metaData(TabUrl(1)).expirationDate() < QDateTime::currentDateTime(),
+             "Refreshed entries must be stale so they are fetched again");
+    QVERIFY2(cache.body_count() == 1, "Refreshed entries must keep their body until the new one arrives");
+    Insert(cache, TabUrl(1), Body(1));
+    QVERIFY2(cache.stats().deduplicated == 1 && cache.stats().bytes_written == written,
+             "An unchanged body must not be written again");
+    QVERIFY2(cache.metaData(TabUrl(1)).expirationDate() > QDateTime::currentDateTime(),
+             "Inserting must make the entry fresh again");
+}
+
+void TestTabCache::IndexSync() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+    Insert(cache, TabUrl(1), Body(1));
+    Insert(cache, TabUrl(2), Body(2));
+    QString index = dir.path() + "/index";
+    QVERIFY2(!QFile::exists(index), "Inserts must not write the index");
+    cache.Sync();
+    QVERIFY2(QFile::exists(index), "Sync must write a changed index");
+    QFile::remove(index);
+    cache.Sync();
+    QVERIFY2(!QFile::exists(index), "Sync must not write an unchanged index");
+}
+
+void TestTabCache::InterruptedRefresh() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    QTemporaryDir crashed;
+    QVERIFY2(crashed.isValid(), "Failed to create a temporary directory");
+    {
+        TabCache cache;
+        cache.setCacheDirectory(dir.path());
+        Insert(cache, TabUrl(1), Body(1));
+        cache.Sync();
+        // the tab changes during a refresh that never gets to Sync
+        cache.Request(TabUrl(1), TabCache::Refresh);
+        Insert(cache, TabUrl(1), Body(2));
+        // what a crash would leave on disk
+        QDir(crashed.path()).mkpath("blobs");
+        QFile::copy(dir.path() + "/index", crashed.path() + "/index");
+        QDir blobs(dir.path() + "/blobs");
+        for (auto &name : blobs.entryList(QDir::Files))
+            QFile::copy(blobs.filePath(name), crashed.path() + "/blobs/" + name);
+    }
+    TabCache cache;
+    cache.setCacheDirectory(crashed.path());
+    QVERIFY2(cache.stats().corrupt == 0, "Bodies the index refers to must survive until it is written again");
+    QVERIFY2(Read(cache, TabUrl(1)) == Body(1), "The entry must read back the body of the last written index");
+}
+
+void TestTabCache::Persistence() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create a temporary directory");
+    {
+        TabCache cache;
+        cache.setCacheDirectory(dir.path());
+        Insert(cache, TabUrl(1), Body(1));
+        Insert(cache, TabUrl(2), Body(2));
+        Read(cache, TabUrl(1));
+    }
+    TabCache cache;
+    cache.setCacheDirectory(dir.path());
+    QVERIFY2(cache.entry_count() == 2, "Entries must be loaded from the index");
+    QVERIFY2(cache.stored(TabUrl(1)).isValid() && cache.stored(TabUrl(1)) <= QDateTime::currentDateTime(),
+             "When entries were stored must be loaded from the index");
+    QVERIFY(!cache.stored(TabUrl(3)).isValid());
+    cache.setMaximumCacheSize(cache.cacheSize() - 1);
+    QVERIFY2(!cache.metaData(TabUrl(2)).isValid(), "The order of use must survive restarts");
+    QVERIFY2(Read(cache, TabUrl(1)) == Body(1), "Loaded entries must read back their body");
+}
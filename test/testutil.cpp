@@ -19,6 +19,9 @@
 
 #include "testutil.h"
 
+#include <algorithm>
+
+#include "itembitmap.h"
 #include "util.h"
 
 const double kDelta = 1e-6;
@@ -33,3 +36,34 @@ void TestUtil::TestModMatcher() {
     QVERIFY(Util::MatchMod("Adds #-# Physical Damage", "Adds 1.5-3.2 Physical Damage", &result));
     QCOMPAREDOUBLE(result, (1.5 + 3.2) / 2);
 }
+
+void TestUtil::TestItemBitmap() {
+    ItemBitmap sparse, dense;
+    for (ItemId id = 0; id < 100000; id += 7)
+        sparse.Add(id);
+    for (ItemId id = 0; id < 100000; ++id)
+        dense.Add(id);
+    // Adding twice must not change anything
+    sparse.Add(14);
+    dense.Add(14);
+
+    QCOMPARE(sparse.Cardinality(), static_cast<size_t>(14286));
+    QCOMPARE(dense.Cardinality(), static_cast<size_t>(100000));
+    QVERIFY(sparse.Contains(70));
+    QVERIFY(!sparse.Contains(71));
+    QVERIFY(dense.Contains(99999));
+    QVERIFY(!dense.Contains(100000));
+
+    ItemBitmap both = sparse & dense;
+    QVERIFY(both == sparse);
+
+    ItemBitmap odd;
+    for (ItemId id = 1; id < 100000; id += 2)
+        odd.Add(id);
+    ItemBitmap odd_sevens = sparse & odd;
+    QCOMPARE(odd_sevens.Cardinality(), static_cast<size_t>(7143));
+    std::vector<ItemId> ids = odd_sevens.ToVector();
+    QCOMPARE(ids.front(), static_cast<ItemId>(7));
+    QCOMPARE(ids.back(), static_cast<ItemId>(99995));
+    QVERIFY(std::is_sorted(ids.begin(), ids.end()));
+}
@@ -27,4 +27,5 @@ class TestUtil : public QObject
     Q_OBJECT
 private slots:
     void TestModMatcher();
+    void TestItemBitmap();
 };